@@ -0,0 +1,536 @@
+/*
+ * File:     arith_fuzz.c
+ * Purpose:  compare old and Shura-Bura arithmetic of m20_cpu.c
+ *           on random and boundary operands, measure speed
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *
+ */
+
+
+#include "m20_defs.h"
+#include <time.h>
+#include <stdarg.h>
+
+#if _WIN32
+#include "getopt.h"
+#else
+#include <unistd.h>
+#endif
+
+
+/*------------------------------- GNU C library -----------------------------*/
+#if _WIN32
+extern int       opterr;
+extern int       optind;
+extern char     *optarg;
+#endif
+
+
+/* Local data */
+
+extern  int        optind;
+extern  int        opterr;
+extern  char     * optarg;
+
+long          rand_count = 1000000;
+unsigned long seed = 1963;
+int           max_examples = 5;
+int           verbose = 0;
+
+
+const char prog_ver[] = "1.0.0";
+const char rcs_id[] = "$Id$";
+
+
+/* m20_cpu.c */
+extern t_value regRMR;
+extern int     arithmetic_op_debug;
+extern int     new_arith_verify;
+
+extern t_stat  addition_v44_op (t_value *result, t_value x, t_value y, int op_code);
+extern t_stat  new_arithmetic_op (t_value *result, t_value x, t_value y, int op_code);
+extern t_stat  multiplication (t_value *result, t_value x, t_value y, int no_round, int no_norm);
+extern t_stat  new_arithmetic_mult_op (t_value *result, t_value x, t_value y, int op_code);
+extern t_stat  division (t_value *result, t_value x, t_value y, int no_round);
+extern t_stat  new_arithmetic_div_op (t_value *result, t_value x, t_value y, int op_code);
+extern t_stat  square_root (t_value *result, t_value x, int no_round);
+extern t_stat  new_arithmetic_square_root (t_value *result, t_value x, int op_code);
+
+
+/* Result of one call */
+typedef struct {
+    t_value  rr;
+    t_value  rmr;
+    t_stat   rc;
+} ARITH_RES;
+
+typedef t_stat (*ARITH_FN) (t_value *result, t_value x, t_value y, int op_code);
+
+/* Pair of routines to compare */
+typedef struct {
+    const char * name;
+    const char * old_name;
+    const char * new_name;
+    ARITH_FN     old_fn;
+    ARITH_FN     new_fn;
+    int          use_rmr;
+    int          ops[12];
+} ARITH_PAIR;
+
+
+/* Old routines with op_code interface (as in op_mult, op_div, op_sqrt) */
+static t_stat old_mult (t_value *result, t_value x, t_value y, int op_code)
+{
+    return multiplication (result, x, y, op_code >> 4 & 1, op_code >> 5 & 1);
+}
+
+static t_stat old_div (t_value *result, t_value x, t_value y, int op_code)
+{
+    return division (result, x, y, op_code >> 4 & 1);
+}
+
+static t_stat old_sqrt (t_value *result, t_value x, t_value y, int op_code)
+{
+    return square_root (result, x, op_code >> 4 & 1);
+}
+
+static t_stat new_sqrt (t_value *result, t_value x, t_value y, int op_code)
+{
+    return new_arithmetic_square_root (result, x, op_code);
+}
+
+
+static ARITH_PAIR pairs[] = {
+    { "ADD",  "new_addition_v44", "new_arithmetic_op",          addition_v44_op, new_arithmetic_op,      0,
+      { 001, 021, 041, 061, 002, 022, 042, 062, 003, 023, 043, 063 } },
+    { "MULT", "multiplication",   "new_arithmetic_mult_op",     old_mult,        new_arithmetic_mult_op, 1,
+      { 005, 025, 045, 065, -1 } },
+    { "DIV",  "division",         "new_arithmetic_div_op",      old_div,         new_arithmetic_div_op,  0,
+      { 004, 024, -1 } },
+    { "SQRT", "square_root",      "new_arithmetic_square_root", old_sqrt,        new_sqrt,               0,
+      { 044, 064, -1 } },
+    { NULL }
+};
+
+
+/* Boundary values of exponent and mantissa */
+static const int edge_exp[] = { 0, 1, 2, 077, 0100, 0101, 0176, 0177 };
+static const t_value edge_mant[] = {
+    0, 1, 2,
+    0377777777777LL, 0400000000000LL, 0400000000001LL,
+    0777777777776LL, 0777777777777LL
+};
+
+#define EDGE_EXP_COUNT   (sizeof(edge_exp)/sizeof(edge_exp[0]))
+#define EDGE_MANT_COUNT  (sizeof(edge_mant)/sizeof(edge_mant[0]))
+#define EDGE_COUNT       (EDGE_EXP_COUNT * EDGE_MANT_COUNT * 2 + 2)
+
+
+/*------------------------------- SCP stubs ---------------------------------*/
+/* m20_cpu.o refers to them, but arithmetic never calls them */
+
+FILE *   sim_deb = NULL;
+int32    sim_interval = 0;
+int32    sim_step = 0;
+uint32   sim_brk_types = 0;
+uint32   sim_brk_dflt = 0;
+uint32   sim_brk_summ = 0;
+BRKTAB **sim_brk_tab = NULL;
+int32    sim_brk_ent = 0;
+UNIT *   sim_clock_queue = QUEUE_LIST_END;
+CTAB *   sim_vm_cmd = NULL;
+CTAB     m20_cmd[] = { { NULL } };
+volatile t_bool sim_is_running = FALSE;
+
+int Fprintf (FILE *f, const char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start (args, fmt);
+    n = vfprintf (f, fmt, args);
+    va_end (args);
+    return n;
+}
+
+void sim_printf (const char *fmt, ...)
+{
+    va_list args;
+
+    va_start (args, fmt);
+    vfprintf (stdout, fmt, args);
+    va_end (args);
+}
+
+t_stat sim_messagef (t_stat stat, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start (args, fmt);
+    vfprintf (stdout, fmt, args);
+    va_end (args);
+    return stat;
+}
+
+t_stat sim_process_event (void) { return SCPE_OK; }
+t_stat sim_cancel_step (void) { return SCPE_OK; }
+uint32 sim_brk_test (t_addr bloc, uint32 btyp) { return 0; }
+BRKTAB *sim_brk_fnd (t_addr loc) { return NULL; }
+FILE *sim_fopen (const char *file, const char *mode) { return fopen (file, mode); }
+size_t sim_strlcpy (char *dst, const char *src, size_t size)
+{
+    size_t len = strlen (src);
+
+    if (size) {
+        size_t n = (len < size) ? len : size - 1;
+        memcpy (dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+t_value get_uint (const char *cptr, uint32 radix, t_value max, t_stat *status)
+{
+    *status = SCPE_ARG;
+    return 0;
+}
+t_value strtotv (CONST char *cptr, CONST char **endptr, uint32 radix)
+{
+    if (endptr) *endptr = cptr;
+    return 0;
+}
+t_stat fprint_sym (FILE *ofile, t_addr addr, t_value *val, UNIT *uptr, int32 sw)
+{
+    return SCPE_ARG;
+}
+
+t_stat read_card (t_value * csum, t_value * rsum, int * rcodes,
+                  int * stop_blocking, int * control_blocking) { return STOP_EXTDEVIOUNSUPP; }
+t_stat punch_card (int start_addr, int end_addr, int zone_buf_addr, int add_only_flag,
+                   int dis_mem_acc, int dis_chksum, int * ocodes, t_value *sum ) { return STOP_EXTDEVIOUNSUPP; }
+t_stat write_line_printer (int start_addr, int end_addr, int zone_buf_addr, int pr_type,
+                           int add_only_flag, int dis_mem_acc, int dis_chksum,
+                           int * ocodes ) { return STOP_EXTDEVIOUNSUPP; }
+t_stat drum_io (t_value * sum, int * ocodes) { return STOP_EXTDEVIOUNSUPP; }
+t_stat mt_format_tape (t_value *sum, int * ocodes, int user_first, int user_last) { return STOP_EXTDEVIOUNSUPP; }
+t_stat mt_tape_io (t_value *sum, int * ocodes) { return STOP_EXTDEVIOUNSUPP; }
+t_stat m20_aio_check (void) { return SCPE_OK; }
+t_stat m20_aio_flush (void) { return SCPE_OK; }
+t_stat m20_hle_call (int ret, int entry, int link) { return SCPE_OK; }
+t_stat m20_hle_show (FILE *st, UNIT *uptr, int32 val, CONST void *desc) { return SCPE_OK; }
+int    m20_jrn_mode = 0;
+t_stat m20_jrn_io (int op, int a1, int a2, int a3, M20_JRN_IO io) { return io (op, a1, a2, a3); }
+t_stat m20_jrn_run (void) { return SCPE_OK; }
+void   m20_jrn_stop (void) { }
+t_stat m20_jrn_mark (t_stat r) { return r; }
+t_stat m20_jrn_set (UNIT *uptr, int32 val, CONST char *cptr, void *desc) { return SCPE_NOFNC; }
+t_stat m20_jrn_show (FILE *st, UNIT *uptr, int32 val, CONST void *desc) { return SCPE_OK; }
+
+
+
+
+/*----------------------- Functions ---------------------------------------*/
+
+
+/*
+ *  Print help screen
+ */
+void usage(void)
+{
+  fprintf( stderr, "\n" );
+  fprintf( stderr, "Compare old and Shura-Bura arithmetic of M-20 emulator, version %s\n", prog_ver );
+  fprintf( stderr, "Copyright (C) 2026 agent. All rights reserved.\n" );
+  fprintf( stderr, "Usage: arith_fuzz [-hvV] [-n count] [-s seed] [-e examples]\n" );
+  fprintf( stderr, "       -h   this help\n" );
+  fprintf( stderr, "       -v   verbose output (per opcode statistics)\n" );
+  fprintf( stderr, "       -V   NEW_ARITH_VERIFY=1 (run also bit-serial digit loops)\n" );
+  fprintf( stderr, "       -n   random operand pairs per opcode\n" );
+  fprintf( stderr, "       -s   random seed\n" );
+  fprintf( stderr, "       -e   mismatch examples to print per opcode\n" );
+  fprintf( stderr, "Default parameters:\n" );
+  fprintf( stderr, "   -n 1000000 -s 1963 -e 5\n" );
+  fprintf( stderr, "Mismatches of old and new routines are printed for information,\n" );
+  fprintf( stderr, "results hash must not change when a routine is optimized.\n" );
+  fprintf( stderr, "Exit code is 1 if -V found divergence of digit loops.\n" );
+  fprintf( stderr, "Sample command line:\n" );
+  fprintf( stderr, "   ./arith_fuzz -v -n 5000000\n" );
+  fprintf( stderr, "\n" );
+  exit(1);
+}
+
+
+/*
+ *  Random generator (xorshift64)
+ */
+static t_uint64 rnd_state;
+
+static t_uint64 rnd (void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+
+/*
+ *  Random M-20 word: a quarter of any bits, the rest normalized
+ *  with exponents near 0100 (so that addition aligns mantissas).
+ */
+static t_value rnd_word (void)
+{
+    t_value w, r;
+
+    r = rnd ();
+    if ((r & 3) == 0)
+        return (rnd () & (TAG | SIGN | EXPONENT | MANTISSA));
+
+    w = (rnd () & MANTISSA) | BIT36;
+    if ((r >> 2 & 7) == 0) w >>= (r >> 5) % BITS_36;
+    w |= (t_value) ((0100 + (int)((r >> 12) % 81) - 40) & 0177) << BITS_36;
+    if (r >> 20 & 1) w |= SIGN;
+    if ((r >> 21 & 037) == 0) w |= TAG;
+
+    return w;
+}
+
+
+/*
+ *  Boundary words: every exponent and mantissa from tables with both signs,
+ *  machine zero and tagged 0.5
+ */
+static int make_edges (t_value * w)
+{
+    int e, m, s, n = 0;
+
+    for (e = 0; e < (int)EDGE_EXP_COUNT; e++)
+        for (m = 0; m < (int)EDGE_MANT_COUNT; m++)
+            for (s = 0; s < 2; s++)
+                w[n++] = (s ? SIGN : 0) | ((t_value) edge_exp[e] << BITS_36) | edge_mant[m];
+    w[n++] = 0;
+    w[n++] = TAG | ((t_value) 0101 << BITS_36) | BIT36;
+
+    return n;
+}
+
+
+/*
+ *  Host time in nanoseconds
+ */
+static double now_ns (void)
+{
+#if _WIN32
+    return (double) clock () * (1e9 / CLOCKS_PER_SEC);
+#else
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+
+/*
+ *  Run one routine over operands, return time in nanoseconds
+ */
+static double run_fn (ARITH_FN fn, int op, const t_value * x, const t_value * y,
+                      long count, ARITH_RES * res)
+{
+    long i;
+    double t0;
+
+    t0 = now_ns ();
+    for (i = 0; i < count; i++) {
+        res[i].rr = ~(t_value) 0;
+        regRMR = ~(t_value) 0;
+        res[i].rc = fn (&res[i].rr, x[i], y[i], op);
+        res[i].rmr = regRMR;
+    }
+    return now_ns () - t0;
+}
+
+
+/*
+ *  Hash of results (FNV-1a like), result words only for successful calls
+ */
+static t_uint64 res_hash (t_uint64 h, const ARITH_RES * r, long count, int use_rmr)
+{
+    long i;
+    t_value v[3];
+    int k, nv;
+
+    for (i = 0; i < count; i++) {
+        nv = 0;
+        v[nv++] = (t_value) r[i].rc;
+        if (r[i].rc == SCPE_OK) {
+            v[nv++] = r[i].rr;
+            if (use_rmr) v[nv++] = r[i].rmr;
+        }
+        for (k = 0; k < nv; k++) {
+            h ^= v[k];
+            h *= 0x100000001b3LL;
+            h ^= h >> 29;
+        }
+    }
+    return h;
+}
+
+
+/*
+ *  Compare results of two routines, print first mismatches
+ */
+static long compare (const ARITH_PAIR * p, int op, const t_value * x, const t_value * y,
+                     long count, const ARITH_RES * ro, const ARITH_RES * rn, long printed)
+{
+    long i, bad = 0;
+    int same;
+
+    for (i = 0; i < count; i++) {
+        same = (ro[i].rc == rn[i].rc);
+        if (same && ro[i].rc == SCPE_OK) {
+            same = (ro[i].rr == rn[i].rr);
+            if (p->use_rmr && ro[i].rmr != rn[i].rmr) same = 0;
+        }
+        if (same) continue;
+
+        bad++;
+        if (printed + bad <= max_examples) {
+            printf ("  %s %03o: x=%015llo y=%015llo\n", p->name, op, x[i], y[i]);
+            printf ("      old: rc=%d rr=%015llo", ro[i].rc, ro[i].rr);
+            if (p->use_rmr) printf (" rmr=%015llo", ro[i].rmr);
+            printf ("\n      new: rc=%d rr=%015llo", rn[i].rc, rn[i].rr);
+            if (p->use_rmr) printf (" rmr=%015llo", rn[i].rmr);
+            printf ("\n");
+        }
+    }
+    return bad;
+}
+
+
+
+
+/*
+ *  Main program stream
+ */
+int main( int argc, char ** argv )
+{
+  int                 ret_code = 0;
+  int                 op, k, i, j, n_edges;
+  long                n, total, bad, bad_op, printed, edge_pairs, diverged;
+  t_uint64            h_old, h_new;
+  double              t_old, t_new, ns_old, ns_new;
+  t_value             edges [EDGE_COUNT];
+  t_value           * x;
+  t_value           * y;
+  ARITH_RES         * ro;
+  ARITH_RES         * rn;
+  const ARITH_PAIR  * p;
+
+/* Process command line  */
+  opterr = 0;
+  while( (op = getopt(argc,argv,"vVhn:s:e:")) != -1)
+    switch(op) {
+      case 'n':
+               rand_count = atol(optarg);
+               break;
+      case 's':
+               seed = strtoul(optarg, NULL, 0);
+               break;
+      case 'e':
+               max_examples = atoi(optarg);
+               break;
+      case 'v':
+               verbose = 1;
+               break;
+      case 'V':
+               new_arith_verify = 1;
+               break;
+      case 'h':
+               usage();
+               break;
+      default:
+               break;
+    }
+
+  if (rand_count < 0) usage();
+
+  arithmetic_op_debug = 0;
+
+  n_edges = make_edges (edges);
+  edge_pairs = (long) n_edges * n_edges;
+  total = edge_pairs + rand_count;
+
+  x  = (t_value *) malloc (total * sizeof(t_value));
+  y  = (t_value *) malloc (total * sizeof(t_value));
+  ro = (ARITH_RES *) malloc (total * sizeof(ARITH_RES));
+  rn = (ARITH_RES *) malloc (total * sizeof(ARITH_RES));
+  if (x == NULL || y == NULL || ro == NULL || rn == NULL) {
+    fprintf( stderr, "ERROR: not enough memory for %ld operands!\n", total );
+    return(10);
+  }
+
+  /* all pairs of boundary words, then random ones */
+  n = 0;
+  for (i = 0; i < n_edges; i++)
+      for (j = 0; j < n_edges; j++) {
+          x[n] = edges[i];
+          y[n] = edges[j];
+          n++;
+      }
+  rnd_state = seed ? seed : 1;
+  for (; n < total; n++) {
+      x[n] = rnd_word ();
+      y[n] = rnd_word ();
+  }
+
+  printf ("%ld boundary and %ld random operand pairs per opcode, seed %lu%s\n\n",
+          edge_pairs, rand_count, seed, new_arith_verify ? ", NEW_ARITH_VERIFY" : "");
+  printf ("%-5s %12s %12s %10s %10s\n", "", "mismatches", "calls", "old ns/op", "new ns/op");
+
+  diverged = 0;
+  for (p = pairs; p->name != NULL; p++) {
+      bad = 0;
+      printed = 0;
+      t_old = t_new = 0;
+      h_old = h_new = 0xcbf29ce484222325LL;
+      for (k = 0; k < 12 && p->ops[k] >= 0; k++) {
+          op = p->ops[k];
+          ns_old = run_fn (p->old_fn, op, x, y, total, ro);
+          ns_new = run_fn (p->new_fn, op, x, y, total, rn);
+          bad_op = compare (p, op, x, y, total, ro, rn, printed);
+          h_old = res_hash (h_old, ro, total, p->use_rmr);
+          h_new = res_hash (h_new, rn, total, p->use_rmr);
+          if (new_arith_verify)
+              for (n = 0; n < total; n++)
+                  if (rn[n].rc == STOP_ASSERT) diverged++;
+          printed += bad_op;
+          bad += bad_op;
+          t_old += ns_old;
+          t_new += ns_new;
+          if (verbose)
+              printf ("  %03o %12ld %12ld %10.1f %10.1f\n",
+                      op, bad_op, total, ns_old / total, ns_new / total);
+      }
+      printf ("%-5s %12ld %12ld %10.1f %10.1f   (%s / %s)\n", p->name, bad, total * k,
+              t_old / (total * k), t_new / (total * k), p->old_name, p->new_name);
+      printf ("%-5s results hash: old %016llx, new %016llx\n", "", h_old, h_new);
+  }
+
+  if (new_arith_verify) {
+      printf ("\nNEW_ARITH_VERIFY: %ld divergences of digit loops\n", diverged);
+      if (diverged) ret_code = 1;
+  }
+
+  free (x);
+  free (y);
+  free (ro);
+  free (rn);
+
+  return(ret_code);
+}
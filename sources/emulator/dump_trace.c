@@ -0,0 +1,286 @@
+/*
+ * File:     dump_trace.c
+ * Purpose:  dump binary CPU trace (SET CPU RINGTRACE) in text format
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *
+ */
+
+
+#include "m20_defs.h"
+#include <math.h>
+
+#if _WIN32
+#include "getopt.h"
+#else
+#include <unistd.h>
+#endif
+
+
+/*------------------------------- GNU C library -----------------------------*/
+#if _WIN32
+extern int       opterr;
+extern int       optind;
+extern char     *optarg;
+#endif
+
+
+/* Local data */
+
+extern  int        optind;
+extern  int        opterr;
+extern  char     * optarg;
+
+char         * in_file = NULL;
+int           verbose = 0;
+int           dump_regs = 0;
+int           dump_mem = 0;
+int           dump_modern_mem = 0;
+int           short_names = 0;
+long          last_count = 0;
+
+
+const char prog_ver[] = "1.0.0";
+const char rcs_id[] = "$Id$";
+
+
+/* M-20 opcode names (m20_eng.c) */
+extern const char *m20_opname [M20_SYM_OPCODE_TABLE_SIZE];
+extern const char *m20_short_opname [M20_SYM_OPCODE_TABLE_SIZE];
+
+
+
+
+/*----------------------- Functions ---------------------------------------*/
+
+
+/*
+ *  Print help screen
+ */
+void usage(void)
+{
+  fprintf( stderr, "\n" );
+  fprintf( stderr, "Dump binary CPU trace in text format, version %s\n", prog_ver );
+  fprintf( stderr, "Copyright (C) 2026 agent. All rights reserved.\n" );
+  fprintf( stderr, "Usage: dump_trace [-hvrmfs] [-n count] -i trace-file\n" );
+  fprintf( stderr, "       -h   this help\n" );
+  fprintf( stderr, "       -v   verbose output\n" );
+  fprintf( stderr, "       -r   dump registers (as DEBUG_DUMP_REGS)\n" );
+  fprintf( stderr, "       -m   dump operands (as DEBUG_DUMP_MEM)\n" );
+  fprintf( stderr, "       -f   dump operands as floating numbers (as DEBUG_DUMP_MODERM_MEM)\n" );
+  fprintf( stderr, "       -s   short symbolic instruction names\n" );
+  fprintf( stderr, "       -n   dump only last count instructions\n" );
+  fprintf( stderr, "Default parameters:\n" );
+  fprintf( stderr, "   all instructions, no registers and operands\n" );
+  fprintf( stderr, "Sample command line:\n" );
+  fprintf( stderr, "   ./dump_trace  -r -m -n 100 -i kt_1963.trc \n" );
+  fprintf( stderr, "\n" );
+  exit(1);
+}
+
+
+/*
+ *  M-20 number to host floating number
+ */
+double m20_to_ieee (t_value w)
+{
+    double d;
+    int exponent;
+
+    d = (double)(w & 0xfffffffffLL);
+    exponent = (w >> BITS_36) & 0x7f;
+    d = ldexp (d, exponent - 64 - 36);
+    if ((w >> 43) & 1) d = -d;
+
+    return d;
+}
+
+
+/*
+ *  Print 12-bit address of machine instruction (as m20_sys.c)
+ */
+void print_addr (int a, int flag)
+{
+    if (flag) putchar ('@');
+
+    if (flag && a >= 07700) {
+	printf ("-%o", (a ^ MAX_ADDR_VALUE) + 1);
+    } else {
+	if (flag) putchar ('+');
+	printf ("%04o", a);
+    }
+}
+
+
+/*
+ *  Print machine instruction (as m20_sys.c)
+ */
+void print_cmd (t_value cmd)
+{
+    const char *m;
+    int flags, op;
+
+    flags = cmd >> BITS_42 & MAX_ADDR_TAG_VALUE;
+    op =    cmd >> BITS_36 & MAX_OPCODE_VALUE;
+
+    m = short_names ? m20_short_opname [op] : m20_opname [op];
+
+    printf ("[op=%02o mod=%0o] %-30s ", op, flags, m );
+    print_addr (cmd >> BITS_24 & MAX_ADDR_VALUE, flags & 4);
+    printf (", ");
+    print_addr (cmd >> BITS_12 & MAX_ADDR_VALUE, flags & 2);
+    printf (", ");
+    print_addr (cmd >> BITS_0  & MAX_ADDR_VALUE, flags & 1);
+}
+
+
+/*
+ *  Print one trace record like trace_before_run()/trace_after_run()
+ */
+void print_record (const M20_TRACE_REC * tr)
+{
+    int i;
+    char c1, c2, c3;
+
+    if (dump_regs || dump_mem) {
+        for( i=0; i<100; i++ ) printf ("-");
+        printf ("\n");
+    }
+    if (tr->flags & M20_TRACE_IRREG) printf ("cpu: byRK: ");
+    else printf ("cpu: %04o: ", tr->kra);
+    print_cmd (tr->rk);
+    printf ("\n");
+    if (dump_regs) {
+        printf ("cpu: [dreg]: ra=%04o,  sw=%d,  rr=%015llo\n", tr->ra, tr->sw, tr->rr );
+    }
+    if (dump_mem) {
+        printf ("cpu: [dmem]: a1[%04o]=%015llo,  a2[%04o]=%015llo,  a3[%04o]=%015llo\n",
+                tr->a[0], tr->m[0], tr->a[1], tr->m[1], tr->a[2], tr->m[2] );
+        if (dump_modern_mem) {
+            printf ("cpu: [fmem]: a1[%04o]=%.12f,  a2[%04o]=%.12f,  a3[%04o]=%.12f\n",
+                    tr->a[0], m20_to_ieee(tr->m[0]), tr->a[1], m20_to_ieee(tr->m[1]),
+                    tr->a[2], m20_to_ieee(tr->m[2]) );
+        }
+    }
+    if (dump_regs || dump_mem) printf ("\n");
+
+    if (dump_regs) {
+        c1 = (tr->ra != tr->ra_after) ? '*' : '-';
+        c2 = (tr->sw != tr->sw_after) ? '*' : '-';
+        c3 = (tr->rr != tr->rr_after) ? '*' : '-';
+        printf ("cpu: [dreg]: ra=%04o%c, sw=%d%c, rr=%015llo%c\n",
+                tr->ra_after, c1, tr->sw_after, c2, tr->rr_after, c3 );
+    }
+    if (dump_mem) {
+        c1 = (tr->m[0] != tr->m_after[0]) ? '*' : '-';
+        c2 = (tr->m[1] != tr->m_after[1]) ? '*' : '-';
+        c3 = (tr->m[2] != tr->m_after[2]) ? '*' : '-';
+        printf ("cpu: [dmem]: a1[%04o%c]=%015llo, a2[%04o%c]=%015llo, a3[%04o%c]=%015llo\n",
+                tr->a1_after, c1, tr->m_after[0], tr->a[1], c2, tr->m_after[1],
+                tr->a[2], c3, tr->m_after[2] );
+        if (dump_modern_mem) {
+            printf ("cpu: [fmem]: a1[%04o%c]=%.12f,  a2[%04o%c]=%.12f,  a3[%04o%c]=%.12f\n",
+                    tr->a1_after, c1, m20_to_ieee(tr->m_after[0]), tr->a[1], c2,
+                    m20_to_ieee(tr->m_after[1]), tr->a[2], c3, m20_to_ieee(tr->m_after[2]) );
+        }
+    }
+    if (dump_regs || dump_mem) printf ("\n");
+}
+
+
+
+
+/*
+ *  Main program stream
+ */
+int main( int argc, char ** argv )
+{
+  int                 ret_code = 0;
+  int                 op;
+  FILE *              fp_in = NULL;
+  M20_TRACE_HDR       hdr;
+  M20_TRACE_REC       rec;
+  unsigned long       i, skip;
+
+/* Process command line  */
+  opterr = 0;
+  while( (op = getopt(argc,argv,"vhrmfsi:n:")) != -1)
+    switch(op) {
+      case 'i':
+               in_file = optarg;
+               break;
+      case 'n':
+               last_count = atol(optarg);
+               break;
+      case 'r':
+               dump_regs = 1;
+               break;
+      case 'm':
+               dump_mem = 1;
+               break;
+      case 'f':
+               dump_modern_mem = 1;
+               break;
+      case 's':
+               short_names = 1;
+               break;
+      case 'v':
+               verbose = 1;
+               break;
+      case 'h':
+               usage();
+               break;
+      default:
+               break;
+    }
+
+  if (in_file == NULL) {
+       usage();
+  }
+
+  fp_in = fopen( in_file, "rb" );
+  if (fp_in == NULL) {
+    fprintf( stderr, "ERROR: cannot open file %s!\n", in_file );
+    return(10);
+  }
+
+  if ((fread( &hdr, sizeof(hdr), 1, fp_in ) != 1) ||
+      (memcmp( hdr.magic, M20_TRACE_MAGIC, sizeof(hdr.magic) ) != 0)) {
+    fprintf( stderr, "ERROR: %s is not a M-20 trace file!\n", in_file );
+    fclose(fp_in);
+    return(11);
+  }
+  if ((hdr.version != M20_TRACE_VERSION) || (hdr.rec_size != sizeof(M20_TRACE_REC))) {
+    fprintf( stderr, "ERROR: unsupported trace format (version %u, record %u bytes)!\n",
+             hdr.version, hdr.rec_size );
+    fclose(fp_in);
+    return(12);
+  }
+
+  if (verbose) printf( "File: %s, %u instructions.\n\n", in_file, hdr.count );
+
+  skip = 0;
+  if ((last_count > 0) && ((unsigned long)last_count < hdr.count)) skip = hdr.count - last_count;
+  if (skip) fseek( fp_in, (long)(skip * sizeof(rec)), SEEK_CUR );
+
+  for( i=skip; i<hdr.count; i++ ) {
+     if (fread( &rec, sizeof(rec), 1, fp_in ) != 1) {
+       fprintf( stderr, "ERROR: trace file is truncated!\n" );
+       ret_code = 13;
+       break;
+     }
+     print_record( &rec );
+  }
+
+  if (verbose) printf( "Dump trace contents completed.\n" );
+
+  if (fp_in  != NULL) fclose(fp_in);
+
+  return(ret_code);
+}
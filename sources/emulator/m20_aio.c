@@ -0,0 +1,281 @@
+/*
+ * File:     m20_aio.c
+ * Purpose:  M-20 simulator write-behind of drum and tape transfers
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Exchange with drum or tape is still done by 070 at once: words are taken
+ * from MOSU, checksum and codes count are computed, transfer time is added
+ * to CPU delay. Only host write of the words into file of unit is queued
+ * to worker thread (M20_ASYNC_IO, see makefile.unx), so CPU goes on while
+ * host waits for slow storage, and emulated results do not depend on it.
+ * Words are copied into request, MOSU under transfer may be changed right
+ * after 070.
+ *
+ * Any other access to file of unit (read, zone search, format, detach)
+ * waits for its queued writes first and returns I/O error if one of them
+ * failed. Failed write of other file is reported too: drum and tape 070
+ * end with m20_aio_check, which returns I/O error for any write failed by
+ * then, and exit of sim_instr waits for all queued writes (m20_aio_flush)
+ * and stops with I/O error if one of them failed. So failure is reported
+ * by the next drum or tape 070 or at the latest by the stop of CPU, not by
+ * the 070 which queued the write. There is no unit event for end of write: 070 takes all transfer
+ * time at once, so event would always come late, and SCP drops overshoot
+ * of late event from simulated time.
+ *
+ * Without M20_ASYNC_IO writes are done immediately.
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *  18-Oct-2026  AGT  m20_aio_forked for FORK
+ *  18-Oct-2026  AGT  m20_aio_check and m20_aio_flush: failed write is not kept
+ *                    until the next access to the same file
+ *
+ */
+
+
+#include "m20_defs.h"
+
+
+/*
+ *  Write words into file at offset
+ */
+static t_stat aio_write_now (FILE * f, long pos, const t_value * buf, int nwords)
+{
+    size_t count;
+
+    if (fseek (f, pos, SEEK_SET)) return SCPE_IOERR;
+    count = fxwrite (buf, sizeof(t_value), nwords, f);
+    if (ferror (f) || (count != (size_t)nwords)) return SCPE_IOERR;
+    return SCPE_OK;
+}
+
+
+#if defined(M20_ASYNC_IO)
+
+#include <pthread.h>
+
+typedef struct m20_aio_req {
+    struct m20_aio_req * next;
+    FILE *    f;
+    long      pos;                      /* file offset */
+    int       nwords;
+    t_value   buf[1];
+} M20_AIO_REQ;
+
+#define  M20_AIO_FAILED   16
+
+static pthread_mutex_t  aio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   aio_work = PTHREAD_COND_INITIALIZER;	/* request queued */
+static pthread_cond_t   aio_done = PTHREAD_COND_INITIALIZER;	/* request written */
+static int              aio_started = 0;
+static M20_AIO_REQ *    aio_head = NULL;			/* head is being written */
+static M20_AIO_REQ *    aio_tail = NULL;
+static FILE *           aio_failed[M20_AIO_FAILED];		/* files with failed write */
+static int              aio_failed_lost = 0;			/* table was full */
+
+
+/*
+ *  Queued or being written request for file? (lock is held)
+ */
+static int aio_pending (FILE * f)
+{
+    M20_AIO_REQ * r;
+
+    for (r = aio_head; r != NULL; r = r->next)
+        if (r->f == f) return 1;
+    return 0;
+}
+
+
+/*
+ *  Take error of file writes (lock is held)
+ */
+static t_stat aio_take_error (FILE * f)
+{
+    int i;
+
+    for (i = 0; i < M20_AIO_FAILED; i++) {
+        if (aio_failed[i] == f) {
+            aio_failed[i] = NULL;
+            return SCPE_IOERR;
+        }
+    }
+    if (aio_failed_lost) {
+        aio_failed_lost = 0;
+        return SCPE_IOERR;
+    }
+    return SCPE_OK;
+}
+
+
+/*
+ *  Worker: write queued requests in order
+ */
+static void * aio_worker (void * arg)
+{
+    M20_AIO_REQ * r;
+    t_stat err;
+    int i;
+
+    pthread_mutex_lock (&aio_lock);
+    for (;;) {
+        while (aio_head == NULL)
+            pthread_cond_wait (&aio_work, &aio_lock);
+        r = aio_head;
+        pthread_mutex_unlock (&aio_lock);
+
+        flockfile (r->f);
+        err = aio_write_now (r->f, r->pos, r->buf, r->nwords);
+        funlockfile (r->f);
+
+        pthread_mutex_lock (&aio_lock);
+        if (err) {
+            for (i = 0; (i < M20_AIO_FAILED) && (aio_failed[i] != NULL) && (aio_failed[i] != r->f); i++) ;
+            if (i < M20_AIO_FAILED) aio_failed[i] = r->f;
+            else aio_failed_lost = 1;
+        }
+        aio_head = r->next;
+        if (aio_head == NULL) aio_tail = NULL;
+        free (r);
+        pthread_cond_broadcast (&aio_done);
+    }
+    return NULL;
+}
+
+
+/*
+ *  Queue write of words into file of unit at offset
+ */
+t_stat m20_aio_write (UNIT * uptr, long pos, const t_value * buf, int nwords)
+{
+    M20_AIO_REQ * r;
+    pthread_t  tid;
+
+    r = (M20_AIO_REQ *) malloc (sizeof(M20_AIO_REQ) + nwords * sizeof(t_value));
+    if (r == NULL) return aio_write_now (uptr->fileref, pos, buf, nwords);
+    r->next = NULL;
+    r->f = uptr->fileref;
+    r->pos = pos;
+    r->nwords = nwords;
+    memcpy (r->buf, buf, nwords * sizeof(t_value));
+
+    pthread_mutex_lock (&aio_lock);
+    if (!aio_started) {
+        if (pthread_create (&tid, NULL, aio_worker, NULL)) {
+            pthread_mutex_unlock (&aio_lock);
+            free (r);
+            return aio_write_now (uptr->fileref, pos, buf, nwords);
+        }
+        pthread_detach (tid);
+        aio_started = 1;
+    }
+    if (aio_tail) aio_tail->next = r;
+    else aio_head = r;
+    aio_tail = r;
+    pthread_cond_signal (&aio_work);
+    pthread_mutex_unlock (&aio_lock);
+
+    return SCPE_OK;
+}
+
+
+/*
+ *  Wait for queued writes into file of unit
+ */
+t_stat m20_aio_wait (UNIT * uptr)
+{
+    FILE * f = uptr->fileref;
+    t_stat err;
+
+    if (f == NULL) return SCPE_OK;
+
+    pthread_mutex_lock (&aio_lock);
+    while (aio_pending (f))
+        pthread_cond_wait (&aio_done, &aio_lock);
+    err = aio_take_error (f);
+    pthread_mutex_unlock (&aio_lock);
+    return err;
+}
+
+
+/*
+ *  Error of any write failed by now, without waiting (end of 070)
+ */
+t_stat m20_aio_check (void)
+{
+    t_stat err = SCPE_OK;
+    int i;
+
+    pthread_mutex_lock (&aio_lock);
+    for (i = 0; i < M20_AIO_FAILED; i++) {
+        if (aio_failed[i] != NULL) {
+            aio_failed[i] = NULL;
+            err = SCPE_IOERR;
+        }
+    }
+    if (aio_failed_lost) {
+        aio_failed_lost = 0;
+        err = SCPE_IOERR;
+    }
+    pthread_mutex_unlock (&aio_lock);
+    return err;
+}
+
+
+/*
+ *  Wait for all queued writes, error of any of them (exit of sim_instr)
+ */
+t_stat m20_aio_flush (void)
+{
+    pthread_mutex_lock (&aio_lock);
+    while (aio_head != NULL)
+        pthread_cond_wait (&aio_done, &aio_lock);
+    pthread_mutex_unlock (&aio_lock);
+    return m20_aio_check ();
+}
+
+
+/*
+ *  Forked process (FORK) has no worker thread, queue is empty
+ */
+void m20_aio_forked (void)
+{
+    pthread_mutex_init (&aio_lock, NULL);
+    pthread_cond_init (&aio_work, NULL);
+    pthread_cond_init (&aio_done, NULL);
+    aio_started = 0;
+    aio_head = aio_tail = NULL;
+}
+
+
+#else
+
+t_stat m20_aio_write (UNIT * uptr, long pos, const t_value * buf, int nwords)
+{
+    return aio_write_now (uptr->fileref, pos, buf, nwords);
+}
+
+t_stat m20_aio_wait (UNIT * uptr)
+{
+    return SCPE_OK;
+}
+
+t_stat m20_aio_check (void)
+{
+    return SCPE_OK;
+}
+
+t_stat m20_aio_flush (void)
+{
+    return SCPE_OK;
+}
+
+void m20_aio_forked (void)
+{
+}
+
+#endif
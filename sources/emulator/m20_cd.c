@@ -27,12 +27,16 @@
  *  28-Jul-2021  LOY  CDP: zone_buf_addr is taken into account;
  *                    Fix erroneous output (type mismatch)
  *  29-Jul-2021  LOY  Declarations changed to remove compiler warnings
+ *  18-Oct-2026  AGT  CDP: line-buffered output, no ftell per character
+ *  18-Oct-2026  AGT  cd_state_save/cd_state_restore for libm20
+ *  18-Oct-2026  AGT  CDR: compiled deck (att -c), cached in <deck>.cdc
  *
  */
 
 
 #include "m20_defs.h"
 #include <math.h>
+#include <sys/stat.h>
 
 
 #define UNIT_V_OUTEXTFMT        (UNIT_V_UF + 0)         
@@ -40,6 +44,12 @@
 #define UNIT_V_INTEXTFMT        (UNIT_V_UF + 1)         
 #define UNIT_INEXTFMT           (1u << UNIT_V_INTEXTFMT)
 
+#define CDP_OUT_BUF_SIZE        256                     /* output line buffer */
+
+#define CDR_DECK                up7                     /* compiled deck records (att -c) */
+#define CDR_DECK_POS            u3                      /* next record */
+#define CDR_DECK_COUNT          u4                      /* records */
+
 
 /* external references (CPU module) */
 
@@ -76,6 +86,9 @@ extern int  msu_drum_print_last_pos;
 char cdr_buf[CDR_BUF_SIZE];                      /* > CDR_WIDTH */
 char cdp_line_buf[(CDP_BUF_SIZE) + 1];           /* + null */
 
+static char   cdp_out_buf[CDP_OUT_BUF_SIZE];     /* current output line */
+static size_t cdp_out_buf_len = 0;
+
 char debug_cdr_buf[CDR_BUF_SIZE];                /* > CDR_WIDTH */
 
 
@@ -86,6 +99,8 @@ int   cdr_input_codes_count;
 
 static int bcd_print = 0;
 
+static M20_CARD_REC cdr_deck_end = { 0, 0, SCPE_OK, -1, -1, 1 };   /* read after end of deck */
+
 t_stat cdr_set_mode (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat cdp_set_mode (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 
@@ -94,10 +109,13 @@ t_stat cdr_boot (int32 unitno, DEVICE *dptr);
 t_stat cdr_attach (UNIT *uptr, CONST char *cptr);
 t_stat cdr_detach (UNIT *uptr);
 t_stat cdr_reset (DEVICE *dptr);
+t_stat cdr_deck_attach (UNIT *uptr);
+void   cdr_deck_free (UNIT *uptr);
 
 t_stat cdp_reset (DEVICE *dptr);
 t_stat cdp_attach (UNIT *uptr, CONST char *cptr);
 t_stat cdp_detach (UNIT *uptr);
+t_stat flush_cdp_line (void);
 
 
 /* 
@@ -200,9 +218,20 @@ t_stat cdr_reset (DEVICE *dptr)
 
 t_stat cdr_attach (UNIT *uptr, CONST char *cptr)
 {
+    t_stat r;
+
     if (sim_deb && cdr_dev.dctrl) fprintf (sim_deb, "cdr: cdr_attach(..)\n");
 
-    return attach_unit (uptr, cptr);
+    r = attach_unit (uptr, cptr);
+    if (r != SCPE_OK) return r;
+
+    /* att -c: deck is parsed once, cards are taken from records */
+    if (sim_switches & SWMASK ('C')) {
+        r = cdr_deck_attach (uptr);
+        if (r != SCPE_OK) detach_unit (uptr);
+    }
+
+    return r;
 }
 
 
@@ -212,6 +241,8 @@ t_stat cdr_detach (UNIT *uptr)
 {
     if (sim_deb && cdr_dev.dctrl) fprintf (sim_deb, "cdr: cdr_detach(..)\n");
 
+    cdr_deck_free (uptr);
+
     return detach_unit (uptr);
 }
 
@@ -256,6 +287,151 @@ int get_marker_value( char ch)
 
 
 
+/*
+   Parse one line of deck: markers (-1 for comment or short line) and word.
+   Same for card reading and deck compiling (att -c).
+*/
+t_stat parse_card_line (char * buf, int * main_marker, int * aux_marker, t_value * code, int trace)
+{
+    int i;
+    char *p, *s;
+    int  d_sign, d_tag, d_exp_sign, exp_val, d_m, d_exp, d;
+    int  m_marker, a_marker;
+    t_value  rcode, tcode, e, m;
+
+    *main_marker = *aux_marker = -1;
+
+    if (buf[0] == ';') return SCPE_OK;                     /* comment */
+    if (strlen(buf) < 9) return SCPE_OK;                   /* too small line */
+
+    /* get left marker */
+    p = skip_spaces(buf);
+    m_marker = get_marker_value(*p);
+
+    if (trace && sim_deb && cdr_dev.dctrl) {
+       memset( debug_cdr_buf, 0, sizeof(debug_cdr_buf) );
+       strncpy( debug_cdr_buf, buf, sizeof(debug_cdr_buf)-1 );
+       s = strchr(debug_cdr_buf,'\n'); if (s != NULL) *s = '\0';
+       s = strchr(debug_cdr_buf,'\r'); if (s != NULL) *s = '\0';
+       fprintf (sim_deb, "cdr: read_card(): cdr_buf='%s'\n", debug_cdr_buf );
+    }
+
+    /* process number */
+    p = skip_spaces(p+1);
+    rcode = 0;
+    if (cdr_unit.flags & UNIT_INEXTFMT) {
+       if (*p == '=') {
+           rcode = ieee_to_m20 (strtod (p+1, NULL));
+           p = skip_nonspaces(p+1);
+           p--;
+           goto take_right_marker;
+       }
+    }
+    if (*p == '+' || *p == '-') {
+       /* binary-decimal-coded number */
+       d_tag = 0;
+       /* detect tage */
+       d_tag = 0;
+       if ((*p != '+') && (*p != '-')) return STOP_CRFMTINVAL;
+       if (*p=='+') d_tag = 1;
+       if (*p=='-') d_tag = 0;
+       p++;
+       /* detect number sign */
+       d_sign = 0;
+       if ((*p != '+') && (*p != '-')) return STOP_CRFMTINVAL;
+       if (*p=='+') d_sign = 0;
+       if (*p=='-') d_sign = 1;
+       p=skip_spaces(p+1);
+       /* detect exponent sign and exponent sign */
+       d_exp = atoi(p);
+       d_exp_sign = 0;
+       if (d_exp < 0) d_exp_sign = 1;
+       exp_val = abs(d_exp);
+       if (exp_val > 19) return SCPE_FMT;
+       e = exp_val % 10;
+       if (exp_val / 10) e |= 1 << 4;
+       p = skip_nonspaces(p+1);
+       p=skip_spaces(p+1);
+       /* detect mantissa */
+       m = 0;
+       for( i=0; i<9; i++ ) {
+           if (*p < '0' || *p > '9') return SCPE_FMT;
+           d_m = *p - '0';
+           m |= ((t_value)d_m << (32-i*4));
+           p=skip_spaces(p+1);
+       }
+       tcode = m;
+       tcode |= (e << BITS_36);
+       if (d_tag) tcode |= TAG;
+       if (d_sign) tcode |= SIGN;
+       if (d_exp_sign) tcode |= EXPONENT_SIGN;
+       rcode = tcode;
+       p--;
+       goto take_right_marker;
+    }
+    if (*p == '#') {
+        /* binary-decimal-coded number (another form) */
+        tcode = 0;
+        p=skip_spaces(p+1);
+        /* detect tag, sign, exponent sign */
+        if (*p < '0' || *p > '7') return STOP_CRFMTINVAL;
+        d_tag = 0; d_sign = 0; d_exp_sign = 0;
+        d = *p - '0';
+        if (d & 4) d_tag = 1;
+        if (d & 2) d_sign = 1;
+        if (d & 1) d_exp_sign = 1;
+        /* detect exponent */
+        p=skip_spaces(p+1);
+        d_exp = atoi(p);
+        exp_val = abs(d_exp);
+        if (exp_val > 19) return SCPE_FMT;
+        e = exp_val % 10;
+        if (exp_val / 10) e |= 1 << 4;
+        p = skip_nonspaces(p+1);
+        p=skip_spaces(p+1);
+        /* detect mantissa */
+        m = 0;
+        for( i=0; i<9; i++ ) {
+            if (*p < '0' || *p > '9') return SCPE_FMT;
+            d_m = *p - '0';
+            m |= ((t_value)d_m << (32-i*4));
+            p=skip_spaces(p+1);
+        }
+        /* make a final code */
+        tcode = m;
+        tcode |= (e << BITS_36);
+        if (d_tag) tcode |= TAG;
+        if (d_sign) tcode |= SIGN;
+        if (d_exp_sign) tcode |= EXPONENT_SIGN;
+        rcode = tcode;
+        p--;
+        goto take_right_marker;
+    }
+
+    if (*p < '0' || *p > '7') return STOP_CRFMTINVAL;
+    rcode = *p - '0';
+    for (i=0; i<14; i++) {
+       p = skip_spaces(p+1);
+       if (*p < '0' || *p > '7') return STOP_CRFMTINVAL;
+       rcode = (rcode << 3) | (*p - '0');
+    }
+
+ take_right_marker:
+    /* get right marker */
+    p = skip_spaces(p+1);
+    a_marker = get_marker_value(*p);
+
+    if ((m_marker < 0) || (a_marker < 0)) return STOP_CRFMTINVAL;
+
+    *main_marker = m_marker;
+    *aux_marker = a_marker;
+    *code = rcode;
+
+    return SCPE_OK;
+}
+
+
+
 /* 
    Card read routine
    Read until end marker encountered.
@@ -263,14 +439,13 @@ int get_marker_value( char ch)
 t_stat read_card (t_value * csum, t_value * rsum, int * rcodes,
                    int * stop_blocking, int * control_blocking)
 {
-    int i;
     t_stat r;
     int cr_input_done = 0;
-    char *p, *s;
-    int  main_marker, aux_marker, store_addr, d_sign, d_tag, d_exp_sign, exp_val, d_m;
-    int  a1, a2, a3, d_exp, d;
-    t_value  sum, rcode, r_sum, tcode, e, m;
-    //double f;
+    int  main_marker, aux_marker, store_addr, eof;
+    int  a1, a2, a3;
+    t_addr  pos;
+    t_value  sum, rcode, r_sum;
+    M20_CARD_REC * rec;
     int  do_write = 0;
 
     if (sim_deb && cdr_dev.dctrl) fprintf (sim_deb, "cdr: read_card(..)\n");
@@ -288,183 +463,58 @@ t_stat read_card (t_value * csum, t_value * rsum, int * rcodes,
     //if (cr_io_addr_1 == 0)  return STOP_CRINVAL;
 
     sum = 0;
+    rcode = 0;
     main_marker = aux_marker = -1;
     store_addr = (int)cr_io_addr_1;
     if (store_addr) do_write = 1;
     cdr_input_codes_count = 0;
 
     while( !cr_input_done ) {
-        memset( cdr_buf, 0, sizeof(cdr_buf) );             /* clear extended buf */
+        if (cdr_unit.CDR_DECK != NULL) {                   /* compiled deck (att -c) */
+            if (cdr_unit.CDR_DECK_POS < cdr_unit.CDR_DECK_COUNT)
+                rec = (M20_CARD_REC *)cdr_unit.CDR_DECK + cdr_unit.CDR_DECK_POS++;
+            else
+                rec = &cdr_deck_end;                       /* after end of deck */
+
+            if (store_addr >= MAX_MEM_SIZE) {              /* cannot read card out of memory! */
+                return STOP_CROUTMEMORY;
+            }
 
-        fgets (cdr_buf, CDR_BUF_SIZE, cdr_unit.fileref);   /* rd char card */
+            if (rec->status != SCPE_OK) return rec->status;
 
-        if (store_addr >= MAX_MEM_SIZE) {                  /* cannot read card out of memory! */
-            return STOP_CROUTMEMORY;
+            main_marker = rec->main_marker;
+            aux_marker = rec->aux_marker;
+            if (main_marker >= 0) {
+                rcode = rec->code;
+                if (sim_deb && cdr_dev.dctrl)
+                    fprintf (sim_deb, "cdr: read_card(): card %d: %d %015llo %d\n",
+                             cdr_unit.CDR_DECK_POS, main_marker, rcode, aux_marker );
+            }
+            eof = rec->eof;
+            pos = rec->pos;
         }
+        else {
+            memset( cdr_buf, 0, sizeof(cdr_buf) );         /* clear extended buf */
 
-        main_marker = aux_marker = -1;
-
-        if (cdr_buf[0] == ';') goto next_card;             /* comment */
-        if (strlen(cdr_buf) < 9) goto next_card;           /* too small line */
+            fgets (cdr_buf, CDR_BUF_SIZE, cdr_unit.fileref);   /* rd char card */
 
-        /* get left marker */
-        p = skip_spaces(cdr_buf);
-        main_marker = get_marker_value(*p);
-
-        if (sim_deb && cdr_dev.dctrl) {
-           memset( debug_cdr_buf, 0, sizeof(debug_cdr_buf) );
-           strncpy( debug_cdr_buf, cdr_buf, sizeof(debug_cdr_buf)-1 );
-           s = strchr(debug_cdr_buf,'\n'); if (s != NULL) *s = '\0';
-           s = strchr(debug_cdr_buf,'\r'); if (s != NULL) *s = '\0';
-           fprintf (sim_deb, "cdr: read_card(): cdr_buf='%s'\n", debug_cdr_buf );
-        }
-
-        /* process number */
-        p = skip_spaces(p+1);
-        rcode = 0;
-        if (cdr_unit.flags & UNIT_INEXTFMT) {
-           if (*p == '=') {
-               rcode = ieee_to_m20 (strtod (p+1, NULL));
-               p = skip_nonspaces(p+1);
-               p--;
-               goto take_right_marker;
-           }
-        }
-        if (*p == '+' || *p == '-') {
-           /* binary-decimal-coded number */
-           d_tag = 0;
-           /* detect tage */
-           d_tag = 0;
-           if ((*p != '+') && (*p != '-')) return STOP_CRFMTINVAL;
-           if (*p=='+') d_tag = 1;
-           if (*p=='-') d_tag = 0;
-           p++;
-           /* detect number sign */
-           d_sign = 0;
-           if ((*p != '+') && (*p != '-')) return STOP_CRFMTINVAL;
-           if (*p=='+') d_sign = 0;
-           if (*p=='-') d_sign = 1;
-           p=skip_spaces(p+1);
-           /* detect exponent sign and exponent sign */
-           d_exp = atoi(p);
-           d_exp_sign = 0;
-           if (d_exp < 0) d_exp_sign = 1;
-           exp_val = abs(d_exp);
-           if (exp_val > 19) return SCPE_FMT;
-           e = exp_val % 10;
-           if (exp_val / 10) e |= 1 << 4;
-           p = skip_nonspaces(p+1);
-           p=skip_spaces(p+1);
-           /* detect mantissa */
-           m = 0;
-           for( i=0; i<9; i++ ) {
-	       if (*p < '0' || *p > '9') return SCPE_FMT;
-               d_m = *p - '0';
-               m |= ((t_value)d_m << (32-i*4));
-               p=skip_spaces(p+1);
-           }
-           tcode = m;
-           tcode |= (e << BITS_36);
-           if (d_tag) tcode |= TAG;
-           if (d_sign) tcode |= SIGN;
-           if (d_exp_sign) tcode |= EXPONENT_SIGN;
-           rcode = tcode;
-           p--;
-           goto take_right_marker;
-        }
-        if (*p == '#') {
-            /* binary-decimal-coded number (another form) */
-            tcode = 0;
-            p=skip_spaces(p+1);
-            /* detect tag, sign, exponent sign */
-            if (*p < '0' || *p > '7') return STOP_CRFMTINVAL;
-            d_tag = 0; d_sign = 0; d_exp_sign = 0;
-            d = *p - '0';
-            if (d & 4) d_tag = 1;
-            if (d & 2) d_sign = 1;
-            if (d & 1) d_exp_sign = 1;
-            /* detect exponent */
-            p=skip_spaces(p+1);
-            d_exp = atoi(p);
-            exp_val = abs(d_exp);
-            if (exp_val > 19) return SCPE_FMT;
-            e = exp_val % 10;
-            if (exp_val / 10) e |= 1 << 4;
-            p = skip_nonspaces(p+1);
-            p=skip_spaces(p+1);
-            /* detect mantissa */
-            m = 0;
-            for( i=0; i<9; i++ ) {
-	        if (*p < '0' || *p > '9') return SCPE_FMT;
-                d_m = *p - '0';
-                m |= ((t_value)d_m << (32-i*4));
-                p=skip_spaces(p+1);
+            if (store_addr >= MAX_MEM_SIZE) {              /* cannot read card out of memory! */
+                return STOP_CROUTMEMORY;
             }
-            /* make a final code */
-            tcode = m;
-            tcode |= (e << BITS_36);
-            if (d_tag) tcode |= TAG;
-            if (d_sign) tcode |= SIGN;
-            if (d_exp_sign) tcode |= EXPONENT_SIGN;
-            rcode = tcode;
-            p--;
-            goto take_right_marker;
-        }
-
-#if 0
-        if (*p == '+' || *p == '-') {
-           /* as decimal number, not bcd number! */
-           d_tag = 0;
-           if (*p=='+') d_tag = 1;
-           if (*p=='-') d_tag = 0;
-           p++;
-           d_sign = 1;
-           if (*p=='+') d_sign = 1;
-           if (*p=='-') d_sign = -1;
-           p=skip_spaces(p+1);
-           d_exp = atoi(p);
-           p = skip_nonspaces(p+1);
-           p=skip_spaces(p+1);
-           if (*p < '0' || *p > '9') return STOP_CRFMTINVAL;
-           tcode = *p - '0';
-           for (i=0; i<9; i++) {
-	      p = skip_spaces(p+1);
-	      if (*p < '0' || *p > '9') return STOP_CRFMTINVAL;
-	      tcode = (tcode * 10) + (*p - '0');
-           }
-           f = (double)tcode * 1E-10;
-           f *= d_sign;
-           f *= pow(10,d_exp );
-           rcode = ieee_to_m20 (f);
-           if (d_tag) rcode |= TAG;
-           p--;
-           goto take_right_marker;
-        }
-#endif
 
+            r = parse_card_line (cdr_buf, &main_marker, &aux_marker, &rcode, 1);
+            if (r != SCPE_OK) return r;
 
-        if (*p < '0' || *p > '7') return STOP_CRFMTINVAL;
-        rcode = *p - '0';
-        for (i=0; i<14; i++) {
-	   p = skip_spaces(p+1);
-	   if (*p < '0' || *p > '7') return STOP_CRFMTINVAL;
-	   rcode = (rcode << 3) | (*p - '0');
+            eof = feof (cdr_unit.fileref);
+            pos = eof ? 0 : ftell (cdr_unit.fileref);
         }
 
-     take_right_marker:
-        /* get right marker */
-        p = skip_spaces(p+1);
-        aux_marker = get_marker_value(*p);
-
-        if ((main_marker < 0) || (aux_marker < 0)) return STOP_CRFMTINVAL;
+        if (main_marker >= 0) cdr_input_codes_count++;
 
-        cdr_input_codes_count++;
-
-      next_card:
-        if (feof (cdr_unit.fileref))                       /* eof? */
+        if (eof)                                           /* eof? */
             return STOP_NOCD;
 
-         cdr_unit.pos = ftell (cdr_unit.fileref);          /* update position */
+         cdr_unit.pos = pos;                               /* update position */
 
 	 a1 = rcode >> BITS_24 & MAX_ADDR_VALUE;
 	 a2 = rcode >> BITS_12 & MAX_ADDR_VALUE;
@@ -511,6 +561,167 @@ t_stat read_card (t_value * csum, t_value * rsum, int * rcodes,
 
 
 
+/*
+ * Compiled deck (att -c).
+ * Every line of deck is parsed once into record (markers, word, status of
+ * parsing, position, end of file) exactly as read_card reads it with fgets,
+ * so cards, checksums, format errors and STOP_NOCD stay the same. Records
+ * are cached in <deck>.cdc, the cache is used while deck size, time, hash
+ * and CDR format are the same.
+ */
+static t_uint64 cdr_deck_hash (FILE *f)
+{
+    unsigned char buf[4096];
+    size_t n, i;
+    t_uint64 h = 14695981039346656037ULL;                  /* FNV-1a */
+
+    rewind (f);
+    while ((n = fread (buf, 1, sizeof(buf), f)) > 0)
+        for (i = 0; i < n; i++) {
+            h ^= buf[i];
+            h *= 1099511628211ULL;
+        }
+    rewind (f);
+
+    return h;
+}
+
+
+static M20_CARD_REC * cdr_deck_compile (FILE *f, uint32 *count)
+{
+    M20_CARD_REC *recs = NULL, *p, *rec;
+    uint32 n = 0, size = 0;
+    int main_marker, aux_marker, eof = 0;
+    t_value code;
+
+    rewind (f);
+    while (!eof) {
+        if (n == size) {
+            size = size ? size * 2 : 256;
+            p = (M20_CARD_REC *) realloc (recs, size * sizeof(M20_CARD_REC));
+            if (p == NULL) {
+                free (recs);
+                return NULL;
+            }
+            recs = p;
+        }
+        rec = &recs[n++];
+        memset (rec, 0, sizeof(*rec));
+
+        memset (cdr_buf, 0, sizeof(cdr_buf));
+        fgets (cdr_buf, CDR_BUF_SIZE, f);
+
+        code = 0;
+        rec->status = parse_card_line (cdr_buf, &main_marker, &aux_marker, &code, 0);
+        rec->main_marker = (int8) main_marker;
+        rec->aux_marker = (int8) aux_marker;
+        rec->code = code;
+        rec->eof = eof = (feof (f) != 0);
+        rec->pos = eof ? 0 : (uint32) ftell (f);
+    }
+    rewind (f);
+
+    *count = n;
+    return recs;
+}
+
+
+static M20_CARD_REC * cdr_deck_read_cache (const char *name, const M20_CARD_HDR *key, uint32 *count)
+{
+    M20_CARD_HDR hdr;
+    M20_CARD_REC *recs;
+    FILE *f;
+
+    f = fopen (name, "rb");
+    if (f == NULL) return NULL;
+
+    if ((fread (&hdr, sizeof(hdr), 1, f) != 1) ||
+        memcmp (hdr.magic, key->magic, sizeof(hdr.magic)) || (hdr.version != key->version) ||
+        (hdr.flags != key->flags) || (hdr.size != key->size) || (hdr.mtime != key->mtime) ||
+        (hdr.hash != key->hash) || (hdr.count == 0) || (hdr.count > key->size + 1)) {
+        fclose (f);
+        return NULL;
+    }
+
+    recs = (M20_CARD_REC *) malloc (hdr.count * sizeof(M20_CARD_REC));
+    if (recs && (fread (recs, sizeof(M20_CARD_REC), hdr.count, f) != hdr.count)) {
+        free (recs);
+        recs = NULL;
+    }
+    fclose (f);
+
+    *count = hdr.count;
+    return recs;
+}
+
+
+static void cdr_deck_write_cache (const char *name, M20_CARD_HDR *hdr, const M20_CARD_REC *recs)
+{
+    FILE *f;
+    int ok;
+
+    f = fopen (name, "wb");
+    if (f == NULL) return;                                 /* no cache, deck is compiled next time */
+
+    ok = (fwrite (hdr, sizeof(*hdr), 1, f) == 1) &&
+         (fwrite (recs, sizeof(M20_CARD_REC), hdr->count, f) == hdr->count);
+    if (fclose (f) || !ok) remove (name);
+}
+
+
+t_stat cdr_deck_attach (UNIT *uptr)
+{
+    M20_CARD_HDR key;
+    M20_CARD_REC *recs;
+    struct stat st;
+    char name[CBUFSIZE + sizeof(M20_CARD_EXT)];
+    uint32 count = 0;
+    int cached;
+
+    if (stat (uptr->filename, &st) != 0) return SCPE_OPENERR;
+
+    memset (&key, 0, sizeof(key));
+    memcpy (key.magic, M20_CARD_MAGIC, sizeof(key.magic));
+    key.version = M20_CARD_VERSION;
+    key.flags = uptr->flags & UNIT_INEXTFMT;
+    key.size = (t_uint64) st.st_size;
+    key.mtime = (t_int64) st.st_mtime;
+    key.hash = cdr_deck_hash (uptr->fileref);
+
+    _snprintf (name, sizeof(name), "%s%s", uptr->filename, M20_CARD_EXT);
+    name[sizeof(name)-1] = '\0';
+
+    recs = cdr_deck_read_cache (name, &key, &count);
+    cached = (recs != NULL);
+    if (!cached) {
+        recs = cdr_deck_compile (uptr->fileref, &count);
+        if (recs == NULL) return SCPE_MEM;
+        key.count = count;
+        cdr_deck_write_cache (name, &key, recs);
+    }
+
+    if (sim_deb && cdr_dev.dctrl)
+        fprintf (sim_deb, "cdr: cdr_deck_attach(..), '%s' records=%u %s\n", name, count,
+                 cached ? "cached" : "compiled");
+
+    uptr->CDR_DECK = recs;
+    uptr->CDR_DECK_COUNT = count;
+    uptr->CDR_DECK_POS = 0;
+
+    return SCPE_OK;
+}
+
+
+void cdr_deck_free (UNIT *uptr)
+{
+    free (uptr->CDR_DECK);
+    uptr->CDR_DECK = NULL;
+    uptr->CDR_DECK_COUNT = 0;
+    uptr->CDR_DECK_POS = 0;
+}
+
+
+
 /* Reader/punch set mode - valid only if not attached */
 
 t_stat cdp_set_mode (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
@@ -548,6 +759,7 @@ t_stat cdp_attach (UNIT *uptr, CONST char *cptr)
     msu_drum_print_last_pos = 0;
 
     memset( msu_drum_print_buf, 0, sizeof(msu_drum_print_buf) );
+    cdp_out_buf_len = 0;
 
     active_cdp++;
 
@@ -562,6 +774,7 @@ t_stat cdp_detach (UNIT *uptr)
 {
     if (sim_deb && cdp_dev.dctrl) fprintf (sim_deb, "cdp: cdp_detach(..)\n");
 
+    if (uptr->flags & UNIT_ATT) flush_cdp_line ();
     active_cdp--;
 
     return detach_unit (uptr);
@@ -571,11 +784,19 @@ t_stat cdp_detach (UNIT *uptr)
 
 
 
-t_stat  output_cdp_line( char * out_line )
+/*
+ * Output is collected into line buffer and written by one call per line;
+ * unit position is counted instead of ftell after every character.
+ */
+t_stat  flush_cdp_line( void )
 {
-    fputs (out_line, cdp_unit.fileref);                    /* output card */
-    //fputc ('\n', cdp_unit.fileref);                      /* plus new line */
-    cdp_unit.pos = ftell (cdp_unit.fileref);               /* update position */
+    size_t len = cdp_out_buf_len;
+
+    cdp_out_buf_len = 0;
+    if (len == 0) return SCPE_OK;
+
+    if (fwrite (cdp_out_buf, 1, len, cdp_unit.fileref) == len)  /* output card */
+        cdp_unit.pos += (t_addr)len;                       /* update position */
 
     if (ferror (cdp_unit.fileref)) {                       /* error? */
         perror ("Card punch I/O error");
@@ -589,13 +810,21 @@ t_stat  output_cdp_line( char * out_line )
 
 t_stat  output_cdp_char( char ch )
 {
-    fputc (ch, cdp_unit.fileref);                          /* output card */
-    cdp_unit.pos = ftell (cdp_unit.fileref);               /* update position */
+    cdp_out_buf[cdp_out_buf_len++] = ch;
+    if ((ch == '\n') || (cdp_out_buf_len == sizeof(cdp_out_buf)))
+        return flush_cdp_line ();
 
-    if (ferror (cdp_unit.fileref)) {                       /* error? */
-        perror ("Card punch I/O error");
-        clearerr (cdp_unit.fileref);
-        return SCPE_IOERR;
+    return SCPE_OK;
+}
+
+
+t_stat  output_cdp_line( char * out_line )
+{
+    t_stat err;
+
+    while (*out_line) {
+        err = output_cdp_char (*out_line++);
+        if (err) return err;
     }
 
     return SCPE_OK;
@@ -813,6 +1042,9 @@ flush_buffer:
       }
     }
 
+    err = flush_cdp_line ();
+    if (err) return err;
+
     /* reset output buffer */
     cdp_buf_full = 0;
     output_codes_count = 0;
@@ -822,3 +1054,38 @@ flush_buffer:
 
     return SCPE_OK;
 }
+
+
+
+/*
+ * Save card reader and punch of machine (libm20).
+ * Punch line buffer is written out first.
+ */
+void cd_state_save (M20_CD_STATE * st)
+{
+    sim_cancel (&cdr_unit);
+    if (cdp_unit.flags & UNIT_ATT) flush_cdp_line ();
+
+    st->cdr_unit = cdr_unit;
+    st->cdp_unit = cdp_unit;
+    st->cdr_codes_count = cdr_input_codes_count;
+    st->cdp_codes_count = output_codes_count;
+    st->cdp_buf_full = cdp_buf_full;
+    st->cdp_sum = cdp_sum;
+    st->bcd_print = bcd_print;
+}
+
+
+/*
+ * Restore card reader and punch of machine (libm20).
+ */
+void cd_state_restore (const M20_CD_STATE * st)
+{
+    cdr_unit = st->cdr_unit;
+    cdp_unit = st->cdp_unit;
+    cdr_input_codes_count = st->cdr_codes_count;
+    output_codes_count = st->cdp_codes_count;
+    cdp_buf_full = st->cdp_buf_full;
+    cdp_sum = st->cdp_sum;
+    bcd_print = st->bcd_print;
+}
@@ -92,6 +92,27 @@
  *                    FA fix (modifiers use in the 2nd word)
  *  15-Jun-2023  LOY  Ability to disable B-61 trace.
  *  21-Dec-2025  LOY  Draft FK command
+ *  17-Oct-2026  AGT  Predecoded instruction cache (one entry per MOSU word)
+ *  17-Oct-2026  AGT  Instructions split into handlers; threaded-code engine (SET CPU THREADED)
+ *  17-Oct-2026  AGT  Basic-block engine (SET CPU BLOCK)
+ *  17-Oct-2026  AGT  Count of MOSU words with bits above 45, O(1) operands overflow test
+ *  17-Oct-2026  AGT  Opcode profile indexed by opcode, per-address profile (SHOW CPU HOTSPOTS)
+ *  18-Oct-2026  AGT  Binary trace ring buffer (SET CPU RINGTRACE), written on stop
+ *  18-Oct-2026  AGT  Trace filter by address ranges, opcodes and triggers (SET CPU TRACEFILTER)
+ *  18-Oct-2026  AGT  Shura-Bura mult/div/sqrt: word-level digits instead of bit loops.
+ *                    NEW_ARITH_VERIFY - run bit loops too and stop on divergence.
+ *  18-Oct-2026  AGT  addition_v44_op: add/sub/sub of modules by new_addition_v44 in one routine
+ *  18-Oct-2026  AGT  cpu_state_save/cpu_state_restore for libm20 (several machines per process)
+ *  18-Oct-2026  AGT  Idle loop detection on backward jumps (SET CPU IDLESTOP/IDLESKIP/NOIDLE)
+ *  18-Oct-2026  AGT  M-20 SCP commands (FORK) set by cpu_reset
+ *  18-Oct-2026  AGT  AOT engine: blocks translated by m20aot
+ *  18-Oct-2026  AGT  HLE hook on 016 (m20_hle.c), cpu_run_routine
+ *  18-Oct-2026  AGT  Read/write watchpoints on MOSU (SET CPU WATCH)
+ *  18-Oct-2026  AGT  Subroutine call profile, folded stacks (SET CPU CALLPROFILE)
+ *  18-Oct-2026  AGT  Count of done instructions (ICOUNT), journal of inputs (m20_jrn.c)
+ *  18-Oct-2026  AGT  Failed write behind is reported by drum/tape 070 and at stop of CPU
+ *  18-Oct-2026  AGT  Overflow test of operands (MEMORY_45_CHECKING) does not hit read watchpoints
+ *  18-Oct-2026  AGT  Translated block is left when a store drops it (self-modifying code)
  */
 
 #include "m20_defs.h"
@@ -152,10 +173,95 @@ int ext_io_ram_chksum;          /* КС_МОЗУ - адрес памяти дл
 
 t_value  MOSU[MAX_MEM_SIZE] = {0};
 
+/* number of MOSU words with bits above 45 set, kept by mosu_write() */
+int      mosu_garbage_count = 0;
+
+
+/*
+ * Predecoded instruction cache.
+ * One entry per MOSU word: handler, unpacked opcode, tags and raw (unmodified by RA) addresses.
+ * Entry is filled on first fetch and invalidated by every store into its word.
+ */
+typedef  t_stat (* M20_OP_HANDLER) (int op, int a1, int a2, int a3);
+
+typedef  struct m20_decoded_inst {
+    M20_OP_HANDLER  handler;
+    uint8    valid;
+    uint8    op;
+    uint8    addr_tags;
+    uint16   a1;
+    uint16   a2;
+    uint16   a3;
+} M20_DECODED_INST, * PM20_DECODED_INST;
+
+M20_DECODED_INST  cpu_decode_cache[MAX_MEM_SIZE];
+
+
+/*
+ * Basic-block cache.
+ * Entry holds number of instructions in block started at this address (0 = not built).
+ * Block ends at jump/cycle/stop/IO instruction or before breakpoint address.
+ * Blocks are rebuilt on every run start and dropped by store into any of their words.
+ */
+#define  CPU_BLOCK_MAX   64
+
+uint8    cpu_block_len[MAX_MEM_SIZE];
+
+
+/*
+ * Translated blocks (m20aot, built in with -DM20_AOT_FILE, see makefile.unx).
+ * Block runs only while its words match the translated program: it is checked
+ * on entry, and store into any of its words drops it until the next check.
+ * Words marked in vmask are stored into by the program (address modification),
+ * only their opcode and tags are checked, addresses are taken from MOSU.
+ */
+typedef  struct cpu_loop_state * PCPU_LOOP_STATE;
+typedef  t_stat (* M20_AOT_FUNC) (PCPU_LOOP_STATE ls);
+
+typedef  struct m20_aot_block {
+    uint16   start;
+    uint16   len;
+    t_uint64 vmask;                 /* words read from MOSU at run time */
+    const t_value * code;           /* translated words */
+    M20_AOT_FUNC  func;
+} M20_AOT_BLOCK;
+
+uint16   cpu_aot_at[MAX_MEM_SIZE];      /* translated block at address: index + 1 */
+uint8    cpu_aot_valid[MAX_MEM_SIZE];   /* block at address checked */
+uint8    cpu_aot_cover[MAX_MEM_SIZE];   /* word of some block (not in vmask) */
+
+
+/*
+ * Idle loop detection.
+ * Taken backward jump saves registers at its target together with count of
+ * effects (changed MOSU words, I/O operations). If the jump comes to the same
+ * target with the same registers and no effects in between, the loop body
+ * was executed from the same machine state and it will repeat forever.
+ */
+#define  CPU_IDLE_TAB_SIZE   16
+
+typedef struct {
+    int       addr;				/* jump target, -1 = empty */
+    uint16    ra;
+    uint16    sma;
+    int       sw;
+    int       rop;
+    t_value   rr;
+    t_value   rmr;
+    t_uint64  effects;
+} M20_IDLE_ENTRY;
+
+M20_IDLE_ENTRY  cpu_idle_tab[CPU_IDLE_TAB_SIZE];
+t_uint64        cpu_effects;			/* changed MOSU words and I/O operations */
+t_uint64        cpu_inst_count = 0;		/* done instructions (ICOUNT) */
+t_uint64        cpu_inst_mark = ~(t_uint64) 0;	/* ICOUNT for m20_jrn_mark */
+
 
 /* SIMH required declarations */
 
 extern int32 sim_emax;
+extern BRKTAB **sim_brk_tab;
+extern int32 sim_brk_ent;
 
 /* external devices */
 extern t_stat read_card (t_value * csum, t_value * rsum, int * rcodes,
@@ -199,6 +305,7 @@ int      new_add = 0;
 int      new_mult = 0;
 int      new_div = 0;
 int      new_sqrt = 0;
+int      new_arith_verify = 0;
 int      itep_mode = 0;
 
 static  int  enable_m20_print_ascii_text = 0;
@@ -221,6 +328,25 @@ t_stat cpu_examine (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat cpu_deposit (t_value val, t_addr addr, UNIT *uptr, int32 sw);
 t_stat cpu_reset (DEVICE *dptr);
 t_stat cpu_one_inst ();
+t_stat cpu_show_hotspots (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat cpu_set_hotspots (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_clear_hotspots (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_set_callprof (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_callprof (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat cpu_set_ring (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_clear_ring (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_set_ring_file (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_ring (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat cpu_set_trace_filter (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_trace_filter (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat cpu_set_watch (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_watch (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+void cpu_trace_map_build (void);
+static t_stat cpu_exec_inst (const M20_DECODED_INST * di);
+static void cpu_invalidate (int addr);
+static void cpu_aot_drop (int addr);
+t_stat cpu_set_aot (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+static void mosu_write (int addr, t_value val);
 
 
 /*
@@ -232,7 +358,7 @@ t_stat cpu_one_inst ();
  * cpu_mod      CPU modifiers list
  */
 
-UNIT cpu_unit = { UDATA (NULL, UNIT_FIX, MAX_MEM_SIZE) };
+UNIT cpu_unit = { UDATA (NULL, UNIT_FIX|UNIT_IDLE_STOP, MAX_MEM_SIZE) };
 
 
 extern char  reg_rk_name[];
@@ -290,8 +416,10 @@ REG cpu_reg[] = {
         { DRDATA (USE_NEW_MULT, new_mult, 8), PV_LEFT },
         { DRDATA (USE_NEW_DIV, new_div, 8), PV_LEFT },
         { DRDATA (USE_NEW_SQRT, new_sqrt, 8), PV_LEFT },
+        { DRDATA (NEW_ARITH_VERIFY, new_arith_verify, 8), PV_LEFT },
         { DRDATA (USE_ADD_SBST, new_add, 8), PV_LEFT },
         { DRDATA (ITEP_MODE, itep_mode, 8), PV_LEFT },
+        { DRDATA (ICOUNT, cpu_inst_count, 64), PV_LEFT|REG_RO },
 	{ 0 }
 };
 
@@ -300,6 +428,60 @@ REG cpu_reg[] = {
 MTAB cpu_mod[] = {
     { SHORT_SYM_OP, SHORT_SYM_OP, "short symbolic instruction name", "SHORT_SYM_OPCODE", NULL },
     { SHORT_SYM_OP, 0,            "long  symbolic instruction name", "LONG_SYM_OPCODE", NULL },
+    { UNIT_ENGINE,  UNIT_ENG_SWITCH,   "switch interpreter engine", "SWITCH", NULL },
+    { UNIT_ENGINE,  UNIT_ENG_THREADED, "threaded code engine",      "THREADED", NULL },
+    { UNIT_ENGINE,  UNIT_ENG_BLOCK,    "basic-block engine",        "BLOCK", NULL },
+    { UNIT_ENGINE,  UNIT_ENG_AOT,      "translated code engine",    "AOT", &cpu_set_aot },
+    { UNIT_IDLELOOP, UNIT_IDLE_STOP,   "stop on idle loop",         "IDLESTOP", NULL },
+    { UNIT_IDLELOOP, UNIT_IDLE_SKIP,   "skip idle loop time",       "IDLESKIP", NULL },
+    { UNIT_IDLELOOP, UNIT_IDLE_OFF,    "no idle loop detection",    "NOIDLE", NULL },
+    { UNIT_HLE,     UNIT_HLE_OFF,      "no HLE",                    "NOHLE", NULL },
+    { UNIT_HLE,     UNIT_HLE_ON,       "HLE of library routines",   "HLE", NULL },
+    { UNIT_HLE,     UNIT_HLE_VERIFY,   "HLE verified by interpreter", "HLEVERIFY", NULL },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, "HLE", NULL,
+      NULL, &m20_hle_show, NULL, "Show registered HLE routines" },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP|MTAB_NC, 0, "HOTSPOTS", "HOTSPOTS",
+      &cpu_set_hotspots, &cpu_show_hotspots, NULL, "Show most expensive addresses / export profile as CSV" },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP, 1, "HOTCOUNT", NULL,
+      NULL, &cpu_show_hotspots, NULL, "Show most executed addresses" },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NOHOTSPOTS",
+      &cpu_clear_hotspots, NULL, NULL, "Clear execution profile" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALO|MTAB_NMO|MTAB_SHP|MTAB_NC, 0, "CALLPROFILE", "CALLPROFILE",
+      &cpu_set_callprof, &cpu_show_callprof, NULL, "Profile subroutines called by 016 / show most expensive ones" },
+    { MTAB_XTD|MTAB_VDV, 1, NULL, "NOCALLPROFILE",
+      &cpu_set_callprof, NULL, NULL, "Free subroutine profile" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR|MTAB_NC, 2, NULL, "CALLDUMP",
+      &cpu_set_callprof, NULL, NULL, "Write subroutine profile as folded stacks" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, "RINGTRACE", "RINGTRACE",
+      &cpu_set_ring, &cpu_show_ring, NULL, "Record last n instructions in binary trace ring" },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NORINGTRACE",
+      &cpu_clear_ring, NULL, NULL, "Free binary trace ring" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR|MTAB_NC, 0, NULL, "RINGDUMP",
+      &cpu_set_ring_file, NULL, NULL, "Write binary trace ring to file" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR|MTAB_NC, 1, NULL, "RINGFILE",
+      &cpu_set_ring_file, NULL, NULL, "Write binary trace ring to file on every stop" },
+    { MTAB_XTD|MTAB_VDV, 2, NULL, "NORINGFILE",
+      &cpu_set_ring_file, NULL, NULL, "Do not write binary trace ring on stop" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, "TRACEFILTER", "TRACEFILTER",
+      &cpu_set_trace_filter, &cpu_show_trace_filter, NULL, "Add trace filter item (IN:, EX:, OP:, START:, STOP:)" },
+    { MTAB_XTD|MTAB_VDV, 1, NULL, "NOTRACEFILTER",
+      &cpu_set_trace_filter, NULL, NULL, "Trace all instructions" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR|MTAB_NMO, 0, "WATCH", "WATCH",
+      &cpu_set_watch, &cpu_show_watch, NULL, "Add MOSU watchpoint (R:, W:, RW: range[/cond])" },
+    { MTAB_XTD|MTAB_VDV, 1, NULL, "NOWATCH",
+      &cpu_set_watch, NULL, NULL, "Remove all MOSU watchpoints" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR|MTAB_NC, 0, NULL, "RECORD",
+      &m20_jrn_set, NULL, NULL, "Record external inputs into journal file" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR|MTAB_NC, 1, NULL, "REPLAY",
+      &m20_jrn_set, NULL, NULL, "Take external inputs from journal file" },
+    { MTAB_XTD|MTAB_VDV, 2, NULL, "NOJOURNAL",
+      &m20_jrn_set, NULL, NULL, "Close journal of external inputs" },
+    { MTAB_XTD|MTAB_VDV|MTAB_VALR, 3, NULL, "STOPAT",
+      &m20_jrn_set, NULL, NULL, "Stop when ICOUNT instructions are done" },
+    { MTAB_XTD|MTAB_VDV, 4, NULL, "NOSTOPAT",
+      &m20_jrn_set, NULL, NULL, "No stop on ICOUNT" },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, "JOURNAL", NULL,
+      NULL, &m20_jrn_show, NULL, "Show journal of external inputs and ICOUNT" },
     { 0 }
 };
 
@@ -320,6 +502,7 @@ typedef  struct command_profile_stat {
 } COMMAND_PROFILE_STAT, * PCOMMAND_PROFILE_STAT;
 
 
+/* Opcode profile, indexed by opcode */
 COMMAND_PROFILE_STAT   cmd_profile_table[M20_SYM_OPCODE_TABLE_SIZE] = {
    {OPCODE_TRANSFER_MEM2MEM, 0, 0},
    {OPCODE_ADD_ROUND_NORM, 0, 0},
@@ -387,6 +570,9 @@ COMMAND_PROFILE_STAT   cmd_profile_table[M20_SYM_OPCODE_TABLE_SIZE] = {
    {OPCODE_STOP_077, 0, 0}
 };
 
+/* Address profile, indexed by instruction address (op_code is last executed there) */
+COMMAND_PROFILE_STAT   addr_profile_table[MAX_MEM_SIZE];
+
 
 
 
@@ -481,12 +667,28 @@ t_stat cpu_deposit (t_value val, t_addr addr, UNIT *uptr, int32 sw)
      if (addr == 07777) return STOP_WRITE_TO_RO_MEM_LOC;
    }
 
-   MOSU[addr] = val;
+   mosu_write (addr, val);
 
    return SCPE_OK;
 }
 
 
+/*
+ * Write word into MOSU array. All memory writes come here.
+ */
+static void mosu_write (int addr, t_value val)
+{
+   if (MOSU[addr] == val) return;
+
+   if (MOSU[addr] & ~WORD45) mosu_garbage_count--;
+   if (val & ~WORD45) mosu_garbage_count++;
+
+   MOSU[addr] = val;
+   cpu_effects++;
+   cpu_invalidate (addr);
+}
+
+
 /*
  * Reset routine
  */
@@ -504,6 +706,7 @@ t_stat cpu_reset (DEVICE *dptr)
     ext_io_op = MAX_ADDR_VALUE;
 
     sim_brk_types = sim_brk_dflt = SWMASK ('E');
+    sim_vm_cmd = m20_cmd;                          /* FORK (m20_fork.c) */
 
     //memset( MOSU, 0, sizeof(MOSU) );
 
@@ -511,6 +714,538 @@ t_stat cpu_reset (DEVICE *dptr)
 }
 
 
+/*
+ * Save machine state (libm20).
+ */
+void cpu_state_save (M20_CPU_STATE * st)
+{
+    memcpy (st->mosu, MOSU, sizeof(MOSU));
+    st->kra = regKRA;
+    st->ra = regRA;
+    st->sma = regSMA;
+    st->sw = trgSW;
+    st->rop = regROP;
+    st->rk = regRK;
+    st->rr = regRR;
+    st->rmr = regRMR;
+    st->p1 = regP1;
+    st->rpu[0] = RPU1;
+    st->rpu[1] = RPU2;
+    st->rpu[2] = RPU3;
+    st->rpu[3] = RPU4;
+    st->old_sw = old_trgSW;
+    st->old_opcode = old_opcode;
+    st->cr_io_addr[0] = cr_io_addr_1;
+    st->cr_io_addr[1] = cr_io_addr_2;
+    st->cr_io_addr[2] = cr_io_addr_3;
+    st->delay = delay;
+    st->ext_io_op = ext_io_op;
+    st->ext_io_dev_zone_addr = ext_io_dev_zone_addr;
+    st->ext_io_ram_start = ext_io_ram_start;
+    st->ext_io_ram_end = ext_io_ram_end;
+    st->ext_io_ram_jump = ext_io_ram_jump;
+    st->ext_io_ram_chksum = ext_io_ram_chksum;
+    st->cdr_csum = cdr_csum;
+    st->cdr_rsum = cdr_rsum;
+    st->cdr_rcodes = cdr_rcodes;
+    st->cdr_stop_blocking = cdr_stop_blocking;
+    st->cdr_control_blocking = cdr_control_blocking;
+    st->boot_device_req_cdr = boot_device_req_cdr;
+    st->active_lpt = active_lpt;
+    st->active_cdp = active_cdp;
+    st->run_mode = run_mode;
+    st->mosu_mode = mosu_mode;
+    st->itep_mode = itep_mode;
+    st->new_add = new_add;
+    st->new_mult = new_mult;
+    st->new_div = new_div;
+    st->new_sqrt = new_sqrt;
+    st->mosu_garbage_count = mosu_garbage_count;
+    st->unit_flags = cpu_unit.flags;
+}
+
+
+/*
+ * Registers and modes of saved state.
+ */
+static void cpu_regs_restore (const M20_CPU_STATE * st)
+{
+    regKRA = st->kra;
+    regRA = st->ra;
+    regSMA = st->sma;
+    trgSW = st->sw;
+    regROP = st->rop;
+    regRK = st->rk;
+    regRR = st->rr;
+    regRMR = st->rmr;
+    regP1 = st->p1;
+    RPU1 = st->rpu[0];
+    RPU2 = st->rpu[1];
+    RPU3 = st->rpu[2];
+    RPU4 = st->rpu[3];
+    old_trgSW = st->old_sw;
+    old_opcode = st->old_opcode;
+    cr_io_addr_1 = st->cr_io_addr[0];
+    cr_io_addr_2 = st->cr_io_addr[1];
+    cr_io_addr_3 = st->cr_io_addr[2];
+    delay = st->delay;
+    ext_io_op = st->ext_io_op;
+    ext_io_dev_zone_addr = st->ext_io_dev_zone_addr;
+    ext_io_ram_start = st->ext_io_ram_start;
+    ext_io_ram_end = st->ext_io_ram_end;
+    ext_io_ram_jump = st->ext_io_ram_jump;
+    ext_io_ram_chksum = st->ext_io_ram_chksum;
+    cdr_csum = st->cdr_csum;
+    cdr_rsum = st->cdr_rsum;
+    cdr_rcodes = st->cdr_rcodes;
+    cdr_stop_blocking = st->cdr_stop_blocking;
+    cdr_control_blocking = st->cdr_control_blocking;
+    boot_device_req_cdr = st->boot_device_req_cdr;
+    active_lpt = st->active_lpt;
+    active_cdp = st->active_cdp;
+    run_mode = st->run_mode;
+    mosu_mode = st->mosu_mode;
+    itep_mode = st->itep_mode;
+    new_add = st->new_add;
+    new_mult = st->new_mult;
+    new_div = st->new_div;
+    new_sqrt = st->new_sqrt;
+}
+
+
+/*
+ * Restore machine state (libm20).
+ * Predecoded instructions belong to previous machine, drop them.
+ */
+void cpu_state_restore (const M20_CPU_STATE * st)
+{
+    memcpy (MOSU, st->mosu, sizeof(MOSU));
+    cpu_regs_restore (st);
+    mosu_garbage_count = st->mosu_garbage_count;
+    cpu_unit.flags = st->unit_flags;
+
+    memset (cpu_decode_cache, 0, sizeof(cpu_decode_cache));
+    memset (cpu_block_len, 0, sizeof(cpu_block_len));
+    memset (cpu_aot_valid, 0, sizeof(cpu_aot_valid));
+}
+
+
+/*
+ * Put state into running machine (journal replay): changed words go
+ * through mosu_write, so predecoded instructions stay valid.
+ */
+void cpu_state_apply (const M20_CPU_STATE * st)
+{
+    cpu_mosu_restore (st->mosu);
+    cpu_regs_restore (st);
+    cpu_effects++;				/* RPU may be changed, no idle loop */
+}
+
+
+/*
+ * Trace filter.
+ * Address ranges and opcodes to trace, set by SET CPU TRACEFILTER=item:
+ *   IN:lo[-hi]     trace only given addresses (all if no IN items)
+ *   EX:lo[-hi]     do not trace given addresses
+ *   OP:op[/op...]  trace only given opcodes (all if no OP items)
+ *   START:addr[/n] start tracing when KRA reaches addr n-th time
+ *   STOP:m         stop tracing after m traced instructions
+ * DISABLE_IS2_TRACE and DISABLE_B61_TRACE act as EX:7200-7767 and EX:0200-0677.
+ * Ranges are folded into trace_addr_map on run start, so an address
+ * out of filter costs one test.
+ */
+#define  TRACE_FILTER_MAX      16
+
+#define  TRACE_MAP_ON          1        /* trace instruction at address */
+#define  TRACE_MAP_START       2        /* START address */
+
+typedef  struct trace_range {
+    int  lo, hi;
+    int  include;
+} TRACE_RANGE;
+
+TRACE_RANGE  trace_ranges[TRACE_FILTER_MAX];
+int      trace_nranges = 0;
+uint8    trace_op_set[M20_SYM_OPCODE_TABLE_SIZE];
+int      trace_nops = 0;
+int      trace_start_addr = -1;
+uint32   trace_start_count = 0;         /* START hits needed */
+uint32   trace_start_hits = 0;
+uint32   trace_stop_count = 0;          /* 0 = no STOP */
+uint32   trace_traced = 0;              /* instructions traced */
+
+uint8    trace_addr_map[MAX_MEM_SIZE];
+
+
+/*
+ * Fold trace filter into address map.
+ */
+void cpu_trace_map_build (void)
+{
+    int i, addr, include;
+
+	include = 1;
+	for( i=0; i<trace_nranges; i++ )
+	  if (trace_ranges[i].include) include = 0;
+	memset (trace_addr_map, include ? TRACE_MAP_ON : 0, sizeof(trace_addr_map));
+
+	for( i=0; i<trace_nranges; i++ )
+	  if (trace_ranges[i].include)
+	    for( addr=trace_ranges[i].lo; addr<=trace_ranges[i].hi; addr++ )
+	      trace_addr_map[addr] = TRACE_MAP_ON;
+	for( i=0; i<trace_nranges; i++ )
+	  if (!trace_ranges[i].include)
+	    for( addr=trace_ranges[i].lo; addr<=trace_ranges[i].hi; addr++ )
+	      trace_addr_map[addr] = 0;
+
+	if (disable_is2_trace)
+	  for( addr=07200; addr<=07767; addr++ ) trace_addr_map[addr] = 0;
+	if (disable_b61_trace)
+	  for( addr=00200; addr<=00677; addr++ ) trace_addr_map[addr] = 0;
+
+	if (trace_start_addr >= 0)
+	  trace_addr_map[trace_start_addr] |= TRACE_MAP_START;
+}
+
+
+/*
+ * Check START/STOP triggers and opcode set for instruction at KRA
+ * with nonzero trace_addr_map entry.
+ */
+static int cpu_trace_check (int op)
+{
+	if ((trace_addr_map[regKRA] & TRACE_MAP_START) && (trace_start_hits < trace_start_count))
+	  trace_start_hits++;
+	if (trace_start_hits < trace_start_count) return 0;
+	if (!(trace_addr_map[regKRA] & TRACE_MAP_ON)) return 0;
+	if (trace_nops && !trace_op_set[op]) return 0;
+	if (trace_stop_count) {
+	  if (trace_traced >= trace_stop_count) return 0;
+	  trace_traced++;
+	}
+	return 1;
+}
+
+
+/*
+ * Parse lo[-hi] octal address range.
+ */
+static t_stat cpu_parse_range (CONST char * cptr, int * lo, int * hi)
+{
+    CONST char * tptr;
+
+	*lo = *hi = (int) strtotv (cptr, &tptr, 8);
+	if ((tptr == cptr) || (*lo > MAX_ADDR_VALUE)) return SCPE_ARG;
+	if (*tptr == '-') {
+	  cptr = tptr + 1;
+	  *hi = (int) strtotv (cptr, &tptr, 8);
+	  if ((tptr == cptr) || (*hi > MAX_ADDR_VALUE) || (*hi < *lo)) return SCPE_ARG;
+	}
+	return (*tptr == 0) ? SCPE_OK : SCPE_ARG;
+}
+
+
+/*
+ * SET CPU TRACEFILTER=item, SET CPU NOTRACEFILTER
+ */
+t_stat cpu_set_trace_filter (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+    CONST char * tptr;
+    int lo, hi, op;
+    t_stat r;
+
+	if (val) {					/* NOTRACEFILTER */
+	  if (cptr) return SCPE_ARG;
+	  trace_nranges = trace_nops = 0;
+	  memset (trace_op_set, 0, sizeof(trace_op_set));
+	  trace_start_addr = -1;
+	  trace_start_count = trace_start_hits = 0;
+	  trace_stop_count = trace_traced = 0;
+	  cpu_trace_map_build ();
+	  return SCPE_OK;
+	}
+
+	if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+
+	if ((strncmp (cptr, "IN:", 3) == 0) || (strncmp (cptr, "EX:", 3) == 0)) {
+	  if (trace_nranges >= TRACE_FILTER_MAX) return SCPE_ARG;
+	  r = cpu_parse_range (cptr + 3, &lo, &hi);
+	  if (r) return r;
+	  trace_ranges[trace_nranges].lo = lo;
+	  trace_ranges[trace_nranges].hi = hi;
+	  trace_ranges[trace_nranges].include = (cptr[0] == 'I');
+	  trace_nranges++;
+	}
+	else if (strncmp (cptr, "OP:", 3) == 0) {
+	  cptr += 3;
+	  for (;;) {
+	    op = (int) strtotv (cptr, &tptr, 8);
+	    if ((tptr == cptr) || (op > MAX_OPCODE_VALUE)) return SCPE_ARG;
+	    if (!trace_op_set[op]) trace_nops++;
+	    trace_op_set[op] = 1;
+	    if (*tptr == 0) break;
+	    if (*tptr != '/') return SCPE_ARG;
+	    cptr = tptr + 1;
+	  }
+	}
+	else if (strncmp (cptr, "START:", 6) == 0) {
+	  cptr += 6;
+	  lo = (int) strtotv (cptr, &tptr, 8);
+	  if ((tptr == cptr) || (lo > MAX_ADDR_VALUE)) return SCPE_ARG;
+	  trace_start_count = 1;
+	  if (*tptr == '/') {
+	    trace_start_count = (uint32) get_uint (tptr + 1, 10, 0xFFFFFFFF, &r);
+	    if (r || (trace_start_count == 0)) return SCPE_ARG;
+	  }
+	  else if (*tptr != 0) return SCPE_ARG;
+	  trace_start_addr = lo;
+	  trace_start_hits = 0;
+	}
+	else if (strncmp (cptr, "STOP:", 5) == 0) {
+	  trace_stop_count = (uint32) get_uint (cptr + 5, 10, 0xFFFFFFFF, &r);
+	  if (r) return SCPE_ARG;
+	  trace_traced = 0;
+	}
+	else return SCPE_ARG;
+
+	cpu_trace_map_build ();
+	return SCPE_OK;
+}
+
+
+/*
+ * SHOW CPU TRACEFILTER
+ */
+t_stat cpu_show_trace_filter (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+    int i;
+
+	if (!trace_nranges && !trace_nops && (trace_start_addr < 0) && !trace_stop_count) {
+	  fprintf (st, "no trace filter");
+	  return SCPE_OK;
+	}
+	fprintf (st, "trace filter");
+	for( i=0; i<trace_nranges; i++ )
+	  fprintf (st, " %s:%04o-%04o", trace_ranges[i].include ? "IN" : "EX",
+	           trace_ranges[i].lo, trace_ranges[i].hi);
+	if (trace_nops) {
+	  fprintf (st, " OP:");
+	  for( i=0; i<M20_SYM_OPCODE_TABLE_SIZE; i++ )
+	    if (trace_op_set[i]) fprintf (st, "%02o ", i);
+	}
+	if (trace_start_addr >= 0)
+	  fprintf (st, " START:%04o/%u (%u reached)", trace_start_addr, trace_start_count, trace_start_hits);
+	if (trace_stop_count)
+	  fprintf (st, " STOP:%u (%u traced)", trace_stop_count, trace_traced);
+	return SCPE_OK;
+}
+
+
+/*
+ * Watchpoints.
+ * MOSU reads and writes to stop on, set by SET CPU WATCH=item:
+ *   R:lo[-hi][/cond]   read by instruction or device
+ *   W:lo[-hi][/cond]   write by instruction or device
+ *   RW:lo[-hi][/cond]  both
+ * cond on the word read or written (v, m - octal or TAG):
+ *   =v   equal to v        #v   not equal to v
+ *   &m   has bit of m      +m   write sets bit of m (W:1234/+TAG)
+ * Run stops with STOP_WATCH after the instruction; KRA is next one.
+ * mosu_load and mosu_store test one bit of cpu_watch_map, LOAD, DUMP,
+ * EXAMINE and DEPOSIT are not watched.
+ */
+#define  CPU_WATCH_MAX         16
+#define  CPU_WATCH_SHOW        8        /* hits shown per stop */
+
+#define  CPU_WATCH_R           1
+#define  CPU_WATCH_W           2
+
+#define  CPU_WATCH_ANY         0
+#define  CPU_WATCH_EQ          1
+#define  CPU_WATCH_NE          2
+#define  CPU_WATCH_HAS         3
+#define  CPU_WATCH_SETS        4
+
+#define  CPU_WATCH_TEST(t, a)  (cpu_watch_map[(t) - 1][(a) >> 5] & (1u << ((a) & 31)))
+
+typedef  struct cpu_watch {
+    int      lo, hi;
+    int      type;                      /* CPU_WATCH_R | CPU_WATCH_W */
+    int      cond;
+    t_value  val;
+    uint32   hits;
+} CPU_WATCH;
+
+CPU_WATCH  cpu_watch[CPU_WATCH_MAX];
+int      cpu_nwatch = 0;
+uint32   cpu_watch_map[2][MAX_MEM_SIZE / 32];
+int      cpu_watch_pending = 0;         /* hits, stop after instruction */
+
+
+static void cpu_watch_map_build (void)
+{
+    int i, addr;
+
+	memset (cpu_watch_map, 0, sizeof(cpu_watch_map));
+	for( i=0; i<cpu_nwatch; i++ )
+	  for( addr=cpu_watch[i].lo; addr<=cpu_watch[i].hi; addr++ ) {
+	    if (cpu_watch[i].type & CPU_WATCH_R) cpu_watch_map[0][addr >> 5] |= 1u << (addr & 31);
+	    if (cpu_watch[i].type & CPU_WATCH_W) cpu_watch_map[1][addr >> 5] |= 1u << (addr & 31);
+	  }
+}
+
+
+/*
+ * Access to watched word: check conditions, report hit, make stop pending.
+ */
+static void cpu_watch_check (int type, int addr, t_value old, t_value val)
+{
+    CPU_WATCH * w;
+    int i;
+
+	if (!sim_is_running) return;
+
+	for( i=0; i<cpu_nwatch; i++ ) {
+	  w = &cpu_watch[i];
+	  if (!(w->type & type) || (addr < w->lo) || (addr > w->hi)) continue;
+	  switch (w->cond) {
+	  case CPU_WATCH_EQ:   if (val != w->val) continue; break;
+	  case CPU_WATCH_NE:   if (val == w->val) continue; break;
+	  case CPU_WATCH_HAS:  if (!(val & w->val)) continue; break;
+	  case CPU_WATCH_SETS: if (!(val & ~old & w->val)) continue; break;
+	  }
+	  w->hits++;
+	  if (cpu_watch_pending++ >= CPU_WATCH_SHOW) return;
+	  if (type == CPU_WATCH_W)
+	    sim_printf ("Watch %d: write %04o = %015" LL_FMT "o (was %015" LL_FMT "o), RK %015" LL_FMT "o\n",
+	                i + 1, addr, val, old, regRK);
+	  else
+	    sim_printf ("Watch %d: read %04o = %015" LL_FMT "o, RK %015" LL_FMT "o\n",
+	                i + 1, addr, val, regRK);
+	  return;
+	}
+}
+
+
+/*
+ * Stop after instruction with watchpoint hit.
+ */
+static t_stat cpu_watch_stop (t_stat r)
+{
+	if (cpu_watch_pending > CPU_WATCH_SHOW)
+	  sim_printf ("Watch: %d more hits\n", cpu_watch_pending - CPU_WATCH_SHOW);
+	cpu_watch_pending = 0;
+	if (r) return r;			/* other stop first */
+	return STOP_WATCH;
+}
+
+
+/*
+ * Parse watchpoint value: octal word or TAG.
+ */
+static t_stat cpu_parse_watch_val (CONST char * cptr, t_value * val)
+{
+    CONST char * tptr;
+
+	if (strcmp (cptr, "TAG") == 0) {
+	  *val = TAG;
+	  return SCPE_OK;
+	}
+	*val = strtotv (cptr, &tptr, 8);
+	if ((tptr == cptr) || (*tptr != 0) || (*val & ~WORD45)) return SCPE_ARG;
+	return SCPE_OK;
+}
+
+
+/*
+ * SET CPU WATCH=item, SET CPU NOWATCH
+ */
+t_stat cpu_set_watch (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+    char gbuf[CBUFSIZE];
+    CPU_WATCH * w;
+    char * cond;
+    t_stat r;
+
+	if (val) {					/* NOWATCH */
+	  if (cptr) return SCPE_ARG;
+	  cpu_nwatch = 0;
+	  cpu_watch_map_build ();
+	  return SCPE_OK;
+	}
+
+	if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+	if (cpu_nwatch >= CPU_WATCH_MAX) return SCPE_ARG;
+	w = &cpu_watch[cpu_nwatch];
+	memset (w, 0, sizeof(CPU_WATCH));
+
+	if (strncmp (cptr, "RW:", 3) == 0) {
+	  w->type = CPU_WATCH_R | CPU_WATCH_W;
+	  cptr += 3;
+	}
+	else if (strncmp (cptr, "R:", 2) == 0) {
+	  w->type = CPU_WATCH_R;
+	  cptr += 2;
+	}
+	else if (strncmp (cptr, "W:", 2) == 0) {
+	  w->type = CPU_WATCH_W;
+	  cptr += 2;
+	}
+	else return SCPE_ARG;
+
+	strlcpy (gbuf, cptr, sizeof(gbuf));
+	cond = strchr (gbuf, '/');
+	if (cond) *cond++ = 0;
+	r = cpu_parse_range (gbuf, &w->lo, &w->hi);
+	if (r) return r;
+
+	w->cond = CPU_WATCH_ANY;
+	if (cond) {
+	  switch (*cond++) {
+	  case '=': w->cond = CPU_WATCH_EQ; break;
+	  case '#': w->cond = CPU_WATCH_NE; break;
+	  case '&': w->cond = CPU_WATCH_HAS; break;
+	  case '+': w->cond = CPU_WATCH_SETS; break;
+	  default:  return SCPE_ARG;
+	  }
+	  if ((w->cond == CPU_WATCH_SETS) && (w->type != CPU_WATCH_W)) return SCPE_ARG;
+	  r = cpu_parse_watch_val (cond, &w->val);
+	  if (r) return r;
+	}
+
+	cpu_nwatch++;
+	cpu_watch_map_build ();
+	return SCPE_OK;
+}
+
+
+/*
+ * SHOW CPU WATCH
+ */
+t_stat cpu_show_watch (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+    static const char * const cond_name[] = { "", "=", "#", "&", "+" };
+    static const char * const type_name[] = { "", "R", "W", "RW" };
+    CPU_WATCH * w;
+    int i;
+
+	if (cpu_nwatch == 0) {
+	  fprintf (st, "no watchpoints\n");
+	  return SCPE_OK;
+	}
+	for( i=0; i<cpu_nwatch; i++ ) {
+	  w = &cpu_watch[i];
+	  fprintf (st, "%2d  %s:%04o-%04o", i + 1, type_name[w->type], w->lo, w->hi);
+	  if (w->cond != CPU_WATCH_ANY) {
+	    if (w->val == TAG) fprintf (st, "/%sTAG", cond_name[w->cond]);
+	    else fprintf (st, "/%s%015" LL_FMT "o", cond_name[w->cond], w->val);
+	  }
+	  fprintf (st, "  %u hits\n", w->hits);
+	}
+	return SCPE_OK;
+}
+
+
 void trace_before_run(pa1,pa2,pa3,pt_ra,pt_sw,pt_rr,pm1,pm2,pm3,irreg)
 int *pa1, *pa2, *pa3, *pt_sw, irreg;
 uint16 *pt_ra;
@@ -518,12 +1253,6 @@ t_value *pm1, *pm2, *pm3, *pt_rr;
 {
   if (sim_deb && cpu_dev.dctrl) {
 	int a1,a2,a3,addr_tags;
-	    if (disable_is2_trace) {
-	      if ((regKRA >= 07200) && (regKRA <= 07767)) goto trace_before_done;
-	    }
-	    if (disable_b61_trace) {
-	      if ((regKRA >= 00200) && (regKRA <= 00677)) goto trace_before_done;
-	    }
 	    addr_tags = regRK >> BITS_42 & MAX_ADDR_TAG_VALUE;
 	    a1 = regRK >> BITS_24 & MAX_ADDR_VALUE;
 	    a2 = regRK >> BITS_12 & MAX_ADDR_VALUE;
@@ -556,7 +1285,6 @@ t_value *pm1, *pm2, *pm3, *pt_rr;
 	    }
             if (debug_dump_regs || debug_dump_mem) fprintf (sim_deb, "\n");
 	    *pa1=a1; *pa2=a2; *pa3=a3;
-          trace_before_done: {};
   }
 }
 
@@ -568,12 +1296,6 @@ t_value m1, m2, m3, t_rr;
 {
 if (sim_deb && cpu_dev.dctrl) {
   char c1,c2,c3;
-	    if (disable_is2_trace) {
-	      if ((regKRA >= 07200) && (regKRA <= 07767)) goto trace_after_done;
-	    }
-	    if (disable_b61_trace) {
-	      if ((regKRA >= 00200) && (regKRA <= 00677)) goto trace_after_done;
-	    }
 	           if (debug_dump_regs) {
 	             c1='-'; c2='-'; c3='-';
 	             if (t_ra != regRA) c1 = '*';
@@ -595,30 +1317,203 @@ if (sim_deb && cpu_dev.dctrl) {
                      }
 	           }
 	           if (debug_dump_regs || debug_dump_mem) fprintf (sim_deb, "\n");
-          trace_after_done: {};
   }
 }
 
+/*
+ * Binary trace ring buffer.
+ * Every executed instruction takes one record (SET CPU RINGTRACE=n);
+ * ring is written to file on demand (SET CPU RINGDUMP=file) or on
+ * every stop of the CPU (SET CPU RINGFILE=file). Records are rendered
+ * to the text trace format by dump_trace.
+ */
+PM20_TRACE_REC  cpu_ring = NULL;
+uint32   cpu_ring_size = 0;             /* records in ring */
+uint32   cpu_ring_pos = 0;              /* next record to fill */
+t_uint64 cpu_ring_total = 0;            /* records filled since ring allocated */
+char     cpu_ring_file[CBUFSIZE] = "";  /* write ring here on stop */
+
+
+/*
+ * Take next record of ring and save state before execution.
+ */
+static PM20_TRACE_REC cpu_ring_before (int irreg)
+{
+    PM20_TRACE_REC tr;
+    int addr_tags, i;
+
+	tr = &cpu_ring[cpu_ring_pos];
+	if (++cpu_ring_pos >= cpu_ring_size) cpu_ring_pos = 0;
+	cpu_ring_total++;
+
+	addr_tags = regRK >> BITS_42 & MAX_ADDR_TAG_VALUE;
+	tr->a[0] = regRK >> BITS_24 & MAX_ADDR_VALUE;
+	tr->a[1] = regRK >> BITS_12 & MAX_ADDR_VALUE;
+	tr->a[2] = regRK >> BITS_0  & MAX_ADDR_VALUE;
+	if (addr_tags & 4) tr->a[0] = (tr->a[0] + regRA) & MAX_ADDR_VALUE;
+	if (addr_tags & 2) tr->a[1] = (tr->a[1] + regRA) & MAX_ADDR_VALUE;
+	if (addr_tags & 1) tr->a[2] = (tr->a[2] + regRA) & MAX_ADDR_VALUE;
+
+	tr->rk = regRK;
+	tr->kra = regKRA;
+	tr->ra = regRA;
+	tr->sw = (uint8) trgSW;
+	tr->rr = regRR;
+	for( i=0; i<3; i++ ) tr->m[i] = MOSU[tr->a[i]];
+	tr->flags = irreg ? M20_TRACE_IRREG : 0;
+	return tr;
+}
+
+
+/*
+ * Save state after execution into ring record.
+ */
+static void cpu_ring_after (PM20_TRACE_REC tr, int a1)
+{
+	tr->a1_after = a1;
+	tr->ra_after = regRA;
+	tr->sw_after = (uint8) trgSW;
+	tr->rr_after = regRR;
+	tr->m_after[0] = MOSU[a1];
+	tr->m_after[1] = MOSU[tr->a[1]];
+	tr->m_after[2] = MOSU[tr->a[2]];
+}
+
+
+/*
+ * Write ring contents to file, oldest record first.
+ */
+t_stat cpu_ring_write (const char * fname)
+{
+    FILE * f;
+    M20_TRACE_HDR hdr;
+    uint32 count, first;
+
+	if (cpu_ring == NULL) return SCPE_NOFNC;
+
+	f = sim_fopen (fname, "wb");
+	if (f == NULL) return SCPE_OPENERR;
+
+	count = (cpu_ring_total < cpu_ring_size) ? (uint32) cpu_ring_total : cpu_ring_size;
+	first = (cpu_ring_total < cpu_ring_size) ? 0 : cpu_ring_pos;
+
+	memset (&hdr, 0, sizeof(hdr));
+	memcpy (hdr.magic, M20_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = M20_TRACE_VERSION;
+	hdr.rec_size = sizeof(M20_TRACE_REC);
+	hdr.count = count;
+	fwrite (&hdr, sizeof(hdr), 1, f);
+
+	if (first > 0) {
+	  fwrite (&cpu_ring[first], sizeof(M20_TRACE_REC), cpu_ring_size - first, f);
+	  fwrite (&cpu_ring[0], sizeof(M20_TRACE_REC), first, f);
+	}
+	else fwrite (&cpu_ring[0], sizeof(M20_TRACE_REC), count, f);
+
+	fclose (f);
+	return SCPE_OK;
+}
+
+
+/*
+ * SET CPU RINGTRACE=n: allocate ring of n records.
+ */
+t_stat cpu_set_ring (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+    uint32 size;
+    t_stat r;
+
+	if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+	size = (uint32) get_uint (cptr, 10, 0x1000000, &r);
+	if ((r != SCPE_OK) || (size == 0)) return SCPE_ARG;
+
+	free (cpu_ring);
+	cpu_ring = (PM20_TRACE_REC) calloc (size, sizeof(M20_TRACE_REC));
+	if (cpu_ring == NULL) {
+	  cpu_ring_size = 0;
+	  return SCPE_MEM;
+	}
+	cpu_ring_size = size;
+	cpu_ring_pos = 0;
+	cpu_ring_total = 0;
+	return SCPE_OK;
+}
+
+
+/*
+ * SET CPU NORINGTRACE: free ring.
+ */
+t_stat cpu_clear_ring (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+	if (cptr) return SCPE_ARG;
+
+	free (cpu_ring);
+	cpu_ring = NULL;
+	cpu_ring_size = cpu_ring_pos = 0;
+	cpu_ring_total = 0;
+	return SCPE_OK;
+}
+
+
+/*
+ * SET CPU RINGDUMP=file, SET CPU RINGFILE=file, SET CPU NORINGFILE.
+ */
+t_stat cpu_set_ring_file (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+	if (val == 2) {				/* NORINGFILE */
+	  if (cptr) return SCPE_ARG;
+	  cpu_ring_file[0] = 0;
+	  return SCPE_OK;
+	}
+	if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+	if (val == 0)				/* RINGDUMP */
+	  return cpu_ring_write (cptr);
+
+	strncpy (cpu_ring_file, cptr, sizeof(cpu_ring_file) - 1);
+	cpu_ring_file[sizeof(cpu_ring_file) - 1] = 0;
+	return SCPE_OK;
+}
+
+
+/*
+ * SHOW CPU RINGTRACE
+ */
+t_stat cpu_show_ring (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+	if (cpu_ring == NULL) {
+	  fprintf (st, "ring trace off");
+	  return SCPE_OK;
+	}
+	fprintf (st, "ring trace %u records, %.0f executed", cpu_ring_size, (double) cpu_ring_total);
+	if (cpu_ring_file[0]) fprintf (st, ", written on stop to %s", cpu_ring_file);
+	return SCPE_OK;
+}
+
+
 t_stat irregular_cmd()
 {
 	int a1,a2,a3,t_sw;
 	uint16 t_ra;
 	t_value m1,m2,m3,t_rr;
 	t_stat err;
-		trace_before_run(&a1,&a2,&a3,&t_ra,&t_sw,&t_rr,&m1,&m2,&m3,1);
+	PM20_TRACE_REC tr = NULL;
+	int traced;
+		if (cpu_ring) tr = cpu_ring_before(1);
+		traced = (trace_addr_map[regKRA] & TRACE_MAP_ON) != 0;
+		if (traced) trace_before_run(&a1,&a2,&a3,&t_ra,&t_sw,&t_rr,&m1,&m2,&m3,1);
 		err=cpu_one_inst();
-		trace_after_run(a1,a2,a3,t_ra,t_sw,t_rr,m1,m2,m3);
+		if (traced) trace_after_run(a1,a2,a3,t_ra,t_sw,t_rr,m1,m2,m3);
+		if (tr) cpu_ring_after(tr, tr->a[0]);
 		return err;
 }
 
 /*
- * Считывание слова из памяти.
+ * Считывание слова из памяти без проверки точек наблюдения (WATCH).
  */
-t_value mosu_load (int addr)
+static M20_INLINE t_value mosu_peek (int addr)
 {
     t_value val;
 
-    addr &= MAX_ADDR_VALUE;
     //if (addr == 0) return 0;
 
     val = MOSU[addr];
@@ -645,16 +1540,35 @@ t_value mosu_load (int addr)
     return val;
 }
 
-
-
 /*
- * Запись слова в память.
+ * Считывание слова из памяти.
  */
-void mosu_store (int addr, t_value val)
+t_value mosu_load (int addr)
+{
+    t_value val;
+
+    addr &= MAX_ADDR_VALUE;
+    val = mosu_peek (addr);
+
+    if (CPU_WATCH_TEST (CPU_WATCH_R, addr))
+      cpu_watch_check (CPU_WATCH_R, addr, val, val);
+
+    return val;
+}
+
+
+
+/*
+ * Запись слова в память.
+ */
+void mosu_store (int addr, t_value val)
 {
     addr &= MAX_ADDR_VALUE;
     if (addr == 0) return;
 
+    if (CPU_WATCH_TEST (CPU_WATCH_W, addr))
+      cpu_watch_check (CPU_WATCH_W, addr, MOSU[addr], val);
+
     if ( (mosu_mode == MOSU_MODE_II) && (addr > 07767) ) {
 	if (itep_mode) {
 		if (addr == 07776)
@@ -665,7 +1579,9 @@ void mosu_store (int addr, t_value val)
 		}
 	}
     }
-    else MOSU[addr] = val;
+    else {
+      mosu_write (addr, val);
+    }
 }
 
 
@@ -1192,6 +2108,74 @@ t_stat new_addition_v44 (t_value *result, t_value x, t_value y, int no_round, in
 }
 
 
+/*
+ * Addition (op_code 01), subtraction (02) and subtraction of modules (03)
+ * with rounding/normalization bits by new_addition_v44.
+ * Counterpart of new_arithmetic_op when USE_NEW_ADD is off.
+ */
+t_stat addition_v44_op (t_value *result, t_value x, t_value y, int op_code)
+{
+	int force_round = 0;
+	int no_norm = 1;
+
+	switch (op_code & 017) {
+	case 1:
+		return new_addition_v44 (result, x, y, op_code >> 4 & 1, op_code >> 5 & 1, 0);
+
+	case 2:
+		break;
+
+	default:
+		if ((op_code==003) || (op_code==023)) no_norm=0;
+		x &= ~SIGN;
+		y |= SIGN;
+		return new_addition_v44 (result, x, y, 1, no_norm, 0);
+	}
+
+	if (arithmetic_op_debug) fprintf(stderr,"sub01: y=%15llo \n",y);
+
+	/* When one of operands is machine zero, rounding should not be performed.
+	But if we take machine zero as 2nd operand, invert the sign and call addition,
+	it already will not be machine zero and can be rounded. Opposite case also may occur,
+	when the 2nd operand is -0 and will not be rounded after sign inversion (as machine zero).
+
+	Non-inverting the sign of machine zero and then call addition is wrong decision,
+	because in this case rounding logic (based on signs) may became broken for -0.
+	Same problems if non-inverting the sign of both -0 and machine zero.
+	Right way is to detect machine zero and in this case switch rounding off
+	(by opcode correction), then call addition.
+
+	When the 2nd operand is -0, and the 1st is positive, rounding should be ON.
+	To do this, inverting/noninverting the sign is unsufficient. When to decide
+	round or not, it should be known: ADD or SUB is calculating now.
+
+	So, LOY introduced forced rounding as a feature of new_addition_v44,
+	and set it as "1" on conditions listed above.
+
+	This -0 subtraction didn't covered by General Arithmetic Test 6 of 1963,
+	but tested in test_02_w.simh and also seperetely by LOY.*/
+
+
+	if (is_norm_zero(y)) {
+		//bit5 = 1 in opcode means round OFF
+		if (arithmetic_op_debug) fprintf(stderr,"sub02a: NORMZERO DETECTED, opcode=%o, ",op_code);
+		op_code |= 0b10000;
+		if (arithmetic_op_debug) fprintf(stderr,"modified opcode=%o \n",op_code);
+	}
+	// "-0" processing
+	if ( !((y & SIGN) == 0) && ((y & MANTISSA) == 0) && ((y & EXPONENT) == 0)) {
+	    if ( ((x & SIGN) == 0) && !(is_norm_zero(x))) force_round = 1;
+	    if (arithmetic_op_debug) fprintf(stderr,"sub02b: MINUSZERO DETECTED, force_round=%d \n",force_round);
+	}
+
+
+	y ^= SIGN;
+	if (arithmetic_op_debug) fprintf(stderr,"sub03: y_after_inversion=%15llo \n",y);
+
+	return new_addition_v44 (result, x, y, op_code >> 4 & 1, op_code >> 5 & 1, force_round);
+}
+
+
 
 
 
@@ -1472,6 +2456,87 @@ t_stat  new_arithmetic_op( t_value * result, t_value x, t_value y, int op_code )
 
 
 
+/*
+ *  NEW_ARITH_VERIFY: word-level and bit-serial digits differ.
+ *  No free stop codes left below SCPE_BASE, so stop as assertion.
+ */
+static t_stat arith_verify_stop (const char *name, int op_code, t_value x, t_value y)
+{
+    fprintf( stderr, "%s: fast and serial results differ: op=%02o, x=%015llo, y=%015llo\n",
+             name, op_code, x, y );
+    return STOP_ASSERT;
+}
+
+
+/*
+ *  Digits of square root, bit by bit as in hardware.
+ *  xin is 37-bit mantissa (shifted left if exponent is even).
+ */
+static t_value serial_sqrt_digits (t_value xin)
+{
+    int i;
+    t_value t, us, qs, qqs, n;
+
+    n = 0;
+    us = ((t_value)1 << BITS_36);
+    us >>= 1;
+    qs = 0 - xin;
+    qqs = 0;
+
+    if (arithmetic_op_debug) fprintf( stderr, "INIT: us=%015llo qs=%015llo\n", us, qs );
+
+    for( i=1; i<37; i++ ) {
+       qqs = qs + us + (n << 1);
+       if (qqs & SIGN) {
+           qs = (qqs << 1);
+           n = n + us;
+       }
+       else {
+          t = qqs - n - n - us;
+          qs = (t << 1);
+          n = n;
+       }
+       us >>= 1;
+       if (arithmetic_op_debug) fprintf( stderr, "LOOP: us=%015llo qs=%015llo qqs=%015llo, n=%015llo\n", us, qs, qqs, n );
+    }
+
+    if (arithmetic_op_debug) fprintf( stderr, "DONE: us=%015llo qs=%015llo qqs=%015llo, n=%015llo\n", us, qs, qqs, n );
+
+    return n;
+}
+
+
+/*
+ *  The same digits at once. The loop accepts a digit while
+ *  (n+us)^2 < xin*2^35, so result is the greatest such n.
+ */
+static int sqrt_digits_below (t_value n, t_value xin)
+{
+    t_value nh, nl, cross, hi, lo;
+
+    /* 72-bit n*n as hi:lo, 36 bits in lo */
+    nh = n >> 18;
+    nl = n & 0777777;
+    cross = 2 * nh * nl;
+    lo = nl * nl + ((cross & 0777777) << 18);
+    hi = nh * nh + (cross >> 18) + (lo >> BITS_36);
+    lo &= MANTISSA;
+
+    return hi < (xin >> 1) || (hi == (xin >> 1) && lo < ((xin & 1) << 35));
+}
+
+static t_value fast_sqrt_digits (t_value xin)
+{
+    t_value n;
+
+    n = (t_value) sqrt (ldexp ((double) xin, 35));
+    while (n > 0 && !sqrt_digits_below (n, xin)) n--;
+    while (sqrt_digits_below (n + 1, xin)) n++;
+
+    return n;
+}
+
+
 /*
  *  Square root arithmetic operation implementation.
  *  According to this book: Shura-Bura,Starkman pp. 86-89
@@ -1479,8 +2544,8 @@ t_stat  new_arithmetic_op( t_value * result, t_value x, t_value y, int op_code )
  */
 t_stat new_arithmetic_square_root (t_value *result, t_value x, int op_code)
 {
-    int beta_round, p, rr, do_shift_right_one, i;
-    t_value m, t, us, qs, qqs, n, zero, x1, zz;
+    int beta_round, p, rr, do_shift_right_one;
+    t_value m, t, n, x1, xin, zz;
 
     if (arithmetic_op_debug) fprintf( stderr, "NEW_SQRT: op_type=%d x=%015llo\n", op_code, x );
 
@@ -1520,36 +2585,13 @@ t_stat new_arithmetic_square_root (t_value *result, t_value x, int op_code)
         if (arithmetic_op_debug) fprintf( stderr, "ZERO: t=%015llo\n\n", t );
         return SCPE_OK;
     }
-    zero = 0;
-    n = 0;
-    us = ((t_value)1 << BITS_36);
-    us >>= 1;
-    qs = 0;
-    if (do_shift_right_one) {
-      qs = 0 - x1;
-    }
-    else {
-      qs = 0 - (x1 + x1);
-    }
-
-    if (arithmetic_op_debug) fprintf( stderr, "INIT: us=%015llo qs=%015llo\n", us, qs );
-
-    for( i=1; i<37; i++ ) {
-       qqs = qs + us + (n << 1);
-       if (qqs & SIGN) {
-           qs = (qqs << 1);
-           n = n + us;
-       }
-       else {
-          t = qqs - n - n - us;
-          qs = (t << 1);
-          n = n;
-       }
-       us >>= 1;
-       if (arithmetic_op_debug) fprintf( stderr, "LOOP: us=%015llo qs=%015llo qqs=%015llo, n=%015llo\n", us, qs, qqs, n );
+    xin = do_shift_right_one ? x1 : x1 + x1;
+    if (arithmetic_op_debug || new_arith_verify) {
+        n = serial_sqrt_digits (xin);
+        if (new_arith_verify && n != fast_sqrt_digits (xin))
+            return arith_verify_stop ("NEW_SQRT", op_code, x, 0);
     }
-
-    if (arithmetic_op_debug) fprintf( stderr, "DONE: us=%015llo qs=%015llo qqs=%015llo, n=%015llo\n", us, qs, qqs, n );
+    else n = fast_sqrt_digits (xin);
 
     zz = n;
     if (arithmetic_op_debug) fprintf( stderr, "READY: zz=%015llo rr=%d\n", zz, rr );
@@ -1584,52 +2626,19 @@ t_stat new_arithmetic_square_root (t_value *result, t_value x, int op_code)
 
 
 /*
- *  Multiply arithmetic operation implementation.
- *  According to this book: Shura-Bura,Starkman pp. 77-82
- *  (russian edition, 1962)
- *  For more straightforward description of the algorithm refer to:
- *  M.A.Kartsev. Arifmetika cifrovykh mashin. Moscow, 1969. Ch. 4.2.2.
- *  p.364.
+ *  Sum of partial products, two digits of multiplier per step
+ *  as in hardware. rr_hi:rr_lo holds initial rounding on entry.
  */
-t_stat new_arithmetic_mult_op (t_value *result, t_value x, t_value y, int op_code)
+static void serial_mult_product (t_value x1, t_value y1, t_int64 *rr_hi_p, t_value *rr_lo_p)
 {
-    int beta_round, beta_norm, rr, sign_zz, p, q, sign_x, sign_y, i, sign_sigma_r, delta_r, delta_r_ind; //rc присвоил delta_r int, чтобы не сбивался вывод
-    t_value t, x1, y1, rr_lo, rr_lo_tmp;
+    int i, sign_sigma_r, delta_r, delta_r_ind; //rc присвоил delta_r int, чтобы не сбивался вывод
+    t_value t, rr_lo, rr_lo_tmp;
 	t_int64 rr_hi;	//rc для того, чтобы сдвиг был арифметический
 	const t_value mask = 3;
     int delta_arr[4];
 
-   if (result == NULL) return STOP_INVARG;
-
-   if (arithmetic_op_debug) fprintf( stderr, "NEW MULT: op=%02o, x=%015llo, y=%015llo\n", op_code, x, y );
-
-   beta_round = (op_code >> 4 & 1);
-   beta_norm = (op_code >> 5 & 1);
-
-   sign_x = get_number_sign(x);
-   sign_y = get_number_sign(y);
-
-   if (arithmetic_op_debug)
-       fprintf( stderr, "round=%d norm=%d sign_x=%d sign_y=%d\n", beta_round, beta_norm, sign_x, sign_y );
-
-   p = (x & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
-   q = (y & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
-
-   x1 = (x & MANTISSA);
-   y1 = (y & MANTISSA);
-
-   if (arithmetic_op_debug) fprintf( stderr, "p=%d, q=%d, x1=%015llo, y1=%015llo\n", p, q, x1, y1 );
-
-   /* Step 1. Preliminary production */
-
-   sign_zz = sign_x * sign_y;
-   rr = p + q - M20_MANTISSA_SHIFT;
-
-   rr_lo = 0;
-   rr_hi = (!beta_round)*0200000000000LL; //1-я стадия округления
-   /*Как объясняется в техописании, после 18 сдвигов эта единица 35-го разряда, складываясь
-   в процессе умножения с суммой частичных произведений, попадает в 35-й разряд младшего регистра,
-   что эквивалентно прибавлению 1 к нему. */
+   rr_hi = *rr_hi_p;
+   rr_lo = *rr_lo_p;
 
    /*массив весов, назначаемых очередной паре разрядов множителя */
    delta_arr[0]=0;
@@ -1637,10 +2646,6 @@ t_stat new_arithmetic_mult_op (t_value *result, t_value x, t_value y, int op_cod
    delta_arr[2]=2;
    delta_arr[3]=-1;
 
-   if (arithmetic_op_debug)
-     fprintf( stderr, "rr=%d sign_zz=%d rr_hi=%015llo \n",
-                       rr, sign_zz, rr_hi );
-
    for( i=1; i<20; i++ ) {
        sign_sigma_r = get_number_sign(rr_hi);
 	   delta_r_ind=(int)(x1&mask);
@@ -1680,6 +2685,92 @@ t_stat new_arithmetic_mult_op (t_value *result, t_value x, t_value y, int op_cod
 	   x1 >>= 2;
    }
 
+
+   *rr_hi_p = rr_hi;
+   *rr_lo_p = rr_lo;
+}
+
+
+/*
+ *  The same sum at once: rr_hi:rr_lo = x1*y1 + rounding, 36 bits in rr_lo.
+ *  The loop takes the carry after "11" digits from the sign of rr_hi,
+ *  which is exact only while rr_hi is less than y1 on entry,
+ *  so small y1 with rounding is left to the loop (returns 0).
+ */
+static int fast_mult_product (t_value x1, t_value y1, int beta_round, t_int64 *rr_hi, t_value *rr_lo)
+{
+    t_value hi, lo;
+
+    if (!beta_round && y1 <= 0200000000000LL) return 0;
+
+    /* 72-bit product from two 54-bit ones */
+    hi = (x1 >> 18) * y1;
+    lo = (x1 & 0777777) * y1 + ((hi & 0777777) << 18) + (!beta_round)*0200000000000LL;
+    *rr_hi = (t_int64) ((hi >> 18) + (lo >> BITS_36));
+    *rr_lo = lo & MANTISSA;
+
+    return 1;
+}
+
+
+/*
+ *  Multiply arithmetic operation implementation.
+ *  According to this book: Shura-Bura,Starkman pp. 77-82
+ *  (russian edition, 1962)
+ *  For more straightforward description of the algorithm refer to:
+ *  M.A.Kartsev. Arifmetika cifrovykh mashin. Moscow, 1969. Ch. 4.2.2.
+ *  p.364.
+ */
+t_stat new_arithmetic_mult_op (t_value *result, t_value x, t_value y, int op_code)
+{
+    int beta_round, beta_norm, rr, sign_zz, p, q, sign_x, sign_y;
+    t_value t, x1, y1, rr_lo, f_lo;
+	t_int64 rr_hi, f_hi;	//rc для того, чтобы сдвиг был арифметический
+
+   if (result == NULL) return STOP_INVARG;
+
+   if (arithmetic_op_debug) fprintf( stderr, "NEW MULT: op=%02o, x=%015llo, y=%015llo\n", op_code, x, y );
+
+   beta_round = (op_code >> 4 & 1);
+   beta_norm = (op_code >> 5 & 1);
+
+   sign_x = get_number_sign(x);
+   sign_y = get_number_sign(y);
+
+   if (arithmetic_op_debug)
+       fprintf( stderr, "round=%d norm=%d sign_x=%d sign_y=%d\n", beta_round, beta_norm, sign_x, sign_y );
+
+   p = (x & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
+   q = (y & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
+
+   x1 = (x & MANTISSA);
+   y1 = (y & MANTISSA);
+
+   if (arithmetic_op_debug) fprintf( stderr, "p=%d, q=%d, x1=%015llo, y1=%015llo\n", p, q, x1, y1 );
+
+   /* Step 1. Preliminary production */
+
+   sign_zz = sign_x * sign_y;
+   rr = p + q - M20_MANTISSA_SHIFT;
+
+   rr_lo = 0;
+   rr_hi = (!beta_round)*0200000000000LL; //1-я стадия округления
+   /*Как объясняется в техописании, после 18 сдвигов эта единица 35-го разряда, складываясь
+   в процессе умножения с суммой частичных произведений, попадает в 35-й разряд младшего регистра,
+   что эквивалентно прибавлению 1 к нему. */
+
+   if (arithmetic_op_debug)
+     fprintf( stderr, "rr=%d sign_zz=%d rr_hi=%015llo \n",
+                       rr, sign_zz, rr_hi );
+
+   if (arithmetic_op_debug || new_arith_verify ||
+       !fast_mult_product (x1, y1, beta_round, &rr_hi, &rr_lo)) {
+       serial_mult_product (x1, y1, &rr_hi, &rr_lo);
+       if (new_arith_verify && fast_mult_product (x1, y1, beta_round, &f_hi, &f_lo) &&
+           (f_hi != rr_hi || f_lo != rr_lo))
+           return arith_verify_stop ("NEW MULT", op_code, x, y);
+   }
+
    /* Step 2. Produce final result */
 
       if (arithmetic_op_debug) fprintf( stderr, "rr=%d rr_lo=%015llo rr_hi=%015llo\n", rr, rr_lo, rr_hi );
@@ -1762,41 +2853,94 @@ t_stat new_arithmetic_mult_op (t_value *result, t_value x, t_value y, int op_cod
 
 
 /*
- *  Division arithmetic operation implementation.
- *  This is non-restoring division.
- *  According to this books:
- *  1) Shura-Bura, Starkman (russian edition, 1962), pp. 82-86.
- *  2) Kartsev, Arifmetika cifrovykn mashin (rus. 1969), p.499, 504-505.
- *  3) Lebedev, Melnikov, General descript. of BESM, vol.1 (rus. 1959),
- *     p.150-151.
- *  4) https://en.wikipedia.org/wiki/Division_algorithm#Non-restoring_division
- *  Note that Shura-Bura book contains an error on p.85:
- *  we need 38 digits, not 37 (see comment below).
- *
+ *  Quotient digits, one per pass as in hardware (x1 < 2*y1).
  */
-t_stat new_arithmetic_div_op (t_value *result, t_value x, t_value y, int op_code)
+static t_value serial_div_digits (t_value x1, t_value y1)
 {
-    int beta_round, rr, sign_zz, p, q, sign_x, sign_y, i, ak;
-    t_value t, x1, y1, zz, qk;
-
-   if (result == NULL) return STOP_INVARG;
-
-   if (arithmetic_op_debug) fprintf( stderr, "NEW DIV: op=%02o, x=%015llo, y=%015llo\n", op_code, x, y );
-
-   beta_round = (op_code >> 4 & 1);
-
-   sign_x = get_number_sign(x);
-   sign_y = get_number_sign(y);
+    int i, ak;
+    t_value zz, qk;
 
-   if (arithmetic_op_debug) fprintf( stderr, "div01: no_round=%d sign_x=%d sign_y=%d\n", beta_round, sign_x, sign_y );
+   zz = 0;
+   qk = x1;
 
-   p = (x & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
-   q = (y & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
+   for( i=1; i<40; i++ ) {
 
-   x1 = (x & MANTISSA);
-   y1 = (y & MANTISSA);
+	  /* look at the sign of new remainder */
+      ak = (qk & SIGN ? -1 : 1 );
 
-   if (arithmetic_op_debug) fprintf( stderr, "div02: p=%d, q=%d, x1=%015llo, y1=%015llo\n", p, q, x1, y1 );
+	  /* add/subtract divisor, depending of sign of the remainder */
+      qk -= ak*y1;
+      if (arithmetic_op_debug) fprintf( stderr, "div04: i=%d: qk=%015llo\n", i, qk );
+
+	  /* generate quotient digit */
+	  zz <<= 1;
+      zz += ak;
+	  if (arithmetic_op_debug) fprintf( stderr, "div05: i=%d: ak=%d qk=%015llo zz=%015llo\n",
+                                                    i, ak, qk, zz );
+	  /*double the remainder */
+	  qk<<=1;
+	  if (arithmetic_op_debug) fprintf( stderr, "div06: i=%d: qk=%015llo \n",
+                                                 i, qk );
+   }
+   /*get rid of last wrong digit*/
+   zz>>= 1;
+
+   return zz;
+}
+
+
+/*
+ *  The same digits at once. After n passes the non-restoring loop
+ *  holds floor(x1*2^(n-1)/y1) with the last digit forced to 1,
+ *  the dropped digit leaves floor(x1*2^37/y1).
+ */
+static t_value fast_div_digits (t_value x1, t_value y1)
+{
+    t_value q, r;
+
+    q = (x1 << 27) / y1;
+    r = (x1 << 27) % y1;
+
+    return (q << 10) + (r << 10) / y1;
+}
+
+
+/*
+ *  Division arithmetic operation implementation.
+ *  This is non-restoring division.
+ *  According to this books:
+ *  1) Shura-Bura, Starkman (russian edition, 1962), pp. 82-86.
+ *  2) Kartsev, Arifmetika cifrovykn mashin (rus. 1969), p.499, 504-505.
+ *  3) Lebedev, Melnikov, General descript. of BESM, vol.1 (rus. 1959),
+ *     p.150-151.
+ *  4) https://en.wikipedia.org/wiki/Division_algorithm#Non-restoring_division
+ *  Note that Shura-Bura book contains an error on p.85:
+ *  we need 38 digits, not 37 (see comment below).
+ *
+ */
+t_stat new_arithmetic_div_op (t_value *result, t_value x, t_value y, int op_code)
+{
+    int beta_round, rr, sign_zz, p, q, sign_x, sign_y;
+    t_value t, x1, y1, zz;
+
+   if (result == NULL) return STOP_INVARG;
+
+   if (arithmetic_op_debug) fprintf( stderr, "NEW DIV: op=%02o, x=%015llo, y=%015llo\n", op_code, x, y );
+
+   beta_round = (op_code >> 4 & 1);
+
+   sign_x = get_number_sign(x);
+   sign_y = get_number_sign(y);
+
+   if (arithmetic_op_debug) fprintf( stderr, "div01: no_round=%d sign_x=%d sign_y=%d\n", beta_round, sign_x, sign_y );
+
+   p = (x & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
+   q = (y & (EXPONENT|EXPONENT_SIGN)) >> BITS_36;
+
+   x1 = (x & MANTISSA);
+   y1 = (y & MANTISSA);
+
+   if (arithmetic_op_debug) fprintf( stderr, "div02: p=%d, q=%d, x1=%015llo, y1=%015llo\n", p, q, x1, y1 );
 
    if (x1 >= 2*y1)
        /* mantissa overflow on division */
@@ -1807,8 +2951,6 @@ t_stat new_arithmetic_div_op (t_value *result, t_value x, t_value y, int op_code
        return STOP_DIVZERO;
 
    /* Step 1. Preliminary quotient */
-   zz = 0;
-   qk = x1;
 
    sign_zz = sign_x * sign_y;
    rr = p - q + M20_MANTISSA_SHIFT;
@@ -1826,27 +2968,12 @@ t_stat new_arithmetic_div_op (t_value *result, t_value x, t_value y, int op_code
    But during 39th pass the last useful 38th digit may be
    corrected (10-1=01). We can't get rid of
    39th pass, but must get rid of last digit.*/
-   for( i=1; i<40; i++ ) {
-
-	  /* look at the sign of new remainder */
-      ak = (qk & SIGN ? -1 : 1 );
-
-	  /* add/subtract divisor, depending of sign of the remainder */
-      qk -= ak*y1;
-      if (arithmetic_op_debug) fprintf( stderr, "div04: i=%d: qk=%015llo\n", i, qk );
-
-	  /* generate quotient digit */
-	  zz <<= 1;
-      zz += ak;
-	  if (arithmetic_op_debug) fprintf( stderr, "div05: i=%d: ak=%d qk=%015llo zz=%015llo\n",
-                                                    i, ak, qk, zz );
-	  /*double the remainder */
-	  qk<<=1;
-	  if (arithmetic_op_debug) fprintf( stderr, "div06: i=%d: qk=%015llo \n",
-                                                 i, qk );
+   if (arithmetic_op_debug || new_arith_verify) {
+       zz = serial_div_digits (x1, y1);
+       if (new_arith_verify && zz != fast_div_digits (x1, y1))
+           return arith_verify_stop ("NEW DIV", op_code, x, y);
    }
-   /*get rid of last wrong digit*/
-   zz>>= 1;
+   else zz = fast_div_digits (x1, y1);
    if (arithmetic_op_debug) fprintf( stderr, "div07: rr=%d zz=%015llo \n", rr, zz );
 
    /* Step 2. Produce final result */
@@ -2033,6 +3160,7 @@ t_stat ext_io_operation (int a1, t_value * sum)
 	/* Барабан (МБ) */
         codes_num = 0;
 	err = drum_io (sum,&codes_num);
+	if (!err) err = m20_aio_check ();	/* write behind failed by now */
         if (sim_deb && cpu_dev.dctrl)
 	    fprintf (sim_deb, "cpu: err=%d, codes_num=%04o sum=%015llo\n", err,codes_num,*sum);
         delay += (40000+((double)codes_num)/6400);
@@ -2045,6 +3173,7 @@ t_stat ext_io_operation (int a1, t_value * sum)
 	/* Магнитная лента (МЛ) */
         codes_num = 0;
 	err = mt_tape_io (sum,&codes_num);
+	if (!err) err = m20_aio_check ();
         if (sim_deb && cpu_dev.dctrl)
 	    fprintf (sim_deb, "cpu: err=%d, codes_num=%04o sum=%015llo\n", err,codes_num,*sum);
 	delay += (75000+((double)codes_num/2500));
@@ -2093,922 +3222,2335 @@ t_value combine_addreses_to_single_word(int a1, int a2, int a3){
 }
 
 /*
- * Execute one instruction, contained in register RK.
+ * Test for memory contents overflow (bits above 45) in instruction operands.
+ * Operands are peeked: the test is not an access of program, watchpoints stay quiet.
  */
-t_stat cpu_one_inst ()
+static M20_INLINE t_stat memory_45_check (int a1, int a2, int a3, const char * when)
 {
-	int addr_tags, op, a1, a2, a3, n = 0, force_round = 0;
-	t_value x, y, t;
-	t_stat err;
-	//unsigned __int64 t1;
-
-	addr_tags = regRK >> BITS_42 & MAX_ADDR_TAG_VALUE;
-	op = regRK >> BITS_36 & MAX_OPCODE_VALUE;
-	a1 = regRK >> BITS_24 & MAX_ADDR_VALUE;
-	a2 = regRK >> BITS_12 & MAX_ADDR_VALUE;
-	a3 = regRK >> BITS_0  & MAX_ADDR_VALUE;
-
-	/* Есля установлен соответствующий бит признака,
-	 * к адресу добавляется значение регистра адреса. */
-	if (addr_tags & 4) a1 = (a1 + regRA) & MAX_ADDR_VALUE;
-	if (addr_tags & 2) a2 = (a2 + regRA) & MAX_ADDR_VALUE;
-	if (addr_tags & 1) a3 = (a3 + regRA) & MAX_ADDR_VALUE;
-
-
-	/* test for memory contents overflow */
-        if (memory_45_checking) {
-	  t = mosu_load(a1);
-	  if (t & ~WORD45) {
-            if (sim_deb && cpu_dev.dctrl)
-	      fprintf (sim_deb, "cpu: OVERFLOW BEFORE: a1: t[%04o]=%018llo, t=%018llo\n", a1, t, t & ~WORD45 );
-            return STOP_MEMORY_GARBAGE_DETECTED;
-          }
-	  t = mosu_load(a2);
-	  if (t & ~WORD45) {
-            if (sim_deb && cpu_dev.dctrl)
-	      fprintf (sim_deb, "cpu: OVERFLOW BEFORE: a2: t[%04o]=%018llo, t=%018llo\n", a2, t, t & ~WORD45  );
-            return STOP_MEMORY_GARBAGE_DETECTED;
-          }
-	  t = mosu_load(a3);
-	  if (t & ~WORD45) {
-            if (sim_deb && cpu_dev.dctrl)
-	      fprintf (sim_deb, "cpu: OVERFLOW BEFORE: a3: t[%04o]=%018llo, t=%018llo\n", a3, t, t & ~WORD45  );
-            return STOP_MEMORY_GARBAGE_DETECTED;
-          }
-        }
-
-	switch (op) {
-	default:
-	        delay += 24.0;
-		return STOP_BADCMD;
-
-	/*
-         *   Numbers Operations
-         *   (операции над числами)
-         */
-
-	case OPCODE_ADD_ROUND_NORM:         /* 001 = сложение с округлением и нормализацией */
-	case OPCODE_ADD_NORM:               /* 021 = сложение без округления с нормализацией */
-	case OPCODE_ADD_ROUND:              /* 041 = сложение с округлением без нормализации */
-	case OPCODE_ADD:                    /* 061 = сложение без округления и без нормализации */
-add:	x = mosu_load (a1);
-		y = mosu_load (a2);
-		if (new_add) {
-          err = new_arithmetic_op( &regRR, x, y, op );
-		  goto add_final;
-		}
-add_v44:
-        err = new_addition_v44 (&regRR, x, y, op >> 4 & 1, op >> 5 & 1, force_round);
-
-add_final:
-		if (err) return err;
-		mosu_store (a3, regRR);
-		trgSW = (regRR & SIGN) != 0;
-		delay += 28.5;
-		break;
-
-
-	case OPCODE_SUB_ROUND_NORM:         /* 002 = вычитание с округлением и нормализацией */
-	case OPCODE_SUB_NORM:               /* 022 = вычитание без округления с нормализацией */
-	case OPCODE_SUB_ROUND:              /* 042 = вычитание с округлением без нормализации */
-	case OPCODE_SUB:                    /* 062 = вычитание без округления и без нормализации */
-        if (new_add) goto add;
-
-		x = mosu_load (a1);
-        y = mosu_load (a2);
-		if (arithmetic_op_debug) fprintf(stderr,"sub01: y=%15llo \n",y);
-
-		/* When one of operands is machine zero, rounding should not be performed.
-		But if we take machine zero as 2nd operand, invert the sign and call addition,
-		it already will not be machine zero and can be rounded. Opposite case also may occur,
-		when the 2nd operand is -0 and will not be rounded after sign inversion (as machine zero).
-
-		Non-inverting the sign of machine zero and then call addition is wrong decision,
-		because in this case rounding logic (based on signs) may became broken for -0.
-		Same problems if non-inverting the sign of both -0 and machine zero.
-		Right way is to detect machine zero and in this case switch rounding off
-		(by opcode correction), then call addition.
+	t_value t;
+
+	/* no garbage in memory: only registers mapped in MOSU mode II may have it */
+	if ((mosu_garbage_count == 0) &&
+	    ((mosu_mode != MOSU_MODE_II) || ((a1 < 07770) && (a2 < 07770) && (a3 < 07770))))
+	  return SCPE_OK;
+
+	t = mosu_peek(a1 & MAX_ADDR_VALUE);
+	if (t & ~WORD45) {
+	  if (sim_deb && cpu_dev.dctrl)
+	    fprintf (sim_deb, "cpu: OVERFLOW %s: a1: t[%04o]=%018llo, t=%018llo\n", when, a1, t, t & ~WORD45 );
+	  return STOP_MEMORY_GARBAGE_DETECTED;
+	}
+	t = mosu_peek(a2 & MAX_ADDR_VALUE);
+	if (t & ~WORD45) {
+	  if (sim_deb && cpu_dev.dctrl)
+	    fprintf (sim_deb, "cpu: OVERFLOW %s: a2: t[%04o]=%018llo, t=%018llo\n", when, a2, t, t & ~WORD45  );
+	  return STOP_MEMORY_GARBAGE_DETECTED;
+	}
+	t = mosu_peek(a3 & MAX_ADDR_VALUE);
+	if (t & ~WORD45) {
+	  if (sim_deb && cpu_dev.dctrl)
+	    fprintf (sim_deb, "cpu: OVERFLOW %s: a3: t[%04o]=%018llo, t=%018llo\n", when, a3, t, t & ~WORD45  );
+	  return STOP_MEMORY_GARBAGE_DETECTED;
+	}
+	return SCPE_OK;
+}
 
-		When the 2nd operand is -0, and the 1st is positive, rounding should be ON.
-		To do this, inverting/noninverting the sign is unsufficient. When to decide
-		round or not, it should be known: ADD or SUB is calculating now.
 
-		So, LOY introduced forced rounding as a feature of new_addition_v44,
-		and set it as "1" on conditions listed above.
+/*
+ *   Instruction handlers.
+ *   One handler per opcode group, operands are effective (RA-modified) addresses.
+ *   Handlers are shared by the switch interpreter and the threaded engine.
+ */
 
-		This -0 subtraction didn't covered by General Arithmetic Test 6 of 1963,
-		but tested in test_02_w.simh and also seperetely by LOY.*/
+static t_stat op_bad (int op, int a1, int a2, int a3)
+{
+	delay += 24.0;
+	return STOP_BADCMD;
+}
 
 
-		if (is_norm_zero(y)) {
-			//bit5 = 1 in opcode means round OFF
-			if (arithmetic_op_debug) fprintf(stderr,"sub02a: NORMZERO DETECTED, opcode=%o, ",op);
-			op |= 0b10000;
-			if (arithmetic_op_debug) fprintf(stderr,"modified opcode=%o \n",op);
-		}
-		// "-0" processing
-		if ( !((y & SIGN) == 0) && ((y & MANTISSA) == 0) && ((y & EXPONENT) == 0)) {
-		    if ( ((x & SIGN) == 0) && !(is_norm_zero(x))) force_round = 1;
-		    if (arithmetic_op_debug) fprintf(stderr,"sub02b: MINUSZERO DETECTED, force_round=%d \n",force_round);
-		}
+/*
+ *   Numbers Operations
+ *   (операции над числами)
+ */
 
+static t_stat op_add_final (t_stat err, int a3)
+{
+	if (err) return err;
+	mosu_store (a3, regRR);
+	trgSW = (regRR & SIGN) != 0;
+	delay += 28.5;
+	return SCPE_OK;
+}
 
-		y ^= SIGN;
-		if (arithmetic_op_debug) fprintf(stderr,"sub03: y_after_inversion=%15llo \n",y);
+/* 001 = сложение с округлением и нормализацией */
+/* 021 = сложение без округления с нормализацией */
+/* 041 = сложение с округлением без нормализации */
+/* 061 = сложение без округления и без нормализации */
+static t_stat op_add (int op, int a1, int a2, int a3)
+{
+	t_value x, y;
+	t_stat err;
 
-		goto add_v44;
+	x = mosu_load (a1);
+	y = mosu_load (a2);
+	if (new_add) err = new_arithmetic_op( &regRR, x, y, op );
+	else err = addition_v44_op (&regRR, x, y, op);
+	return op_add_final (err, a3);
+}
 
+/* 002 = вычитание с округлением и нормализацией */
+/* 022 = вычитание без округления с нормализацией */
+/* 042 = вычитание с округлением без нормализации */
+/* 062 = вычитание без округления и без нормализации */
+static t_stat op_sub (int op, int a1, int a2, int a3)
+{
+	return op_add (op, a1, a2, a3);
+}
 
-	case OPCODE_SUB_MOD_ROUND_NORM:     /* 003 = вычитание модулей с округлением и нормализацией */
-	case OPCODE_SUB_MOD_NORM:           /* 023 = вычитание модулей без округления с нормализацией */
-	case OPCODE_SUB_MOD_ROUND:          /* 043 = вычитание модулей с округлением без нормализации */
-	case OPCODE_SUB_MOD:                /* 063 = вычитание модулей без округления и без нормализации */
-	    {
-        if (new_add) goto add;
+/* 003 = вычитание модулей с округлением и нормализацией */
+/* 023 = вычитание модулей без округления с нормализацией */
+/* 043 = вычитание модулей с округлением без нормализации */
+/* 063 = вычитание модулей без округления и без нормализации */
+static t_stat op_sub_mod (int op, int a1, int a2, int a3)
+{
+	return op_add (op, a1, a2, a3);
+}
 
-        int no_norm = 1;
-        if ((op==003) || (op==023)) no_norm=0;
+/* 005 = умножение с округлением и нормализацией */
+/* 025 = умножение без округления с нормализацией */
+/* 045 = умножение с округлением без нормализации */
+/* 065 = умножение без округления и без нормализации */
+static t_stat op_mult (int op, int a1, int a2, int a3)
+{
+	t_value x, y;
+	t_stat err;
 
-		x = mosu_load (a1) & ~SIGN;
-		y = mosu_load (a2) | SIGN;
-        err = new_addition_v44 (&regRR, x, y, 1, no_norm, force_round);
-		goto add_final;
-	     }
+	x = mosu_load (a1);
+	y = mosu_load (a2);
+	if (new_mult) err = new_arithmetic_mult_op (&regRR, x, y, op);
+	else err = multiplication (&regRR, x, y, op >> 4 & 1, op >> 5 & 1);
+	if (err) return err;
+	mosu_store (a3, regRR);
+	trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
+	delay += 69.5;
+	return SCPE_OK;
+}
 
-	case OPCODE_MULT_ROUND_NORM:        /* 005 = умножение с округлением и нормализацией */
-	case OPCODE_MULT_NORM:              /* 025 = умножение без округления с нормализацией */
-	case OPCODE_MULT_ROUND:             /* 045 = умножение с округлением без нормализации */
-	case OPCODE_MULT:                   /* 065 = умножение без округления и без нормализации */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-                if (new_mult) err = new_arithmetic_mult_op (&regRR, x, y, op);
-                else err = multiplication (&regRR, x, y, op >> 4 & 1, op >> 5 & 1);
-		if (err) return err;
-		mosu_store (a3, regRR);
-		trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
-		delay += 69.5;
-		break;
+/* 004 = деление с округлением */
+/* 024 = деление без округления */
+static t_stat op_div (int op, int a1, int a2, int a3)
+{
+	t_value x, y;
+	t_stat err;
 
+	x = mosu_load (a1);
+	y = mosu_load (a2);
+	if (new_div) err = new_arithmetic_div_op (&regRR, x, y, op);
+	else err = division (&regRR, x, y, op >> 4 & 1);
+	if (err) return err;
+	mosu_store (a3, regRR);
+	trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
+	delay += 136.5;
+	return SCPE_OK;
+}
 
-	case OPCODE_DIV_ROUND_NORM:         /* 004 = деление с округлением */
-	case OPCODE_DIV_NORM:               /* 024 = деление без округления */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-                if (new_div) err = new_arithmetic_div_op (&regRR, x, y, op);
-                else err = division (&regRR, x, y, op >> 4 & 1);
-		if (err) return err;
-		mosu_store (a3, regRR);
-		trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
-		delay += 136.5;
-		break;
+/* 044 = извлечение корня с округлением */
+/* 064 = извлечение корня без округления */
+static t_stat op_sqrt (int op, int a1, int a2, int a3)
+{
+	t_value x;
+	t_stat err;
 
+	x = mosu_load (a1);
+	if (new_sqrt) err = new_arithmetic_square_root (&regRR, x, op);
+	else err = square_root (&regRR, x, op >> 4 & 1);
+	if (err) return err;
+	mosu_store (a3, regRR);
+	trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
+	delay += 275.0;
+	return SCPE_OK;
+}
 
-	case OPCODE_SQRT_ROUND_NORM:        /* 044 = извлечение корня с округлением */
-	case OPCODE_SQRT_NORM:              /* 064 = извлечение корня без округления */
-		x = mosu_load (a1);
-                if (new_sqrt) err = new_arithmetic_square_root (&regRR, x, op);
-                else err = square_root (&regRR, x, op >> 4 & 1);
-		if (err) return err;
-		mosu_store (a3, regRR);
+/* 047 = выдача младших разрядов произведения */
+/* Use only after op 025 or 065, but in real all otherwise */
+static t_stat op_mult_low (int op, int a1, int a2, int a3)
+{
+	switch( old_opcode ) {
+	    case OPCODE_MULT_ROUND_NORM:        /* 005 = умножение с округлением и нормализацией */
+	    case OPCODE_MULT_NORM:              /* 025 = умножение без округления с нормализацией */
+	    case OPCODE_MULT_ROUND:             /* 045 = умножение с округлением без нормализации */
+	    case OPCODE_MULT:                   /* 065 = умножение без округления и без нормализации */
+		regRR = regRMR;
 		trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
-		delay += 275.0;
 		break;
-
-
-	case OPCODE_OUT_LOWER_BITS_OF_MULT: /* 047 = выдача младших разрядов произведения */
-                                            /* Use only after op 025 or 065, but in real all otherwise */
-                switch( old_opcode ) {
-	            case OPCODE_MULT_ROUND_NORM:        /* 005 = умножение с округлением и нормализацией */
-	            case OPCODE_MULT_NORM:              /* 025 = умножение без округления с нормализацией */
-	            case OPCODE_MULT_ROUND:             /* 045 = умножение с округлением без нормализации */
-	            case OPCODE_MULT:                   /* 065 = умножение без округления и без нормализации */
-		        regRR = regRMR;
-                        trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
-	                break;
-	            default:
-                        //t = regRR & EXP_SIGN_TAG;
-                        //fprintf( stderr, "regP1=%015llo\n", regP1 );
-                        t = (regRR & EXP_SIGN_TAG) | (regP1 & MANTISSA);
-                        regRR = t;
-                        trgSW = (regRR & MANTISSA) == 0;
-	                break;
-	        }
-                //trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
-		mosu_store (a3, regRR);
-		//trgSW = (regRR & MANTISSA) == 0;
-		//if (trgSW) goto sw1;
-		//if (!trgSW) trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
-             //sw1:
-		delay += 24.0;
+	    default:
+		regRR = (regRR & EXP_SIGN_TAG) | (regP1 & MANTISSA);
+		trgSW = (regRR & MANTISSA) == 0;
 		break;
+	}
+	mosu_store (a3, regRR);
+	delay += 24.0;
+	return SCPE_OK;
+}
 
+/* 006 = сложение порядка с адресом */
+/* 026 = сложение порядков чисел */
+/* 046 = вычитание адреса из порядка */
+/* 066 = вычитание порядков чисел */
+static t_stat op_add_exp (int op, int a1, int a2, int a3)
+{
+	t_value y;
+	t_stat err;
+	int n;
 
-	case OPCODE_ADD_ADDR_TO_EXP:        /* 006 = сложение порядка с адресом */
+	switch (op) {
+	case OPCODE_ADD_ADDR_TO_EXP:
 		n = (a1 & 0177) - M20_MANTISSA_SHIFT;
-		y = mosu_load (a2);
 		delay += 61.5;
-addexp:
-                err = add_exponent (&regRR, y, n, op);
-		if (err) return err;
-		mosu_store (a3, regRR);
-		trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
 		break;
-
-	case OPCODE_ADD_EXP_TO_EXP:         /* 026 = сложение порядков чисел */
+	case OPCODE_ADD_EXP_TO_EXP:
 		delay += 24.0;
-                x = mosu_load (a1);
-		n = (int) (x >> BITS_36 & 0177) - M20_MANTISSA_SHIFT;
-                y = mosu_load (a2);
-		goto addexp;
-
-	case OPCODE_SUB_ADDR_FROM_EXP:      /* 046 = вычитание адреса из порядка */
+		n = (int) (mosu_load (a1) >> BITS_36 & 0177) - M20_MANTISSA_SHIFT;
+		break;
+	case OPCODE_SUB_ADDR_FROM_EXP:
 		delay += 61.5;
 		n = M20_MANTISSA_SHIFT - (a1 & 0177);
-		y = mosu_load (a2);
-		goto addexp;
-
-	case OPCODE_SUB_EXP_FROM_EXP:       /* 066 = вычитание порядков чисел */
+		break;
+	default:        /* OPCODE_SUB_EXP_FROM_EXP */
 		delay += 24.0;
-                x = mosu_load (a1);
-		n = M20_MANTISSA_SHIFT - (int) (x >> BITS_36 & 0177);
-                y = mosu_load (a2);
-		goto addexp;
+		n = M20_MANTISSA_SHIFT - (int) (mosu_load (a1) >> BITS_36 & 0177);
+		break;
+	}
+	y = mosu_load (a2);
+	err = add_exponent (&regRR, y, n, op);
+	if (err) return err;
+	mosu_store (a3, regRR);
+	trgSW = (int) (regRR >> BITS_36 & 0177) > 0100;
+	return SCPE_OK;
+}
 
 
-	/*
-         *   Codes Operations
-         *   (операции над кодами)
-         */
+/*
+ *   Codes Operations
+ *   (операции над кодами)
+ */
 
-	case OPCODE_TRANSFER_MEM2MEM: /* 000 = пересылка */
-	    regRR = mosu_load (a1);
-	    mosu_store (a3, regRR);
-	    /* w не изменяется и нет авто-останов */
-	    delay += 24.0;
-	    break;
+/* 000 = пересылка */
+static t_stat op_move (int op, int a1, int a2, int a3)
+{
+	regRR = mosu_load (a1);
+	mosu_store (a3, regRR);
+	/* w не изменяется и нет авто-останов */
+	delay += 24.0;
+	return SCPE_OK;
+}
 
+/* 020 = чтение пультовых тумблеров */
+static t_stat op_read_panel (int op, int a1, int a2, int a3)
+{
+	switch (a1 & 7) {
+	  case 0: regRR = 0;    break;
+	  case 1: regRR = RPU1; break;
+	  case 2: regRR = RPU2; break;
+	  case 3: regRR = RPU3; break;
+	  case 4: regRR = RPU4; break;
+	  case 5: /* RR */   break;
+	  default:
+	    return STOP_INVARG; /* неверный аргумент команды СЧП */
+	}
+	mosu_store (a3, regRR);
+	/* w не изменяется. */
+	delay += 24.0;
+	return SCPE_OK;
+}
 
-	case OPCODE_LOAD_FROM_KEY_REGISTER:    /* 020 = чтение пультовых тумблеров */
-		switch (a1 & 7) {
-		  case 0: regRR = 0;    break;
-		  case 1: regRR = RPU1; break;
-		  case 2: regRR = RPU2; break;
-		  case 3: regRR = RPU3; break;
-		  case 4: regRR = RPU4; break;
-		  case 5: /* RR */   break;
-		  default:
-                    return STOP_INVARG; /* неверный аргумент команды СЧП */
-		}
-		mosu_store (a3, regRR);
-		/* w не изменяется. */
-		delay += 24.0;
-		break;
+/* 040 = гашение */
+static t_stat op_blank_040 (int op, int a1, int a2, int a3)
+{
+	int n;
+
+	if (enable_opcode_040_hack) {
+	  delay += 24.0;
+	  n = (mosu_load (a1) >> BITS_12) & 07777;
+	  if (regRA < n) regKRA = a2;
+	  regRA = a3;
+	  return SCPE_OK;
+	}
+	regRR = 0;
+	mosu_store( a3, regRR );
+	/* w не изменяется. */
+	delay += 24.0;
+	return SCPE_OK;
+}
 
+/* 060 = гашение */
+static t_stat op_blank_060 (int op, int a1, int a2, int a3)
+{
+	regRR = 0;
+	mosu_store( a3, regRR );
+	/* w не изменяется. */
+	delay += 24.0;
+	return SCPE_OK;
+}
 
-	case OPCODE_BLANKING_040:           /* 040 = гашение */
-#if 1
-                if (enable_opcode_040_hack) {
-		  delay += 24.0;
-                  x = mosu_load (a1);
-                  //n = (x >> 13) & 07777;
-                  n = (x >> BITS_12) & 07777;
-		  if (regRA < n) regKRA = a2;
-		  regRA = a3;
-	          break;
-	        }
-#endif
-	        regRR = 0;
-	        mosu_store( a3, regRR );
-		/* w не изменяется. */
-                delay += 24.0;
-		break;
+/* 015 = поразрядное сравнение (исключающее или) */
+/* 035 = поразрядное сравнение с остановом */
+/* 055 = логическое умножение (и) = AND */
+/* 075 = логическое сложение (или) = OR */
+static t_stat op_logical (int op, int a1, int a2, int a3)
+{
+	switch (op) {
+	case OPCODE_LOGICAL_MULT: regRR = mosu_load (a1) & mosu_load (a2); break;
+	case OPCODE_LOGICAL_ADD:  regRR = mosu_load (a1) | mosu_load (a2); break;
+	default:                  regRR = mosu_load (a1) ^ mosu_load (a2); break;
+	}
+	trgSW = (regRR == 0);
+	delay += 24.0;
+	if (op == 035 && !trgSW)  return STOP_ASSERT; /* останов по несовпадению */
+	mosu_store (a3, regRR);     /* 035 must no store result, only from engineering panel! */
+	return SCPE_OK;
+}
 
-	case OPCODE_BLANKING_060:           /* 060 = гашение */
-	        regRR = 0;
-	        mosu_store( a3, regRR );
-		/* w не изменяется. */
-		delay += 24.0;
-		break;
+/* 013 = сложение команд */
+/* 033 = вычитание команд */
+static t_stat op_add_cmds (int op, int a1, int a2, int a3)
+{
+	t_value x, y;
+
+	x = mosu_load (a1);
+	y = mosu_load (a2);
+	if (op == OPCODE_ADD_CMDS) y = (x & MANTISSA) + (y & MANTISSA);
+	else y = (x & MANTISSA) - (y & MANTISSA);
+	regRR = (x & ~MANTISSA & WORD45) | (y & MANTISSA);
+	mosu_store (a3, regRR);
+	trgSW = (y & BIT37) != 0;
+	delay += 24.0;
+	return SCPE_OK;
+}
 
+/* 053 = сложение кодов операций */
+/* 073 = вычитание кодов операций */
+static t_stat op_add_opcs (int op, int a1, int a2, int a3)
+{
+	t_value x, y;
+
+	x = mosu_load (a1);
+	y = mosu_load (a2);
+	if (op == OPCODE_ADD_OPCS) y = (x & ~MANTISSA) + (y & ~MANTISSA);
+	else y = (x & ~MANTISSA) - (y & ~MANTISSA);
+	regRR = (x & MANTISSA) | (y & ~MANTISSA & WORD45);
+	mosu_store (a3, regRR);
+	trgSW = (y & BIT46) != 0;
+	delay += 24.0;
+	return SCPE_OK;
+}
 
-	case OPCODE_COMPARE:                /* 015 = поразрядное сравнение (исключающее или) */
-	case OPCODE_COMPARE_WITH_STOP:      /* 035 = поразрядное сравнение с остановом */
-		regRR = mosu_load (a1) ^ mosu_load (a2);
-logop:
-		trgSW = (regRR == 0);
-		delay += 24.0;
-		if (op == 035 && !trgSW)  return STOP_ASSERT; /* останов по несовпадению */
-                mosu_store (a3, regRR);     /* 035 must no store result, only from engineering panel! */
-		break;
+/* 014 = сдвиг мантиссы по адресу */
+/* 034 = сдвиг мантиссы по порядку числа */
+static t_stat op_shift_mantissa (int op, int a1, int a2, int a3)
+{
+	t_value y;
+	int n;
 
-	case OPCODE_LOGICAL_MULT:           /* 055  = логическое умножение (и) = AND */
-		regRR = mosu_load (a1) & mosu_load (a2);
-		goto logop;
+	if (op == OPCODE_SHIFT_MANTISSA_BY_ADDR) {
+	  n = (a1 & 0177) - M20_MANTISSA_SHIFT;
+	  delay += 61.5 + 1.5 * (n>0 ? n : -n);
+	}
+	else {
+	  n = (int) (mosu_load (a1) >> BITS_36 & 0177) - M20_MANTISSA_SHIFT;
+	  delay += 24.0 + 1.5 * (n>0 ? n : -n);
+	}
+	y = mosu_load (a2);
+	regRR = (y & ~MANTISSA);
+	if ((n < 36) && (-n < 36)) {		//linux bugfix. 36 is mantissa length
+	    if (n >= 0) regRR |= (((y & MANTISSA) << n) & MANTISSA);
+	    else if (n < 0) regRR |= (((y & MANTISSA) >> -n) & MANTISSA);
+	}
+	mosu_store (a3, regRR);
+	trgSW = ((regRR & MANTISSA) == 0);
+	return SCPE_OK;
+}
 
-	case OPCODE_LOGICAL_ADD:            /* 075 = логическое сложение (или) = OR */
-		regRR = mosu_load (a1) | mosu_load (a2);
-		goto logop;
-
-
-	case OPCODE_ADD_CMDS:       /* 013 = сложение команд */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-		y = (x & MANTISSA) + (y & MANTISSA);
-addm:
-                regRR = (x & ~MANTISSA & WORD45) | (y & MANTISSA);
-		mosu_store (a3, regRR);
-                trgSW = (y & BIT37) != 0;
-		//if (op == 013) trgSW = (y & BIT37) != 0;
-                //if (op == 033) trgSW = (regRR & SIGN) != 0; //???
-		delay += 24.0;
-		break;
+/* 054 = сдвиг по адресу */
+/* 074 = сдвиг по порядку числа */
+static t_stat op_shift_code (int op, int a1, int a2, int a3)
+{
+	int n;
 
-	case OPCODE_SUB_CMDS:       /* 033 = вычитание команд */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-		y = (x & MANTISSA) - (y & MANTISSA);
-		goto addm;
-
-
-	case OPCODE_ADD_OPCS:      /* 053 = сложение кодов операций */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-		y = (x & ~MANTISSA) + (y & ~MANTISSA);
-addop:
-                regRR = (x & MANTISSA) | (y & ~MANTISSA & WORD45);
-		mosu_store (a3, regRR);
-                trgSW = (y & BIT46) != 0;
-		//if (op == 053) trgSW = (y & BIT46) != 0;
-                //if (op == 073) trgSW = (regRR & SIGN) != 0;
-		delay += 24.0;
-		break;
+	if (op == OPCODE_SHIFT_CODE_BY_ADDR) {
+	  n = (a1 & 0177) - M20_MANTISSA_SHIFT;
+	  delay += 61.5 + 1.5 * (n>0 ? n : -n);
+	}
+	else {
+	  n = (int) (mosu_load (a1) >> BITS_36 & 0177) - M20_MANTISSA_SHIFT;
+	  delay += 24 + 1.5 * (n>0 ? n : -n);
+	}
+	if ((n < 45) && (-n < 45)) {		//linux bugfix. 45 is machine word length
+	    regRR = mosu_load (a2);
+	    if (n > 0) regRR = (regRR << n);
+	    else if (n < 0) regRR >>= -n;
+	    regRR &= WORD45;
+	}
+	else regRR = 0;
+	mosu_store (a3, regRR);
+	trgSW = (regRR == 0);
+	return SCPE_OK;
+}
+
+/* 007 = циклическое сложение */
+static t_stat op_add_cyclic (int op, int a1, int a2, int a3)
+{
+	t_value x, y, t;
+
+	x = mosu_load (a1);
+	y = mosu_load (a2);
+	regRR = (x & ~MANTISSA) + (y & ~MANTISSA);
+	t = (x & MANTISSA) + (y & MANTISSA);
+	trgSW = (t & BIT37) != 0;
+	if (regRR & BIT46) regRR += BIT37;
+	if (t & BIT37) t += 1;
+	regRR &= WORD45;
+	regRR |= (t & MANTISSA);
+	mosu_store (a3, regRR);
+	delay += 24.0;
+	return SCPE_OK;
+}
+
+/* 027 = циклическое вычитание */
+static t_stat op_sub_cyclic (int op, int a1, int a2, int a3)
+{
+	t_value x, y, t;
+
+	x = mosu_load (a1);
+	y = mosu_load (a2);
+	t = BIT37 + (x & MANTISSA) - (y & MANTISSA);
+	if (t & BIT37) t -= BIT37;
+	regRR = (x & ~MANTISSA) - (y & ~MANTISSA);
+	if (regRR & BIT46) {
+	  regRR -= BIT37;
+	  t -= 1;
+	}
+	trgSW = (t & BIT37) != 0;
+	regRR |= t & MANTISSA;
+	regRR &= WORD45;
+	mosu_store (a3, regRR);
+	delay += 24.0;
+	return SCPE_OK;
+}
+
+/* 067 = циклический сдвиг */
+static t_stat op_shift_cyclic (int op, int a1, int a2, int a3)
+{
+	t_value x;
+
+	x = mosu_load (a1);
+	regRR = (x & 07777777)  << BITS_24 | (x >> BITS_24 & 07777777);
+	mosu_store (a3, regRR);
+	trgSW = (a3 == 0);
+	/* w не изменяется (неверно). */
+	delay += 24.0;
+	return SCPE_OK;
+}
+
+
+/*
+ *   Control Operations
+ *   (операции управления)
+ */
+
+/* 017 = останов машины */
+/* 077 = останов машины */
+static t_stat op_stop (int op, int a1, int a2, int a3)
+{
+	delay += 24.0;
+	regRR = 0;
+	mosu_store (a3, regRR);
+	/* Если адреса равны 0, считаем что это штатная, "хорошая" остановка. (?!) */
+	return STOP_STOP;
+}
+
+/* 037 = останов машины, в ИТЭФ-режиме: ФА - формирование адресов */
+static t_stat op_stop_037 (int op, int a1, int a2, int a3)
+{
+	t_value x, y, t, newcmd;
+	t_stat err;
+
+	if (!itep_mode) return op_stop (op, a1, a2, a3);
+
+	x = mosu_load (a1) >> BITS_12 & MAX_ADDR_VALUE;
+	y = mosu_load (a2) >> BITS_12 & MAX_ADDR_VALUE;
+	t = mosu_load (a3) >> BITS_12 & MAX_ADDR_VALUE;
+	fprintf(stderr,"itep_FA1: (A)2=%04llo, (B)2=%04llo, (C)2=%04llo\n",x,y,t);
+	newcmd=mosu_load (regKRA);
+	fprintf(stderr,"itep_FA2: updKRA=%04o, (updKRA)=%015llo\n",regKRA,newcmd);
+	x += newcmd >> BITS_24 & MAX_ADDR_VALUE;
+	x &= MAX_ADDR_VALUE;
+	y += newcmd >> BITS_12 & MAX_ADDR_VALUE;
+	y &= MAX_ADDR_VALUE;
+	t += newcmd & MAX_ADDR_VALUE;
+	t &= MAX_ADDR_VALUE;
+	fprintf(stderr,"itep_FA3: (A)2+K=%04llo, (B)2+L=%04llo, (C)2+M=%04llo\n",x,y,t);
+	regRK = newcmd & EXP_SIGN_TAG;
+	regRK |= x << BITS_24;
+	regRK |= y << BITS_12;
+	regRK |=t;
+	fprintf(stderr,"itep_FA4: regRK=%015llo\n",regRK);
+	regKRA +=1;
+	regKRA &= MAX_ADDR_VALUE;
+	err = irregular_cmd();
+	fprintf(stderr,"itep_FA5: nextKRA=%04o \n\n",regKRA);
+	return err;
+}
+
+/* 057 = останов машины, в ИТЭФ-режиме: ФК - формирование команд */
+static t_stat op_stop_057 (int op, int a1, int a2, int a3)
+{
+	t_value etalon_cmd_1,etalon_cmd_2,template1,k,l,m,fk_result;
+	int fk_alpha,fk_beta,fk_gamma,fk_delta,alpha1,alpha2,alpha3,k_addr,l_addr,m_addr;
+
+	if (!itep_mode) return op_stop (op, a1, a2, a3);
+
+	fk_alpha = (a1 & 07000) >> 9;
+	fk_beta  = (a1 & 0700) >> 6;
+	fk_gamma = (a1 & 070) >> 3;
+	fk_delta =  a1 & 07;
+	fprintf(stderr,"itep_FK1: alpha=%1d, beta=%1d, gamma=%1d, delta=%1d\n",fk_alpha,fk_beta,fk_gamma,fk_delta);
+
+	etalon_cmd_1 = mosu_load (a2);
+	etalon_cmd_2 = mosu_load (regKRA);
+	fprintf(stderr,"itep_FK2: A2=%04o, etalon1=%015llo, updKRA=%04o, etalon2=%015llo\n",a2,etalon_cmd_1,regKRA,etalon_cmd_2);
+
+	alpha1=!((fk_alpha & 4) >> 2) * MAX_ADDR_VALUE;
+	alpha2=!((fk_alpha & 2) >> 1) * MAX_ADDR_VALUE;
+	alpha3=! (fk_alpha & 1) * MAX_ADDR_VALUE;
+	fprintf(stderr,"itep_FK3: alpha1=%04o, alpha2=%04o, alpha3=%04o\n",alpha1,alpha2,alpha3);
+
+	template1=combine_addreses_to_single_word(alpha1,alpha2,alpha3);
+	etalon_cmd_1 &= template1;
+	fprintf(stderr,"itep_FK4: alpha_template=%015llo, etalon_cmd_1=%015llo\n",template1,etalon_cmd_1);
+
+	k_addr = etalon_cmd_2 >> BITS_24 & MAX_ADDR_VALUE;
+	l_addr = etalon_cmd_2 >> BITS_12 & MAX_ADDR_VALUE;
+	m_addr = etalon_cmd_2 >> BITS_0  & MAX_ADDR_VALUE;
+
+
+	k=get_fk_operand(fk_beta,k_addr);
+	l=get_fk_operand(fk_gamma,l_addr);
+	m=get_fk_operand(fk_delta,m_addr);
+	fprintf(stderr,"itep_FK5: mosu[k_addr]=%015llo, k=%04llo\n",mosu_load(k_addr),k);
+	fprintf(stderr,"itep_FK6: mosu[l_addr]=%015llo, l=%04llo\n",mosu_load(l_addr),l);
+	fprintf(stderr,"itep_FK7: mosu[m_addr]=%015llo, m=%04llo\n",mosu_load(m_addr),m);
+
+	m += etalon_cmd_1;
+	m &= MAX_ADDR_VALUE;
+	etalon_cmd_1 >>= BITS_12;
+	l += etalon_cmd_1;
+	l &= MAX_ADDR_VALUE;
+	etalon_cmd_1 >>= BITS_12;
+	k += etalon_cmd_1;
+	k &= MAX_ADDR_VALUE;
+	fprintf(stderr,"itep_FK8: k=%04llo, l=%04llo, m=%04llo\n",k,l,m);
+
+	fk_result=combine_addreses_to_single_word((int)k,(int)l,(int)m);
+	fk_result |= (etalon_cmd_2 & EXP_SIGN_TAG);
+	fprintf(stderr,"itep_FK9: fk_result=%015llo\n",fk_result);
+
+	regKRA +=1;
+	regKRA &= MAX_ADDR_VALUE;
+	mosu_store(a3,fk_result);
+	fprintf(stderr,"\n");
+	return SCPE_OK;
+}
+
+/* 052 = установка регистра адреса адресом */
+static t_stat op_set_ra_by_addr (int op, int a1, int a2, int a3)
+{
+	regRR = 052000000000000LL | (a1 << BITS_12);
+	mosu_store (a3, regRR);
+	regRA = a2;
+	delay += 28.5;
+	return SCPE_OK;
+}
+
+/* 072 = установка регистра адреса числом */
+static t_stat op_set_ra_by_code (int op, int a1, int a2, int a3)
+{
+	regRR = 052000000000000LL | (a1 << BITS_12);
+	mosu_store (a3, regRR);
+	regRA = mosu_load (a2) >> BITS_12 & MAX_ADDR_VALUE;
+	delay += 28.5;
+	return SCPE_OK;
+}
+
+/*
+ * Check taken jump to KRA (from = address after jump instruction).
+ * Backward jump repeating machine state without effects is idle loop:
+ * stop with STOP_IDLE, or with SET CPU IDLESKIP skip time to next event.
+ * Loop waiting for counted breakpoint is not stopped.
+ */
+static t_stat cpu_idle_check (int from)
+{
+    M20_IDLE_ENTRY * e;
+    BRKTAB * bp;
+    int i;
+
+	if (!(cpu_unit.flags & UNIT_IDLELOOP) || (regKRA >= from))
+	  return SCPE_OK;
+
+	e = &cpu_idle_tab[regKRA % CPU_IDLE_TAB_SIZE];
+	if ((e->addr != regKRA) || (e->effects != cpu_effects) ||
+	    (e->ra != regRA) || (e->sma != regSMA) || (e->sw != trgSW) ||
+	    (e->rop != regROP) || (e->rr != regRR) || (e->rmr != regRMR)) {
+	  e->addr = regKRA;
+	  e->ra = regRA;
+	  e->sma = regSMA;
+	  e->sw = trgSW;
+	  e->rop = regROP;
+	  e->rr = regRR;
+	  e->rmr = regRMR;
+	  e->effects = cpu_effects;
+	  return SCPE_OK;
+	}
+
+	if (sim_brk_summ) {
+	  for (i = 0; i < sim_brk_ent; i++)
+	    for (bp = sim_brk_tab[i]; bp != NULL; bp = bp->next)
+	      if (bp->cnt > 0) return SCPE_OK;
+	}
+
+	if (((cpu_unit.flags & UNIT_IDLELOOP) == UNIT_IDLE_SKIP) &&
+	    (sim_clock_queue != QUEUE_LIST_END)) {
+	  if (sim_interval > 0) delay += sim_interval;
+	  return SCPE_OK;
+	}
+
+	if (sim_deb && cpu_dev.dctrl)
+	  fprintf (sim_deb, "cpu: idle loop at %04o\n", regKRA);
+	return STOP_IDLE;
+}
+
+/* 016 = передача управления с возвратом */
+static t_stat op_jump_with_return (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	regRR = 016000000000000LL | (a1 << BITS_12);
+	regKRA = a2;
+	mosu_store (a3, regRR);
+	delay += 24.0;
+
+	if (cpu_unit.flags & UNIT_HLE) {	/* library routine in native code? */
+	  t_stat r = m20_hle_call (a1, a2, a3);
+	  if (r) return r;
+	}
+	return cpu_idle_check (from);
+}
+
+/* 036 = передача управления по условию w=1 */
+static t_stat op_jump_w1 (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	regRR = mosu_load (a1);
+	if (trgSW) regKRA = a2;
+	mosu_store (a3, regRR);
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 056 = передача управления */
+static t_stat op_jump (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	regRR = mosu_load (a1);
+	regKRA = a2;
+	mosu_store (a3, regRR);
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 076 = передача управления по условию w=0 */
+static t_stat op_jump_w0 (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	regRR = mosu_load (a1);
+	if (!trgSW) regKRA = a2;
+	mosu_store (a3, regRR);
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 012 = переход по < */
+static t_stat op_cycle_lt (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	if (regRA < (unsigned)a1) regKRA = a2;
+	regRA = a3;
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 032 = переход по >= */
+static t_stat op_cycle_ge (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	if (regRA >= (unsigned)a1) regKRA = a2;
+	regRA = a3;
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 011 = переход по < и w=1 */
+static t_stat op_cycle_lt_w1 (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	if (regRA < (unsigned)a1 && trgSW) regKRA = a2;
+	regRA = a3;
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 031 = переход по >= и w=1 */
+static t_stat op_cycle_ge_w1 (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	if (regRA >= (unsigned)a1 && trgSW) regKRA = a2;
+	regRA = a3;
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 051 = переход по < и w=0 */
+static t_stat op_cycle_lt_w0 (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	if (regRA < (unsigned)a1 && !trgSW) regKRA = a2;
+	regRA = a3;
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+/* 071 = переход по >= и w=0 */
+static t_stat op_cycle_ge_w0 (int op, int a1, int a2, int a3)
+{
+	int from = regKRA;
+
+	if (regRA >= (unsigned)a1 && !trgSW) regKRA = a2;
+	regRA = a3;
+	delay += 24.0;
+	return cpu_idle_check (from);
+}
+
+
+/*
+ *   Input/Output Operations
+ *   (операции обмена между накопителями)
+ */
+
+/* 010 = ввод с перфокарт */
+static t_stat op_input_cards_with_stop (int op, int a1, int a2, int a3)
+{
+	t_stat err;
+
+	if (m20_jrn_mode) return m20_jrn_io (op, a1, a2, a3, op_input_cards_with_stop);
+
+	cpu_effects++;
+	cr_io_addr_1 = a1;
+	cr_io_addr_2 = a2;
+	cr_io_addr_3 = a3;
+	cdr_csum = 0;
+	cdr_rsum = 0;
+	cdr_rcodes = 0;
+	cdr_stop_blocking = 0;
+	cdr_control_blocking = 0;
+	if (sim_deb && cpu_dev.dctrl)
+	    fprintf (sim_deb, "cpu: opcode=10: regKRA=%d,a1=%d,a2=%d,a3=%d\n", regKRA,a1,a2,a3);
+	/* check for boot operation request from card reader device */
+	if (boot_device_req_cdr) {
+	   if (sim_deb && cpu_dev.dctrl) fprintf (sim_deb, "cpu: cdr boot detected. Set regKRA=%d\n", a1);
+	   regKRA = a1;
+	   boot_device_req_cdr = 0;
+	}
+	err = read_card(&cdr_csum,&cdr_rsum,&cdr_rcodes,&cdr_stop_blocking,&cdr_control_blocking);
+	if (err) {
+	    if (err == STOP_CRBADSUM) {
+	      /* A1 must contain last address code of input */
+	    }
+	    return err;
+	}
+	delay += (50000*cdr_rcodes);
+	if (!cdr_control_blocking) {
+	  if (cdr_stop_blocking) regKRA = a2;
+	  else if (cdr_csum != cdr_rsum) {
+	    regKRA = a2;
+	    return STOP_CRBADSUM;
+	  }
+	}
+	mosu_store (a3, cdr_csum);
+	return SCPE_OK;
+}
+
+/* 030 = ввод с перфокарт останова после проверки к.суммы */
+static t_stat op_input_cards (int op, int a1, int a2, int a3)
+{
+	t_stat err;
+
+	if (m20_jrn_mode) return m20_jrn_io (op, a1, a2, a3, op_input_cards);
+
+	cpu_effects++;
+	cr_io_addr_1 = a1;
+	cr_io_addr_2 = a2;
+	cr_io_addr_3 = a3;
+	cdr_csum = 0;
+	cdr_rsum = 0;
+	cdr_rcodes = 0;
+	cdr_stop_blocking = 0;
+	cdr_control_blocking = 0;
+	if (sim_deb && cpu_dev.dctrl)
+	    fprintf (sim_deb, "cpu: opcode=30: regKRA=%d,a1=%d,a2=%d,a3=%d\n", regKRA,a1,a2,a3);
+	err = read_card(&cdr_csum,&cdr_rsum,&cdr_rcodes,&cdr_stop_blocking,&cdr_control_blocking);
+	if (err) return err;
+	delay += (50000*cdr_rcodes);
+	if (!cdr_control_blocking && (cdr_csum != cdr_rsum)) regKRA = a2;
+	mosu_store (a3, cdr_csum);
+	return SCPE_OK;
+}
+
+/* 050 = подготовка обращения к внешнему устройству */
+static t_stat op_ext_io_setup (int op, int a1, int a2, int a3)
+{
+	t_stat err;
+
+	if (m20_jrn_mode) return m20_jrn_io (op, a1, a2, a3, op_ext_io_setup);
+
+	cpu_effects++;
+	err = ext_io_setup (a1, a2, a3);
+	if (err) return err;
+	delay += 24.0;
+	return SCPE_OK;
+}
+
+/* 070 = выполнение обращения к внешнему устройству */
+static t_stat op_ext_io (int op, int a1, int a2, int a3)
+{
+	t_stat err;
+
+	if (m20_jrn_mode) return m20_jrn_io (op, a1, a2, a3, op_ext_io);
+
+	cpu_effects++;
+	if (sim_deb && cpu_dev.dctrl)
+	     fprintf (sim_deb, "cpu: ext_io_op=%04o\n", ext_io_op);
+	if (ext_io_op == MAX_ADDR_VALUE) return STOP_IO_MISSING_SETUP;
+	err = ext_io_operation (a1, &regRR);
+	if (a3) mosu_store (a3, regRR);
+	if (err) {
+	   if (err == STOP_READERR) {
+	       /* A1 must contain last location address of successful input */
+	   }
+	   if (err == STOP_TAPEREADERR) {
+	       /* A1 must contain last zone number of successful input */
+	   }
+	   if (err != STOP_READERR || !(ext_io_op & EXT_DIS_STOP)) return err;
+	   if (!(ext_io_op & (EXT_PUNCH|EXT_PRINT)) && a2) regKRA = a2;
+	}
+	delay += 24.0;
+	return SCPE_OK;
+}
+
+
+/* Instruction handlers, indexed by opcode */
+
+static const M20_OP_HANDLER  cpu_op_handler[M20_SYM_OPCODE_TABLE_SIZE] = {
+/*       0                   1                   2                   3                   4                   5                   6                   7         */
+/* 00 */ op_move,            op_add,             op_sub,             op_sub_mod,         op_div,             op_mult,            op_add_exp,         op_add_cyclic,
+/* 01 */ op_input_cards_with_stop, op_cycle_lt_w1, op_cycle_lt,      op_add_cmds,        op_shift_mantissa,  op_logical,         op_jump_with_return, op_stop,
+/* 02 */ op_read_panel,      op_add,             op_sub,             op_sub_mod,         op_div,             op_mult,            op_add_exp,         op_sub_cyclic,
+/* 03 */ op_input_cards,     op_cycle_ge_w1,     op_cycle_ge,        op_add_cmds,        op_shift_mantissa,  op_logical,         op_jump_w1,         op_stop_037,
+/* 04 */ op_blank_040,       op_add,             op_sub,             op_sub_mod,         op_sqrt,            op_mult,            op_add_exp,         op_mult_low,
+/* 05 */ op_ext_io_setup,    op_cycle_lt_w0,     op_set_ra_by_addr,  op_add_opcs,        op_shift_code,      op_logical,         op_jump,            op_stop_057,
+/* 06 */ op_blank_060,       op_add,             op_sub,             op_sub_mod,         op_sqrt,            op_mult,            op_add_exp,         op_shift_cyclic,
+/* 07 */ op_ext_io,          op_cycle_ge_w0,     op_set_ra_by_code,  op_add_opcs,        op_shift_code,      op_logical,         op_jump_w0,         op_stop
+};
+
+
+/*
+ * Unpack instruction word into predecoded form.
+ */
+void cpu_decode_inst (PM20_DECODED_INST di, t_value w)
+{
+	di->addr_tags = (uint8)(w >> BITS_42 & MAX_ADDR_TAG_VALUE);
+	di->op = (uint8)(w >> BITS_36 & MAX_OPCODE_VALUE);
+	di->a1 = (uint16)(w >> BITS_24 & MAX_ADDR_VALUE);
+	di->a2 = (uint16)(w >> BITS_12 & MAX_ADDR_VALUE);
+	di->a3 = (uint16)(w >> BITS_0  & MAX_ADDR_VALUE);
+	di->handler = cpu_op_handler[di->op];
+	di->valid = 1;
+}
+
+
+/*
+ * Execute one predecoded instruction (switch interpreter, reference engine).
+ */
+static t_stat cpu_exec_inst (const M20_DECODED_INST * di)
+{
+	int addr_tags, op, a1, a2, a3;
+	t_stat err;
+
+	addr_tags = di->addr_tags;
+	op = di->op;
+	a1 = di->a1;
+	a2 = di->a2;
+	a3 = di->a3;
+
+	/* Есля установлен соответствующий бит признака,
+	 * к адресу добавляется значение регистра адреса. */
+	if (addr_tags & 4) a1 = (a1 + regRA) & MAX_ADDR_VALUE;
+	if (addr_tags & 2) a2 = (a2 + regRA) & MAX_ADDR_VALUE;
+	if (addr_tags & 1) a3 = (a3 + regRA) & MAX_ADDR_VALUE;
+
+
+	/* test for memory contents overflow */
+	if (memory_45_checking) {
+	  err = memory_45_check (a1, a2, a3, "BEFORE");
+	  if (err) return err;
+	}
+
+	switch (op) {
+	default:
+		err = op_bad (op, a1, a2, a3);
+		break;
+
+	/*
+         *   Numbers Operations
+         *   (операции над числами)
+         */
+
+	case OPCODE_ADD_ROUND_NORM:         /* 001 = сложение с округлением и нормализацией */
+	case OPCODE_ADD_NORM:               /* 021 = сложение без округления с нормализацией */
+	case OPCODE_ADD_ROUND:              /* 041 = сложение с округлением без нормализации */
+	case OPCODE_ADD:                    /* 061 = сложение без округления и без нормализации */
+		err = op_add (op, a1, a2, a3);
+		break;
+
+	case OPCODE_SUB_ROUND_NORM:         /* 002 = вычитание с округлением и нормализацией */
+	case OPCODE_SUB_NORM:               /* 022 = вычитание без округления с нормализацией */
+	case OPCODE_SUB_ROUND:              /* 042 = вычитание с округлением без нормализации */
+	case OPCODE_SUB:                    /* 062 = вычитание без округления и без нормализации */
+		err = op_sub (op, a1, a2, a3);
+		break;
+
+	case OPCODE_SUB_MOD_ROUND_NORM:     /* 003 = вычитание модулей с округлением и нормализацией */
+	case OPCODE_SUB_MOD_NORM:           /* 023 = вычитание модулей без округления с нормализацией */
+	case OPCODE_SUB_MOD_ROUND:          /* 043 = вычитание модулей с округлением без нормализации */
+	case OPCODE_SUB_MOD:                /* 063 = вычитание модулей без округления и без нормализации */
+		err = op_sub_mod (op, a1, a2, a3);
+		break;
+
+	case OPCODE_MULT_ROUND_NORM:        /* 005 = умножение с округлением и нормализацией */
+	case OPCODE_MULT_NORM:              /* 025 = умножение без округления с нормализацией */
+	case OPCODE_MULT_ROUND:             /* 045 = умножение с округлением без нормализации */
+	case OPCODE_MULT:                   /* 065 = умножение без округления и без нормализации */
+		err = op_mult (op, a1, a2, a3);
+		break;
+
+	case OPCODE_DIV_ROUND_NORM:         /* 004 = деление с округлением */
+	case OPCODE_DIV_NORM:               /* 024 = деление без округления */
+		err = op_div (op, a1, a2, a3);
+		break;
+
+	case OPCODE_SQRT_ROUND_NORM:        /* 044 = извлечение корня с округлением */
+	case OPCODE_SQRT_NORM:              /* 064 = извлечение корня без округления */
+		err = op_sqrt (op, a1, a2, a3);
+		break;
+
+	case OPCODE_OUT_LOWER_BITS_OF_MULT: /* 047 = выдача младших разрядов произведения */
+		err = op_mult_low (op, a1, a2, a3);
+		break;
+
+	case OPCODE_ADD_ADDR_TO_EXP:        /* 006 = сложение порядка с адресом */
+	case OPCODE_ADD_EXP_TO_EXP:         /* 026 = сложение порядков чисел */
+	case OPCODE_SUB_ADDR_FROM_EXP:      /* 046 = вычитание адреса из порядка */
+	case OPCODE_SUB_EXP_FROM_EXP:       /* 066 = вычитание порядков чисел */
+		err = op_add_exp (op, a1, a2, a3);
+		break;
+
+	/*
+         *   Codes Operations
+         *   (операции над кодами)
+         */
+
+	case OPCODE_TRANSFER_MEM2MEM:       /* 000 = пересылка */
+		err = op_move (op, a1, a2, a3);
+		break;
+
+	case OPCODE_LOAD_FROM_KEY_REGISTER: /* 020 = чтение пультовых тумблеров */
+		err = op_read_panel (op, a1, a2, a3);
+		break;
+
+	case OPCODE_BLANKING_040:           /* 040 = гашение */
+		err = op_blank_040 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_BLANKING_060:           /* 060 = гашение */
+		err = op_blank_060 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_COMPARE:                /* 015 = поразрядное сравнение (исключающее или) */
+	case OPCODE_COMPARE_WITH_STOP:      /* 035 = поразрядное сравнение с остановом */
+	case OPCODE_LOGICAL_MULT:           /* 055 = логическое умножение (и) = AND */
+	case OPCODE_LOGICAL_ADD:            /* 075 = логическое сложение (или) = OR */
+		err = op_logical (op, a1, a2, a3);
+		break;
+
+	case OPCODE_ADD_CMDS:               /* 013 = сложение команд */
+	case OPCODE_SUB_CMDS:               /* 033 = вычитание команд */
+		err = op_add_cmds (op, a1, a2, a3);
+		break;
+
+	case OPCODE_ADD_OPCS:               /* 053 = сложение кодов операций */
+	case OPCODE_SUB_OPCS:               /* 073 = вычитание кодов операций */
+		err = op_add_opcs (op, a1, a2, a3);
+		break;
+
+	case OPCODE_SHIFT_MANTISSA_BY_ADDR: /* 014 = сдвиг мантиссы по адресу */
+	case OPCODE_SHIFT_MANTISSA_BY_EXP:  /* 034 = сдвиг мантиссы по порядку числа */
+		err = op_shift_mantissa (op, a1, a2, a3);
+		break;
+
+	case OPCODE_SHIFT_CODE_BY_ADDR:     /* 054 = сдвиг по адресу */
+	case OPCODE_SHIFT_CODE_BY_EXP:      /* 074 = сдвиг по порядку числа */
+		err = op_shift_code (op, a1, a2, a3);
+		break;
+
+	case OPCODE_ADD_CYCLIC:             /* 007 = циклическое сложение */
+		err = op_add_cyclic (op, a1, a2, a3);
+		break;
+
+	case OPCODE_SUB_CYCLIC:             /* 027 = циклическое вычитание */
+		err = op_sub_cyclic (op, a1, a2, a3);
+		break;
+
+	case OPCODE_SHIFT_CYCLIC:           /* 067 = циклический сдвиг */
+		err = op_shift_cyclic (op, a1, a2, a3);
+		break;
+
+	/*
+         *   Control Operations
+         *   (операции управления)
+         */
+
+	case OPCODE_STOP_037:               /* 037 = останов машины, в ИТЭФ-режиме: ФА */
+		err = op_stop_037 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_STOP_057:               /* 057 = останов машины, в ИТЭФ-режиме: ФК */
+		err = op_stop_057 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_STOP_017:               /* 017 = останов машины */
+	case OPCODE_STOP_077:               /* 077 = останов машины */
+		err = op_stop (op, a1, a2, a3);
+		break;
+
+	case OPCODE_CHANGE_RA_BY_ADDR:      /* 052 = установка регистра адреса адресом */
+		err = op_set_ra_by_addr (op, a1, a2, a3);
+		break;
+
+	case OPCODE_CHANGE_RA_BY_CODE:      /* 072 = установка регистра адреса числом */
+		err = op_set_ra_by_code (op, a1, a2, a3);
+		break;
+
+	case OPCODE_JUMP_WITH_RETURN:       /* 016 = передача управления с возвратом */
+		err = op_jump_with_return (op, a1, a2, a3);
+		break;
+
+	case OPCODE_COND_JUMP_BY_SIG_W_1:   /* 036 = передача управления по условию w=1 */
+		err = op_jump_w1 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_JUMP_BY_ADDR:           /* 056 = передача управления */
+		err = op_jump (op, a1, a2, a3);
+		break;
+
+	case OPCODE_COND_JUMP_BY_SIG_W_0:   /* 076 = передача управления по условию w=0 */
+		err = op_jump_w0 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_012:           /* 012 = переход по < */
+		err = op_cycle_lt (op, a1, a2, a3);
+		break;
+
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_032:           /* 032 = переход по >= */
+		err = op_cycle_ge (op, a1, a2, a3);
+		break;
+
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_011:   /* 011 = переход по < и w=1 */
+		err = op_cycle_lt_w1 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_031:   /* 031 = переход по >= и w=1 */
+		err = op_cycle_ge_w1 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_051:   /* 051 = переход по < и w=0 */
+		err = op_cycle_lt_w0 (op, a1, a2, a3);
+		break;
+
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_071:   /* 071 = переход по >= и w=0 */
+		err = op_cycle_ge_w0 (op, a1, a2, a3);
+		break;
+
+	/*
+         *   Input/Output Operations
+         *   (операции обмена между накопителями)
+         */
+
+	case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS_WITH_STOP:   /* 010 = ввод с перфокарт */
+		err = op_input_cards_with_stop (op, a1, a2, a3);
+		break;
+
+	case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS:   /* 030 = ввод с перфокарт останова после проверки к.суммы */
+		err = op_input_cards (op, a1, a2, a3);
+		break;
+
+	case OPCODE_IO_EXT_DEV_TO_MEM_050:  /* 050 = подготовка обращения к внешнему устройству */
+		err = op_ext_io_setup (op, a1, a2, a3);
+		break;
+
+	case OPCODE_IO_EXT_DEV_TO_MEM_070:  /* 070 = выполнение обращения к внешнему устройству */
+		err = op_ext_io (op, a1, a2, a3);
+		break;
+	}
+	if (err) return err;
+
+	/* test for memory contents overflow */
+	if (memory_45_checking) {
+	  err = memory_45_check (a1, a2, a3, "AFTER");
+	  if (err) return err;
+	}
+
+	//ext_io_op = MAX_ADDR_VALUE;
+
+	return SCPE_OK;
+}
+
+
+/*
+ * Execute one instruction, contained in register RK.
+ */
+t_stat cpu_one_inst ()
+{
+	M20_DECODED_INST di;
+
+	cpu_decode_inst (&di, regRK);
+	return cpu_exec_inst (&di);
+}
+
+
+
+
+void print_commad_run_profile_stat(void)
+{
+   int i, op;
+   double sum_time, sum_count;
+
+   printf("\n*** Command time profile stat ***\n");
+   sum_time = sum_count = 0;
+   for( i=0; i<M20_SYM_OPCODE_TABLE_SIZE; i++ ) {
+       op = cmd_profile_table[i].op_code;
+       if (cmd_profile_table[i].us_count > 0) {
+         sum_time += cmd_profile_table[i].us_time;
+         sum_count += cmd_profile_table[i].us_count;
+         printf("opcode=%02o   count=%-9.0f  times=%-15.2f  avg_time=%-15.2f   (%s)\n",
+                 op, cmd_profile_table[i].us_count, cmd_profile_table[i].us_time,
+                 cmd_profile_table[i].us_time/cmd_profile_table[i].us_count, m20_opname[i] );
+       }
+   }
+   printf("Summary:  times=%.2f  count=%.0f  avg_time=%.2f\n", sum_time, sum_count, sum_time/sum_count );
+   printf("**********\n\n");
+}
+
+
+/*
+ * Per-address execution profile (hotspots).
+ */
+static int hotspot_compare_time (const void * pa, const void * pb)
+{
+   const COMMAND_PROFILE_STAT * a = &addr_profile_table[*(const int *)pa];
+   const COMMAND_PROFILE_STAT * b = &addr_profile_table[*(const int *)pb];
+
+   if (a->us_time != b->us_time) return (a->us_time < b->us_time) ? 1 : -1;
+   return *(const int *)pa - *(const int *)pb;
+}
+
+static int hotspot_compare_count (const void * pa, const void * pb)
+{
+   const COMMAND_PROFILE_STAT * a = &addr_profile_table[*(const int *)pa];
+   const COMMAND_PROFILE_STAT * b = &addr_profile_table[*(const int *)pb];
+
+   if (a->us_count != b->us_count) return (a->us_count < b->us_count) ? 1 : -1;
+   return *(const int *)pa - *(const int *)pb;
+}
+
+
+/*
+ * SHOW CPU HOTSPOTS[=n], SHOW CPU HOTCOUNT[=n]:
+ * print n most expensive addresses by emulated time or by execution count.
+ */
+t_stat cpu_show_hotspots (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+   int addr_list[MAX_MEM_SIZE];
+   int i, n, max_lines;
+   double sum_time, sum_count;
+   COMMAND_PROFILE_STAT * p;
+   t_stat r;
+
+   max_lines = 20;
+   if (desc) {
+     max_lines = (int) get_uint ((CONST char *) desc, 10, MAX_MEM_SIZE, &r);
+     if (r != SCPE_OK) return SCPE_ARG;
+   }
+
+   n = 0;
+   sum_time = sum_count = 0;
+   for( i=0; i<MAX_MEM_SIZE; i++ ) {
+       if (addr_profile_table[i].us_count > 0) {
+         addr_list[n++] = i;
+         sum_time += addr_profile_table[i].us_time;
+         sum_count += addr_profile_table[i].us_count;
+       }
+   }
+   if (n == 0) {
+     fprintf(st, "No execution profile (PRINT_SYS_STAT is 0 or CPU not run)\n");
+     return SCPE_OK;
+   }
+
+   qsort (addr_list, n, sizeof(addr_list[0]), val ? hotspot_compare_count : hotspot_compare_time);
+
+   if (max_lines > n) max_lines = n;
+   for( i=0; i<max_lines; i++ ) {
+       p = &addr_profile_table[addr_list[i]];
+       fprintf(st, "addr=%04o   count=%-11.0f  times=%-15.2f  %5.1f%%   (%s)\n",
+               addr_list[i], p->us_count, p->us_time,
+               100.0 * (val ? p->us_count/sum_count : p->us_time/sum_time), m20_opname[p->op_code] );
+   }
+   fprintf(st, "Summary:  addresses=%d  times=%.2f  count=%.0f\n", n, sum_time, sum_count );
+   return SCPE_OK;
+}
+
+
+/*
+ * SET CPU HOTSPOTS=file: export execution profile of all addresses as CSV.
+ */
+t_stat cpu_set_hotspots (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+   FILE * f;
+   int i;
+
+   if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+
+   f = sim_fopen (cptr, "w");
+   if (f == NULL) return SCPE_OPENERR;
+
+   fprintf(f, "addr,opcode,count,time_us\n");
+   for( i=0; i<MAX_MEM_SIZE; i++ ) {
+       if (addr_profile_table[i].us_count > 0)
+         fprintf(f, "%04o,%02o,%.0f,%.2f\n", i, addr_profile_table[i].op_code,
+                 addr_profile_table[i].us_count, addr_profile_table[i].us_time );
+   }
+   fclose (f);
+   return SCPE_OK;
+}
+
+
+/*
+ * SET CPU NOHOTSPOTS: clear execution profile of addresses and opcodes.
+ */
+t_stat cpu_clear_hotspots (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+   int i;
+
+   if (cptr) return SCPE_ARG;
+
+   memset (addr_profile_table, 0, sizeof(addr_profile_table));
+   for( i=0; i<M20_SYM_OPCODE_TABLE_SIZE; i++ ) {
+       cmd_profile_table[i].us_count = 0;
+       cmd_profile_table[i].us_time = 0;
+   }
+   return SCPE_OK;
+}
+
+
+/*
+ * Subroutine profile (SET CPU CALLPROFILE[=file]).
+ * Shadow stack of calls: 016 with nonzero a3 (return word 016 to a1 is
+ * planted there) pushes frame of routine a2, frame is popped when control
+ * comes to its a1, by the return word or by any other jump. Executed
+ * instructions and their delay go to routine on top of stack (exclusive)
+ * and to its call path; inclusive figures are counted from entry to
+ * return, once for recursive calls.
+ *   SHOW CPU CALLPROFILE[=n]   n routines with largest inclusive time
+ *   SET CPU CALLDUMP=file      call paths as folded stacks for flamegraph
+ *                              tools ("main;0200;7200 time_us"), written on
+ *                              every stop if file is given to CALLPROFILE
+ */
+#define  CALLPROF_DEPTH        256
+#define  CALLPROF_NODES        65536
+#define  CALLPROF_MAIN         MAX_MEM_SIZE     /* code not called by 016 */
+
+typedef  struct callprof_entry {
+    double   calls;
+    double   incl_count, incl_time;
+    double   excl_count, excl_time;
+    int      active;                    /* frames on stack */
+} CALLPROF_ENTRY;
+
+typedef  struct callprof_node {
+    int      entry, parent, child, sibling;
+    double   count, time;               /* exclusive on this path */
+} CALLPROF_NODE;
+
+typedef  struct callprof_frame {
+    int      entry, ret, node;
+    double   count, time;               /* totals at entry */
+} CALLPROF_FRAME;
+
+CALLPROF_ENTRY * cpu_callprof = NULL;   /* MAX_MEM_SIZE + 1 entries */
+char     cpu_callprof_file[CBUFSIZE] = "";      /* write folded stacks here on stop */
+
+static CALLPROF_NODE * callprof_nodes = NULL;
+static int      callprof_nnodes;
+static CALLPROF_FRAME  callprof_stack[CALLPROF_DEPTH];
+static int      callprof_depth;         /* top frame, 0 is main */
+static double   callprof_count, callprof_time;
+static uint32   callprof_lost;          /* calls not on stack, stack or nodes full */
+
+
+/*
+ * Node of call path: child of parent for routine entry.
+ */
+static int callprof_child (int parent, int entry)
+{
+    CALLPROF_NODE * p;
+    int n;
+
+	for( n=callprof_nodes[parent].child; n>=0; n=callprof_nodes[n].sibling )
+	  if (callprof_nodes[n].entry == entry) return n;
+
+	if (callprof_nnodes >= CALLPROF_NODES) return -1;
+	n = callprof_nnodes++;
+	p = &callprof_nodes[n];
+	memset (p, 0, sizeof(CALLPROF_NODE));
+	p->entry = entry;
+	p->parent = parent;
+	p->child = -1;
+	p->sibling = callprof_nodes[parent].child;
+	callprof_nodes[parent].child = n;
+	return n;
+}
+
+
+static void callprof_push (int entry, int ret)
+{
+    CALLPROF_FRAME * f;
+    int node;
+
+	cpu_callprof[entry].calls += 1;
+	node = -1;
+	if (callprof_depth + 1 < CALLPROF_DEPTH)
+	  node = callprof_child (callprof_stack[callprof_depth].node, entry);
+	if (node < 0) {
+	  callprof_lost++;
+	  return;
+	}
+	f = &callprof_stack[++callprof_depth];
+	f->entry = entry;
+	f->ret = ret;
+	f->node = node;
+	f->count = callprof_count;
+	f->time = callprof_time;
+	cpu_callprof[entry].active++;
+}
+
+
+static void callprof_pop (void)
+{
+    CALLPROF_FRAME * f;
+    CALLPROF_ENTRY * e;
+
+	f = &callprof_stack[callprof_depth--];
+	e = &cpu_callprof[f->entry];
+	if (--e->active == 0) {
+	  e->incl_count += callprof_count - f->count;
+	  e->incl_time += callprof_time - f->time;
+	}
+}
+
+
+/*
+ * Executed instruction: count it for top routine, follow call or return.
+ */
+static void cpu_callprof_step (int op, int a1, int a3, double t)
+{
+    CALLPROF_FRAME * f;
+    int i;
+
+	f = &callprof_stack[callprof_depth];
+	callprof_count += 1;
+	callprof_time += t;
+	cpu_callprof[f->entry].excl_count += 1;
+	cpu_callprof[f->entry].excl_time += t;
+	callprof_nodes[f->node].count += 1;
+	callprof_nodes[f->node].time += t;
+
+	for( i=callprof_depth; i>0; i-- )
+	  if (callprof_stack[i].ret == regKRA) {
+	    while (callprof_depth >= i) callprof_pop ();
+	    return;
+	  }
+
+	/* call; HLE routine has returned already */
+	if ((op == OPCODE_JUMP_WITH_RETURN) && (a3 != 0) && (regKRA != a1))
+	  callprof_push (regKRA, a1);
+}
+
+
+static void callprof_reset (void)
+{
+	memset (cpu_callprof, 0, (MAX_MEM_SIZE + 1) * sizeof(CALLPROF_ENTRY));
+	memset (&callprof_nodes[0], 0, sizeof(CALLPROF_NODE));
+	callprof_nodes[0].entry = CALLPROF_MAIN;
+	callprof_nodes[0].parent = callprof_nodes[0].child = callprof_nodes[0].sibling = -1;
+	callprof_nnodes = 1;
+	callprof_stack[0].entry = CALLPROF_MAIN;
+	callprof_stack[0].ret = -1;
+	callprof_stack[0].node = 0;
+	callprof_depth = 0;
+	callprof_count = callprof_time = 0;
+	callprof_lost = 0;
+}
+
+
+/*
+ * Write call paths of node and its children in folded stack format.
+ */
+static void callprof_fold (FILE * f, int n, char * path, size_t len)
+{
+    CALLPROF_NODE * p = &callprof_nodes[n];
+
+	if (n == 0) len = _snprintf (path, CBUFSIZE * 2, "main");
+	else len += _snprintf (path + len, CBUFSIZE * 2 - len, ";%04o", p->entry);
+
+	if (p->time >= 0.5)
+	  fprintf (f, "%s %.0f\n", path, p->time);
+	for( n=p->child; n>=0; n=callprof_nodes[n].sibling )
+	  callprof_fold (f, n, path, len);
+	path[len] = 0;
+}
+
+
+t_stat cpu_callprof_write (const char * fname)
+{
+    FILE * f;
+    char * path;
+
+	if (cpu_callprof == NULL) return SCPE_NOFNC;
+
+	f = sim_fopen (fname, "w");
+	if (f == NULL) return SCPE_OPENERR;
+	path = (char *) malloc (CBUFSIZE * 2);	/* CALLPROF_DEPTH ";nnnn" */
+	if (path == NULL) {
+	  fclose (f);
+	  return SCPE_MEM;
+	}
+	callprof_fold (f, 0, path, 0);
+	free (path);
+	fclose (f);
+	return SCPE_OK;
+}
+
+
+/*
+ * SET CPU CALLPROFILE[=file], SET CPU NOCALLPROFILE, SET CPU CALLDUMP=file.
+ * CALLPROFILE starts profile anew.
+ */
+t_stat cpu_set_callprof (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+	if (val == 2) {				/* CALLDUMP */
+	  if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+	  return cpu_callprof_write (cptr);
+	}
+
+	free (cpu_callprof);
+	free (callprof_nodes);
+	cpu_callprof = NULL;
+	callprof_nodes = NULL;
+	cpu_callprof_file[0] = 0;
+	if (val == 1)				/* NOCALLPROFILE */
+	  return cptr ? SCPE_ARG : SCPE_OK;
+
+	cpu_callprof = (CALLPROF_ENTRY *) malloc ((MAX_MEM_SIZE + 1) * sizeof(CALLPROF_ENTRY));
+	callprof_nodes = (CALLPROF_NODE *) malloc (CALLPROF_NODES * sizeof(CALLPROF_NODE));
+	if ((cpu_callprof == NULL) || (callprof_nodes == NULL)) {
+	  free (cpu_callprof);
+	  free (callprof_nodes);
+	  cpu_callprof = NULL;
+	  callprof_nodes = NULL;
+	  return SCPE_MEM;
+	}
+	callprof_reset ();
+
+	if (cptr && *cptr) {
+	  strncpy (cpu_callprof_file, cptr, sizeof(cpu_callprof_file) - 1);
+	  cpu_callprof_file[sizeof(cpu_callprof_file) - 1] = 0;
+	}
+	return SCPE_OK;
+}
+
+
+static double *callprof_sort_key;
+
+static int callprof_compare (const void * a, const void * b)
+{
+    double ta = callprof_sort_key[*(const int *)a];
+    double tb = callprof_sort_key[*(const int *)b];
+
+	return (ta < tb) ? 1 : (ta > tb) ? -1 : 0;
+}
+
+
+/*
+ * SHOW CPU CALLPROFILE[=n]
+ */
+t_stat cpu_show_callprof (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+    static double incl_count[MAX_MEM_SIZE + 1], incl_time[MAX_MEM_SIZE + 1];
+    static int list[MAX_MEM_SIZE + 1];
+    CALLPROF_ENTRY * e;
+    CALLPROF_FRAME * f;
+    int i, n, max_lines;
+    t_stat r;
+
+	if (cpu_callprof == NULL) {
+	  fprintf (st, "No subroutine profile (SET CPU CALLPROFILE)\n");
+	  return SCPE_OK;
+	}
+	max_lines = 20;
+	if (desc) {
+	  max_lines = (int) get_uint ((CONST char *) desc, 10, MAX_MEM_SIZE + 1, &r);
+	  if (r != SCPE_OK) return SCPE_ARG;
+	}
+
+	/* routines on stack: inclusive up to now, outermost frame only */
+	for( i=0; i<=MAX_MEM_SIZE; i++ ) {
+	  incl_count[i] = cpu_callprof[i].incl_count;
+	  incl_time[i] = cpu_callprof[i].incl_time;
+	}
+	incl_count[CALLPROF_MAIN] = callprof_count;
+	incl_time[CALLPROF_MAIN] = callprof_time;
+	for( i=1; i<=callprof_depth; i++ ) {
+	  f = &callprof_stack[i];
+	  for( n=1; (n < i) && (callprof_stack[n].entry != f->entry); n++ ) ;
+	  if (n < i) continue;
+	  incl_count[f->entry] += callprof_count - f->count;
+	  incl_time[f->entry] += callprof_time - f->time;
+	}
+
+	n = 0;
+	for( i=0; i<=MAX_MEM_SIZE; i++ )
+	  if ((cpu_callprof[i].calls > 0) || (cpu_callprof[i].excl_count > 0)) list[n++] = i;
+	callprof_sort_key = incl_time;
+	qsort (list, n, sizeof(list[0]), callprof_compare);
+
+	if (max_lines > n) max_lines = n;
+	for( i=0; i<max_lines; i++ ) {
+	  e = &cpu_callprof[list[i]];
+	  if (list[i] == CALLPROF_MAIN) fprintf (st, "main ");
+	  else fprintf (st, "%04o ", list[i]);
+	  fprintf (st, "  calls=%-9.0f  incl: count=%-11.0f times=%-15.2f %5.1f%%   excl: count=%-11.0f times=%-15.2f %5.1f%%\n",
+	           e->calls, incl_count[list[i]], incl_time[list[i]],
+	           callprof_time > 0 ? 100.0 * incl_time[list[i]] / callprof_time : 0.0,
+	           e->excl_count, e->excl_time,
+	           callprof_time > 0 ? 100.0 * e->excl_time / callprof_time : 0.0);
+	}
+	fprintf (st, "Summary:  routines=%d  times=%.2f  count=%.0f  depth=%d  paths=%d",
+	         n, callprof_time, callprof_count, callprof_depth, callprof_nnodes);
+	if (callprof_lost) fprintf (st, "  lost calls=%u", callprof_lost);
+	fprintf (st, "\n");
+	return SCPE_OK;
+}
+
+
+
+/*
+ * Per-instruction state of the fetch/execute loop.
+ * Trace fields keep their values from one instruction to the next.
+ */
+typedef  struct cpu_loop_state {
+    PM20_DECODED_INST  di;          /* decoded instruction */
+    t_value  cmd;                   /* fetched instruction word */
+    int      ea1, ea2, ea3;         /* effective addresses */
+    int      op;                    /* opcode for profile, -1 if not profiled */
+    int      addr;                  /* instruction address for profile */
+    PM20_TRACE_REC  tr;             /* ring trace record, NULL if ring is off */
+    M20_DECODED_INST  vdi;          /* instruction read at run time (AOT) */
+    int      traced;                /* instruction passed trace filter */
+    double   old_delay;
+    int      a1, a2, a3, t_sw;      /* trace state */
+    uint16   t_ra;
+    t_value  m1, m2, m3, t_rr;
+} CPU_LOOP_STATE;
+
+
+/*
+ * Check events, bounds and breakpoints before next instruction.
+ */
+static M20_INLINE t_stat cpu_fetch_check (void)
+{
+    t_stat r;
+
+	if (sim_interval <= 0) {		/* check clock queue */
+	  r = sim_process_event ();
+	  if (r) return r;
+	  if (cpu_watch_pending)		/* device access on event */
+	    return cpu_watch_stop (SCPE_OK);
+	}
+
+	if (regKRA >= MAX_MEM_SIZE) {		/* выход за пределы памяти */
+	    return STOP_RUNOUT;			/* stop simulation */
+	}
+
+	if (sim_brk_summ &&			/* breakpoint? */
+	    sim_brk_test (regKRA, SWMASK ('E'))) {
+	    if (print_stat_on_break) print_commad_run_profile_stat();
+	    return STOP_IBKPT;			/* stop simulation */
+	}
+
+	return SCPE_OK;
+}
+
+
+/*
+ * Fetch instruction at KRA: decode, compute addresses, trace.
+ */
+static M20_INLINE void cpu_fetch_inst (PCPU_LOOP_STATE ls)
+{
+    PM20_DECODED_INST di;
+
+	ls->cmd = regRK = MOSU[regKRA];		/* get instruction */
+	di = ls->di = &cpu_decode_cache[regKRA];
+	if (!di->valid) cpu_decode_inst (di, ls->cmd);
+
+	ls->ea1 = di->a1;
+	ls->ea2 = di->a2;
+	ls->ea3 = di->a3;
+	if (di->addr_tags & 4) ls->ea1 = (ls->ea1 + regRA) & MAX_ADDR_VALUE;
+	if (di->addr_tags & 2) ls->ea2 = (ls->ea2 + regRA) & MAX_ADDR_VALUE;
+	if (di->addr_tags & 1) ls->ea3 = (ls->ea3 + regRA) & MAX_ADDR_VALUE;
+
+	ls->op = -1;
+	if (print_sys_stat || cpu_callprof) {
+	  ls->old_delay = delay;
+	  ls->op = di->op;
+	  ls->addr = regKRA;
+	}
+
+	ls->tr = NULL;
+	if (cpu_ring)
+	  ls->tr = cpu_ring_before (0);
+
+	ls->traced = 0;
+	if (sim_deb && cpu_dev.dctrl && trace_addr_map[regKRA] && cpu_trace_check (di->op)) {
+	  ls->traced = 1;
+	  trace_before_run(&ls->a1,&ls->a2,&ls->a3,&ls->t_ra,&ls->t_sw,&ls->t_rr,&ls->m1,&ls->m2,&ls->m3,0);
+	}
+
+	regKRA += 1;				/* increment RVK */
+}
+
+
+/*
+ * Fetch next instruction: check events, bounds and breakpoints, decode, trace.
+ */
+static M20_INLINE t_stat cpu_fetch (PCPU_LOOP_STATE ls)
+{
+    t_stat r;
+
+	r = cpu_fetch_check ();
+	if (r) return r;
+
+	cpu_fetch_inst (ls);
+	return SCPE_OK;
+}
+
+
+/*
+ * Count down delay of executed instructions into simulator time.
+ */
+static M20_INLINE void cpu_count_down (void)
+{
+    int ticks;
+
+	ticks = 1;
+
+	if (delay > 0)				/* delay to next instr */
+	    ticks += (int)(delay - DBL_EPSILON);
+
+	delay -= ticks;				/* count down delay */
+	sim_interval -= ticks;
+}
+
+
+/*
+ * Finish executed instruction: save state, profile and trace.
+ */
+static M20_INLINE t_stat cpu_retire_inst (PCPU_LOOP_STATE ls, t_stat r)
+{
+    int addr_tags, a1;
+    PCOMMAND_PROFILE_STAT p;
+    double instr_time;
 
-	case OPCODE_SUB_OPCS:      /* 073 = вычитание кодов операций */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-		y = (x & ~MANTISSA) - (y & ~MANTISSA);
-		goto addop;
+	if (cpu_watch_pending)
+	  r = cpu_watch_stop (r);
 
+	// save some state
+	old_trgSW = trgSW;
+	if (regRK == ls->cmd) {			/* RK not replaced by irregular command */
+	  old_opcode = ls->di->op;
+	  addr_tags = ls->di->addr_tags;
+	  a1 = ls->di->a1;
+	}
+	else {
+	  old_opcode = (int) (regRK >> BITS_36) & MAX_OPCODE_VALUE;
+	  addr_tags = regRK >> BITS_42 & MAX_ADDR_TAG_VALUE;
+	  a1 = regRK >> BITS_24 & MAX_ADDR_VALUE;
+	}
 
-	case OPCODE_SHIFT_MANTISSA_BY_ADDR:      /* 014 = сдвиг мантиссы по адресу */
-		n = (a1 & 0177) - M20_MANTISSA_SHIFT;
-		delay += 61.5 + 1.5 * (n>0 ? n : -n);
-shm:
-                y = mosu_load (a2);
-		regRR = (y & ~MANTISSA);
-		//fprintf( stderr, "n=%d y=%015lo, regRR=%015llo\n", n, y, regRR );
-		if ((n < 36) && (-n < 36)) {		//linux bugfix. 36 is mantissa length
-		    if (n >= 0) regRR |= (((y & MANTISSA) << n) & MANTISSA);
-		    else if (n < 0) regRR |= (((y & MANTISSA) >> -n) & MANTISSA);
-		}
-                //regRR &= WORD45;
-		mosu_store (a3, regRR);
-		trgSW = ((regRR & MANTISSA) == 0);
-		break;
+	/* save reg P1 state */
+	if (addr_tags & 4) a1 = (a1 + regRA) & MAX_ADDR_VALUE;
+	regP1 = MOSU[a1];
+	ls->a1 = a1;
 
-	case OPCODE_SHIFT_MANTISSA_BY_EXP:    /* 034 = сдвиг мантиссы по порядку числа */
-		n = (int) (mosu_load (a1) >> BITS_36 & 0177) - M20_MANTISSA_SHIFT;
-		delay += 24.0 + 1.5 * (n>0 ? n : -n);
-		goto shm;
+	if (ls->tr)
+	  cpu_ring_after (ls->tr, a1);
 
+	if (cpu_callprof)
+	  cpu_callprof_step (old_opcode, a1, ls->ea3, delay - ls->old_delay);
 
-	case OPCODE_SHIFT_CODE_BY_ADDR:       /* 054 = сдвиг по адресу */
-		n = (a1 & 0177) - M20_MANTISSA_SHIFT;
-		delay += 61.5 + 1.5 * (n>0 ? n : -n);
-shift:
-		if ((n < 45) && (-n < 45)) {		//linux bugfix. 45 is machine word length
-            	    regRR = mosu_load (a2);
-		    if (n > 0) regRR = (regRR << n);
-		    else if (n < 0) regRR >>= -n;
-            	    regRR &= WORD45;
-                }
-                else regRR = 0;
-		mosu_store (a3, regRR);
-		trgSW = (regRR == 0);
-		break;
+	// special check for stop codes
+	if ((r == STOP_NEGSQRT) || (r==STOP_CRBADSUM) || (r==STOP_READERR) || (r==STOP_STOP) ||
+	    (r==STOP_TAPEREADERR)) {
+	    if (regKRA > 0001) regKRA -= 1;	/* decrement RVK */
+	    regRK = MOSU[regKRA];
+	}
+	if ((r==STOP_ASSERT) || (r==STOP_NOCD) || (r == STOP_DIVMOVF) || (r==STOP_DIVZERO)) {
+	    regRK = MOSU[regKRA-1];
+	}
 
-	case OPCODE_SHIFT_CODE_BY_EXP:        /* 074 = сдвиг по порядку числа */
-		n = (int) (mosu_load (a1) >> BITS_36 & 0177) - M20_MANTISSA_SHIFT;
-		delay += 24 + 1.5 * (n>0 ? n : -n);
-		goto shift;
-
-	case OPCODE_ADD_CYCLIC:        /* 007 = циклическое сложение */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-	//cyclic_sum:
-		regRR = (x & ~MANTISSA) + (y & ~MANTISSA);
-		t = (x & MANTISSA) + (y & MANTISSA);
-		trgSW = (t & BIT37) != 0;
-                if (op == 007) {
-                  if (regRR & BIT46) regRR += BIT37;
-		  if (t & BIT37) t += 1;
-                  regRR &= WORD45;
-		}
-		if (op == 027) {
-                  if (regRR & BIT46) regRR &= ~BIT37;
-		  if (t & BIT37) t &= ~1;
-		}
-		//regRR &= WORD45;
-		regRR |= (t & MANTISSA);
-		mosu_store (a3, regRR);
-		delay += 24.0;
-		break;
+	if (print_sys_stat) {
+	  instr_time = delay - ls->old_delay;
+	  if (instr_time > 0) {
+	    p = &cmd_profile_table[ls->op];
+	    p->us_count += 1;
+	    p->us_time  += instr_time;
+	    p = &addr_profile_table[ls->addr];
+	    p->op_code = ls->op;
+	    p->us_count += 1;
+	    p->us_time  += instr_time;
+	  }
+	  if (r) {
+	    print_commad_run_profile_stat();
+	  }
+	}
 
-	case OPCODE_SUB_CYCLIC:        /* 027 = циклическое вычитание */
-		x = mosu_load (a1);
-		y = mosu_load (a2);
-#if 0
-		y = mosu_load (a2);
-		y = BIT46 - y;
-		goto cyclic_sum;
-#endif
-#if 0
-		regRR = (x & ~MANTISSA) - (y & ~MANTISSA);
-		t = (x & MANTISSA) - (y & MANTISSA);
-                trgSW = (t & BIT37) != 0;
-                //if (((x & MANTISSA) - (y & MANTISSA)) == 0) trgSW=1;
-                if (regRR & BIT46) regRR -= BIT37;
-		if (t & BIT37) t -= 1;
-		regRR &= WORD45;
-		regRR |= t & MANTISSA;
-#endif
-#if 0
-		regRR = (x & ~MANTISSA) - (y & ~MANTISSA);
-		t = (x & MANTISSA) - (y & MANTISSA);
-                if (regRR & BIT46) {
-                  regRR -= BIT37;
-                  if (t & BIT37) t -= 1;
-                  //t += BIT37;
-                  //t = -1;
-                }
-		//if (t & BIT37) t -= 1;
-#endif
-                t = BIT37 + (x & MANTISSA) - (y & MANTISSA);
-                //fprintf( stderr, "xm=%015llo ym=%015llo t=%015llo\n", x & MANTISSA, y&MANTISSA,t );
-                if (t & BIT37) t -= BIT37;
-                regRR = (x & ~MANTISSA) - (y & ~MANTISSA);
-                if (regRR & BIT46) {
-                  regRR -= BIT37;
-                  t -= 1;
-                }
-                trgSW = (t & BIT37) != 0;
-		regRR |= t & MANTISSA;
-		regRR &= WORD45;
-		mosu_store (a3, regRR);
-		delay += 24.0;
-		break;
+	if (ls->traced)
+	  trace_after_run(ls->a1,ls->a2,ls->a3,ls->t_ra,ls->t_sw,ls->t_rr,ls->m1,ls->m2,ls->m3);
 
-	case OPCODE_SHIFT_CYCLIC:      /* 067 = циклический сдвиг */
-		x = mosu_load (a1);
-                //regRR = (x & 077777777) << BITS_24 | (x >> BITS_24 & 07777777);
-                regRR = (x & 07777777)  << BITS_24 | (x >> BITS_24 & 07777777);
-		//regRR &= WORD45;
-		mosu_store (a3, regRR);
-                trgSW = (a3 == 0);
-		/* w не изменяется (неверно). */
-		//delay += 60.0;
-                delay += 24.0;
-		break;
+	if (++cpu_inst_count == cpu_inst_mark)	/* journal record or STOPAT due */
+	  r = m20_jrn_mark (r);
 
+	return r;
+}
 
 
-	/*
-         *   Control Operations
-         *   (операции управления)
-         */
+/*
+ * Finish executed instruction: save state, profile, trace and count down time.
+ */
+static M20_INLINE t_stat cpu_retire (PCPU_LOOP_STATE ls, t_stat r)
+{
+	r = cpu_retire_inst (ls, r);
+	cpu_count_down ();
 
-        case OPCODE_STOP_037:    /* 037 = останов машины, в ИТЭФ-режиме: ФА - формирование адресов */
-	if (itep_mode) {
-		t_value newcmd;
-		x = mosu_load (a1) >> BITS_12 & MAX_ADDR_VALUE;
-		y = mosu_load (a2) >> BITS_12 & MAX_ADDR_VALUE;
-		t = mosu_load (a3) >> BITS_12 & MAX_ADDR_VALUE;
-		fprintf(stderr,"itep_FA1: (A)2=%04llo, (B)2=%04llo, (C)2=%04llo\n",x,y,t);
-		newcmd=mosu_load (regKRA);
-		fprintf(stderr,"itep_FA2: updKRA=%04o, (updKRA)=%015llo\n",regKRA,newcmd);
-		x += newcmd >> BITS_24 & MAX_ADDR_VALUE;
-		x &= MAX_ADDR_VALUE;
-		y += newcmd >> BITS_12 & MAX_ADDR_VALUE;
-		y &= MAX_ADDR_VALUE;
-		t += newcmd & MAX_ADDR_VALUE;
-		t &= MAX_ADDR_VALUE;
-		fprintf(stderr,"itep_FA3: (A)2+K=%04llo, (B)2+L=%04llo, (C)2+M=%04llo\n",x,y,t);
-		regRK = newcmd & EXP_SIGN_TAG;
-		regRK |= x << BITS_24;
-		regRK |= y << BITS_12;
-		regRK |=t;
-		fprintf(stderr,"itep_FA4: regRK=%015llo\n",regRK);
-		regKRA +=1;
-		regKRA &= MAX_ADDR_VALUE;
-		err = irregular_cmd();
-		fprintf(stderr,"itep_FA5: nextKRA=%04o \n\n",regKRA);
-		if (err) return err;
-		break;
-	}
-        case OPCODE_STOP_057:    /* 057 = останов машины, в ИТЭФ-режиме: ФК - формирование команд */
-	if (itep_mode) {
-		t_value etalon_cmd_1,etalon_cmd_2,template1,k,l,m,fk_result;
-		int fk_alpha,fk_beta,fk_gamma,fk_delta,alpha1,alpha2,alpha3,k_addr,l_addr,m_addr;
-		
-		fk_alpha = (a1 & 07000) >> 9;
-		fk_beta  = (a1 & 0700) >> 6;
-		fk_gamma = (a1 & 070) >> 3;
-		fk_delta =  a1 & 07;
-		fprintf(stderr,"itep_FK1: alpha=%1d, beta=%1d, gamma=%1d, delta=%1d\n",fk_alpha,fk_beta,fk_gamma,fk_delta);
-		
-		etalon_cmd_1 = mosu_load (a2);
-		etalon_cmd_2 = mosu_load (regKRA);
-		fprintf(stderr,"itep_FK2: A2=%04o, etalon1=%015llo, updKRA=%04o, etalon2=%015llo\n",a2,etalon_cmd_1,regKRA,etalon_cmd_2);
-		
-		alpha1=!((fk_alpha & 4) >> 2) * MAX_ADDR_VALUE;
-		alpha2=!((fk_alpha & 2) >> 1) * MAX_ADDR_VALUE;
-		alpha3=! (fk_alpha & 1) * MAX_ADDR_VALUE;
-		fprintf(stderr,"itep_FK3: alpha1=%04o, alpha2=%04o, alpha3=%04o\n",alpha1,alpha2,alpha3);
-		
-		template1=combine_addreses_to_single_word(alpha1,alpha2,alpha3);
- 		etalon_cmd_1 &= template1;
-		fprintf(stderr,"itep_FK4: alpha_template=%015llo, etalon_cmd_1=%015llo\n",template1,etalon_cmd_1);
-
-		k_addr = etalon_cmd_2 >> BITS_24 & MAX_ADDR_VALUE;
-		l_addr = etalon_cmd_2 >> BITS_12 & MAX_ADDR_VALUE;
-		m_addr = etalon_cmd_2 >> BITS_0  & MAX_ADDR_VALUE;
-
-
-		k=get_fk_operand(fk_beta,k_addr);
-		l=get_fk_operand(fk_gamma,l_addr);
-		m=get_fk_operand(fk_delta,m_addr);
-		fprintf(stderr,"itep_FK5: mosu[k_addr]=%015llo, k=%04llo\n",mosu_load(k_addr),k);
-		fprintf(stderr,"itep_FK6: mosu[l_addr]=%015llo, l=%04llo\n",mosu_load(l_addr),l);
-		fprintf(stderr,"itep_FK7: mosu[m_addr]=%015llo, m=%04llo\n",mosu_load(m_addr),m);
-		
-		m += etalon_cmd_1;
-		m &= MAX_ADDR_VALUE;
-		etalon_cmd_1 >>= BITS_12;
-		l += etalon_cmd_1;
-		l &= MAX_ADDR_VALUE;
-		etalon_cmd_1 >>= BITS_12;
-		k += etalon_cmd_1;
-		k &= MAX_ADDR_VALUE;
-		fprintf(stderr,"itep_FK8: k=%04llo, l=%04llo, m=%04llo\n",k,l,m);
-
-		fk_result=combine_addreses_to_single_word((int)k,(int)l,(int)m);
-		fk_result |= (etalon_cmd_2 & EXP_SIGN_TAG);
-		fprintf(stderr,"itep_FK9: fk_result=%015llo\n",fk_result);
-		
-		regKRA +=1;
-		regKRA &= MAX_ADDR_VALUE;
-		mosu_store(a3,fk_result);
-		fprintf(stderr,"\n");
-		break;
-	}		
-        case OPCODE_STOP_017:    /* 017 = останов машины */
-	case OPCODE_STOP_077:    /* 077 = останов машины */
-		delay += 24.0;
-		regRR = 0;
-		mosu_store (a3, regRR);
-		/* Если адреса равны 0, считаем что это штатная, "хорошая" остановка. (?!) */
-		return STOP_STOP;
-
-
-	case OPCODE_CHANGE_RA_BY_ADDR :     /* 052 = установка регистра адреса адресом */
-		regRR = 052000000000000LL | (a1 << BITS_12);
-		mosu_store (a3, regRR);
-		regRA = a2;
-		//delay += 24.0;
-                delay += 28.5;
-		break;
+	if (r) return r;			/* one instr; error? */
 
-	case OPCODE_CHANGE_RA_BY_CODE :     /* 072 = установка регистра адреса числом */
-		regRR = 052000000000000LL | (a1 << BITS_12);
-		mosu_store (a3, regRR);
-		regRA = mosu_load (a2) >> BITS_12 & MAX_ADDR_VALUE;
-		//delay += 24.0;
-                delay += 28.5;
-		break;
+	if (sim_step && (--sim_step <= 0))	/* do step count */
+	   return SCPE_STOP;
 
+	return SCPE_OK;
+}
 
-	case OPCODE_JUMP_WITH_RETURN:       /* 016 = передача управления с возвратом */
-		regRR = 016000000000000LL | (a1 << BITS_12);
-		regKRA = a2;
-		mosu_store (a3, regRR);
-		delay += 24.0;
-		break;
 
-	case OPCODE_COND_JUMP_BY_SIG_W_1:   /* 036 = передача управления по условию w=1 */
-		regRR = mosu_load (a1);
-		if (trgSW) regKRA = a2;
-		mosu_store (a3, regRR);
-		delay += 24.0;
-		break;
+/*
+ * Threaded engine: fetch next instruction and test its operands.
+ */
+static t_stat cpu_enter_inst (PCPU_LOOP_STATE ls)
+{
+    t_stat r;
 
-	case OPCODE_JUMP_BY_ADDR:           /* 056 = передача управления */
-		regRR = mosu_load (a1);
-		regKRA = a2;
-		mosu_store (a3, regRR);
-		delay += 24.0;
-		break;
+	r = cpu_fetch (ls);
+	if (r) return r;
 
-	case OPCODE_COND_JUMP_BY_SIG_W_0:   /* 076 = передача управления по условию w=0 */
-		regRR = mosu_load (a1);
-		if (!trgSW) regKRA = a2;
-		mosu_store (a3, regRR);
-		delay += 24.0;
-		break;
+	if (memory_45_checking) {
+	  r = memory_45_check (ls->ea1, ls->ea2, ls->ea3, "BEFORE");
+	  if (r) return cpu_retire (ls, r);
+	}
+	return SCPE_OK;
+}
 
 
-	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_012:   /* 012 = переход по < */
-		if (regRA < (unsigned)a1) regKRA = a2;
-		regRA = a3;
-		delay += 24.0;
-		break;
+/*
+ * Threaded engine: complete executed instruction and enter the next one.
+ */
+static t_stat cpu_next_inst (PCPU_LOOP_STATE ls, t_stat r)
+{
+	if ((r == SCPE_OK) && memory_45_checking)
+	  r = memory_45_check (ls->ea1, ls->ea2, ls->ea3, "AFTER");
 
-	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_032:   /* 032 = переход по >= */
-                if (regRA >= (unsigned)a1) regKRA = a2;
-		regRA = a3;
-		delay += 24.0;
-		break;
+	r = cpu_retire (ls, r);
+	if (r) return r;
 
+	return cpu_enter_inst (ls);
+}
 
-	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_011:    /* 011 = переход по < и w=1 */
-                if (regRA < (unsigned)a1 && trgSW) regKRA = a2;
-		regRA = a3;
-		delay += 24.0;
-		break;
 
-	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_031:    /* 031 = переход по >= и w=1 */
-		if (regRA >= (unsigned)a1 && trgSW) regKRA = a2;
-		regRA = a3;
-		delay += 24.0;
-		break;
+/*
+ * Threaded-code engine.
+ * Under GCC/Clang every handler is entered through a per-opcode label table
+ * and each label has its own dispatch jump (direct threading).
+ * Other compilers call the handler stored in the decoded instruction.
+ */
+static t_stat cpu_run_threaded (PCPU_LOOP_STATE ls)
+{
+    t_stat r;
 
-	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_051:    /* 051 = переход по < и w=0 */
-                if (regRA < (unsigned)a1 && !trgSW) regKRA = a2;
-		regRA = a3;
-		delay += 24.0;
-		break;
+#if defined(__GNUC__)
+    static void * const op_label[M20_SYM_OPCODE_TABLE_SIZE] = {
+/*       0                 1                 2                 3                 4                 5                 6                 7            */
+/* 00 */ &&l_move,         &&l_add,          &&l_sub,          &&l_sub_mod,      &&l_div,          &&l_mult,         &&l_add_exp,      &&l_add_cyclic,
+/* 01 */ &&l_cards_stop,   &&l_cyc_lt_w1,    &&l_cyc_lt,       &&l_add_cmds,     &&l_shift_mant,   &&l_logical,      &&l_jump_ret,     &&l_stop,
+/* 02 */ &&l_read_panel,   &&l_add,          &&l_sub,          &&l_sub_mod,      &&l_div,          &&l_mult,         &&l_add_exp,      &&l_sub_cyclic,
+/* 03 */ &&l_cards,        &&l_cyc_ge_w1,    &&l_cyc_ge,       &&l_add_cmds,     &&l_shift_mant,   &&l_logical,      &&l_jump_w1,      &&l_stop_037,
+/* 04 */ &&l_blank_040,    &&l_add,          &&l_sub,          &&l_sub_mod,      &&l_sqrt,         &&l_mult,         &&l_add_exp,      &&l_mult_low,
+/* 05 */ &&l_io_setup,     &&l_cyc_lt_w0,    &&l_set_ra_addr,  &&l_add_opcs,     &&l_shift_code,   &&l_logical,      &&l_jump,         &&l_stop_057,
+/* 06 */ &&l_blank_060,    &&l_add,          &&l_sub,          &&l_sub_mod,      &&l_sqrt,         &&l_mult,         &&l_add_exp,      &&l_shift_cyclic,
+/* 07 */ &&l_io,           &&l_cyc_ge_w0,    &&l_set_ra_code,  &&l_add_opcs,     &&l_shift_code,   &&l_logical,      &&l_jump_w0,      &&l_stop
+    };
+
+#define THREADED_NEXT(handler)                                                  \
+    r = cpu_next_inst (ls, handler (ls->di->op, ls->ea1, ls->ea2, ls->ea3));   \
+    if (r) return r;                                                            \
+    goto *op_label[ls->di->op]
+
+    r = cpu_enter_inst (ls);
+    if (r) return r;
+    goto *op_label[ls->di->op];
+
+l_move:         THREADED_NEXT (op_move);
+l_add:          THREADED_NEXT (op_add);
+l_sub:          THREADED_NEXT (op_sub);
+l_sub_mod:      THREADED_NEXT (op_sub_mod);
+l_div:          THREADED_NEXT (op_div);
+l_mult:         THREADED_NEXT (op_mult);
+l_sqrt:         THREADED_NEXT (op_sqrt);
+l_mult_low:     THREADED_NEXT (op_mult_low);
+l_add_exp:      THREADED_NEXT (op_add_exp);
+l_add_cyclic:   THREADED_NEXT (op_add_cyclic);
+l_sub_cyclic:   THREADED_NEXT (op_sub_cyclic);
+l_shift_cyclic: THREADED_NEXT (op_shift_cyclic);
+l_read_panel:   THREADED_NEXT (op_read_panel);
+l_blank_040:    THREADED_NEXT (op_blank_040);
+l_blank_060:    THREADED_NEXT (op_blank_060);
+l_logical:      THREADED_NEXT (op_logical);
+l_add_cmds:     THREADED_NEXT (op_add_cmds);
+l_add_opcs:     THREADED_NEXT (op_add_opcs);
+l_shift_mant:   THREADED_NEXT (op_shift_mantissa);
+l_shift_code:   THREADED_NEXT (op_shift_code);
+l_stop:         THREADED_NEXT (op_stop);
+l_stop_037:     THREADED_NEXT (op_stop_037);
+l_stop_057:     THREADED_NEXT (op_stop_057);
+l_set_ra_addr:  THREADED_NEXT (op_set_ra_by_addr);
+l_set_ra_code:  THREADED_NEXT (op_set_ra_by_code);
+l_jump_ret:     THREADED_NEXT (op_jump_with_return);
+l_jump_w1:      THREADED_NEXT (op_jump_w1);
+l_jump:         THREADED_NEXT (op_jump);
+l_jump_w0:      THREADED_NEXT (op_jump_w0);
+l_cyc_lt:       THREADED_NEXT (op_cycle_lt);
+l_cyc_ge:       THREADED_NEXT (op_cycle_ge);
+l_cyc_lt_w1:    THREADED_NEXT (op_cycle_lt_w1);
+l_cyc_ge_w1:    THREADED_NEXT (op_cycle_ge_w1);
+l_cyc_lt_w0:    THREADED_NEXT (op_cycle_lt_w0);
+l_cyc_ge_w0:    THREADED_NEXT (op_cycle_ge_w0);
+l_cards_stop:   THREADED_NEXT (op_input_cards_with_stop);
+l_cards:        THREADED_NEXT (op_input_cards);
+l_io_setup:     THREADED_NEXT (op_ext_io_setup);
+l_io:           THREADED_NEXT (op_ext_io);
+
+#undef THREADED_NEXT
+#else
+    r = cpu_enter_inst (ls);
+    while (r == SCPE_OK)
+      r = cpu_next_inst (ls, ls->di->handler (ls->di->op, ls->ea1, ls->ea2, ls->ea3));
+    return r;
+#endif
+}
 
-	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_071:    /* 071 = переход по >= и w=0 */
-		if (regRA >= (unsigned)a1 && !trgSW) regKRA = a2;
-		regRA = a3;
-		delay += 24.0;
-		break;
 
+/*
+ * Drop predecoded instruction and basic and translated blocks containing given word.
+ */
+static void cpu_invalidate (int addr)
+{
+    int start;
 
+	if (cpu_aot_cover[addr]) cpu_aot_drop (addr);
 
-	/*
-         *   Input/Output Operations
-         *   (операции обмена между накопителями)
-         */
+	if (!cpu_decode_cache[addr].valid) return;	/* not fetched as instruction */
+	cpu_decode_cache[addr].valid = 0;
 
-	case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS_WITH_STOP:   /* 010 = ввод с перфокарт */
-                cr_io_addr_1 = a1;
-                cr_io_addr_2 = a2;
-                cr_io_addr_3 = a3;
-                cdr_csum = 0;
-                cdr_rsum = 0;
-                cdr_rcodes = 0;
-                cdr_stop_blocking = 0;
-                cdr_control_blocking = 0;
-                if (sim_deb && cpu_dev.dctrl)
-	            fprintf (sim_deb, "cpu: opcode=10: regKRA=%d,a1=%d,a2=%d,a3=%d\n", regKRA,a1,a2,a3);
-                /* check for boot operation request from card reader device */
-                if (boot_device_req_cdr) {
-                   if (sim_deb && cpu_dev.dctrl) fprintf (sim_deb, "cpu: cdr boot detected. Set regKRA=%d\n", a1);
-                   regKRA = a1;
-                   boot_device_req_cdr = 0;
-                }
-                err = read_card(&cdr_csum,&cdr_rsum,&cdr_rcodes,&cdr_stop_blocking,&cdr_control_blocking);
-		if (err) {
-		    if (err == STOP_CRBADSUM) {
-		      /* A1 must contain last address code of input */
-		    }
-                    return err;
-                }
-		delay += (50000*cdr_rcodes);
-		if (cdr_control_blocking) goto store_chksum;
-		if (cdr_stop_blocking) {
-                  regKRA = a2;
-                  goto store_chksum;
-		}
-		if (cdr_csum != cdr_rsum) {
-		  regKRA = a2;
-                  return STOP_CRBADSUM;
-                }
-             store_chksum:
-		mosu_store (a3, cdr_csum);
-		break;
+	for (start = addr; (start >= 0) && (start > addr - CPU_BLOCK_MAX); start--) {
+	  if (cpu_block_len[start] > addr - start) cpu_block_len[start] = 0;
+	}
+}
 
-	case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS:   /* 030 = ввод с перфокарт останова после проверки к.суммы */
-                cr_io_addr_1 = a1;
-                cr_io_addr_2 = a2;
-                cr_io_addr_3 = a3;
-                cdr_csum = 0;
-                cdr_rsum = 0;
-                cdr_rcodes = 0;
-                cdr_stop_blocking = 0;
-                cdr_control_blocking = 0;
-                if (sim_deb && cpu_dev.dctrl)
-	            fprintf (sim_deb, "cpu: opcode=30: regKRA=%d,a1=%d,a2=%d,a3=%d\n", regKRA,a1,a2,a3);
-                err = read_card(&cdr_csum,&cdr_rsum,&cdr_rcodes,&cdr_stop_blocking,&cdr_control_blocking);
-		if (err) return err;
-		delay += (50000*cdr_rcodes);
-		if (cdr_control_blocking) goto store_chksum_30;
-		if (cdr_csum != cdr_rsum) {
-		  regKRA = a2;
-                }
-             store_chksum_30:
-		mosu_store (a3, cdr_csum);
-		break;
 
+/*
+ * Check for instruction ending basic block:
+ * 1 - block ends after it, 2 - it makes a block by itself
+ * (I/O runs with simulator time counted down).
+ */
+static int cpu_block_end (int op)
+{
+	switch (op) {
+	case OPCODE_JUMP_WITH_RETURN:
+	case OPCODE_JUMP_BY_ADDR:
+	case OPCODE_COND_JUMP_BY_SIG_W_1:
+	case OPCODE_COND_JUMP_BY_SIG_W_0:
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_012:
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_032:
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_011:
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_031:
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_051:
+	case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_071:
+	case OPCODE_STOP_017:
+	case OPCODE_STOP_037:
+	case OPCODE_STOP_057:
+	case OPCODE_STOP_077:
+		return 1;
+	case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS_WITH_STOP:
+	case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS:
+	case OPCODE_IO_EXT_DEV_TO_MEM_050:
+	case OPCODE_IO_EXT_DEV_TO_MEM_070:
+		return 2;
+	}
+	return 0;
+}
 
-	case OPCODE_IO_EXT_DEV_TO_MEM_050:  /* 050 = подготовка обращения к внешнему устройству */
-		err = ext_io_setup (a1, a2, a3);
-		if (err) return err;
-		delay += 24.0;
-		break;
 
-	case OPCODE_IO_EXT_DEV_TO_MEM_070:  /* 070 = выполнение обращения к внешнему устройству */
-                if (sim_deb && cpu_dev.dctrl)
-	             fprintf (sim_deb, "cpu: ext_io_op=%04o\n", ext_io_op);
-		if (ext_io_op == MAX_ADDR_VALUE) return STOP_IO_MISSING_SETUP;
-		err = ext_io_operation (a1, &regRR);
-                if (a3) mosu_store (a3, regRR);
-		if (err) {
-		   if (err == STOP_READERR) {
-		       /* A1 must contain last location address of successful input */
-		   }
-		   if (err == STOP_TAPEREADERR) {
-		       /* A1 must contain last zone number of successful input */
-		   }
-		   if (err != STOP_READERR || !(ext_io_op & EXT_DIS_STOP)) return err;
-		   if (ext_io_op & (EXT_PUNCH|EXT_PRINT)) goto skip_done;
-		   if (a2) regKRA = a2;
-		  skip_done: ;
-		}
-		delay += 24.0;
-		break;
+/*
+ * Find basic block started at given address, decode its instructions.
+ */
+static int cpu_build_block (int start)
+{
+    int addr, len, end;
+    PM20_DECODED_INST di;
+
+	len = 0;
+	for (addr = start; addr < MAX_MEM_SIZE; addr++) {
+	  if ((len > 0) && sim_brk_summ && sim_brk_fnd (addr))
+	    break;				/* breakpoint starts new block */
+	  di = &cpu_decode_cache[addr];
+	  if (!di->valid) cpu_decode_inst (di, MOSU[addr]);
+	  end = cpu_block_end (di->op);
+	  if ((len > 0) && (end == 2))
+	    break;
+	  len++;
+	  if (end || (len >= CPU_BLOCK_MAX))
+	    break;
 	}
+	cpu_block_len[start] = (uint8) len;
+	return len;
+}
 
 
-	/* test for memory contents overflow */
-	if (memory_45_checking) {
-	  t = mosu_load(a1);
-	  if (t & ~WORD45) {
-            if (sim_deb && cpu_dev.dctrl)
-	      fprintf (sim_deb, "cpu: OVERFLOW AFTER: a1: t[%04o]=%018llo, t=%018llo\n", a1, t, t & ~WORD45 );
-            return STOP_MEMORY_GARBAGE_DETECTED;
-          }
-	  t = mosu_load(a2);
-	  if (t & ~WORD45) {
-            if (sim_deb && cpu_dev.dctrl)
-	      fprintf (sim_deb, "cpu: OVERFLOW AFTER: a2: t[%04o]=%018llo, t=%018llo\n", a2, t, t & ~WORD45  );
-            return STOP_MEMORY_GARBAGE_DETECTED;
-          }
-	  t = mosu_load(a3);
-	  if (t & ~WORD45) {
-            if (sim_deb && cpu_dev.dctrl)
-	      fprintf (sim_deb, "cpu: OVERFLOW AFTER: a3: t[%04o]=%018llo, t=%018llo\n", a3, t, t & ~WORD45  );
-            return STOP_MEMORY_GARBAGE_DETECTED;
-          }
-        }
-
-	//ext_io_op = MAX_ADDR_VALUE;
+/*
+ * Run instructions from KRA until control comes to ret, at most max of them
+ * (HLE, m20_hle.c). No events, breakpoints, trace or profile; I/O is refused.
+ * Time is left in delay, the caller counts it down.
+ */
+t_stat cpu_run_routine (int ret, long max)
+{
+    M20_DECODED_INST di;
+    t_stat r;
 
-	return SCPE_OK;
+	for ( ; max > 0; max--) {
+	  if (regKRA == ret) return SCPE_OK;
+	  if (regKRA >= MAX_MEM_SIZE) return STOP_RUNOUT;
+	  regRK = MOSU[regKRA];
+	  cpu_decode_inst (&di, regRK);
+	  if (cpu_block_end (di.op) == 2) return SCPE_NOFNC;
+	  regKRA += 1;
+	  r = cpu_exec_inst (&di);
+	  if (r) return r;
+	}
+	return (regKRA == ret) ? SCPE_OK : SCPE_INCOMP;
 }
 
 
-
-void print_commad_run_profile_stat(void)
+/*
+ * Put saved MOSU back, changed words only (HLE verify).
+ */
+void cpu_mosu_restore (const t_value * mem)
 {
-   int i, op;
-   double sum_time, sum_count;
+    int addr;
 
-   printf("\n*** Command time profile stat ***\n");
-   sum_time = sum_count = 0;
-   for( i=0; i<M20_SYM_OPCODE_TABLE_SIZE; i++ ) {
-       op = cmd_profile_table[i].op_code;
-       if (cmd_profile_table[i].us_count > 0) {
-         sum_time += cmd_profile_table[i].us_time;
-         sum_count += cmd_profile_table[i].us_count;
-         printf("opcode=%02o   count=%-9.0f  times=%-15.2f  avg_time=%-15.2f   (%s)\n",
-                 op, cmd_profile_table[i].us_count, cmd_profile_table[i].us_time,
-                 cmd_profile_table[i].us_time/cmd_profile_table[i].us_count, m20_opname[i] );
-       }
-   }
-   printf("Summary:  times=%.2f  count=%.0f  avg_time=%.2f\n", sum_time, sum_count, sum_time/sum_count );
-   printf("**********\n\n");
+	for (addr = 0; addr < MAX_MEM_SIZE; addr++)
+	  if (MOSU[addr] != mem[addr]) mosu_write (addr, mem[addr]);
 }
 
 
-
 /*
- * Main instruction fetch/decode loop
+ * Run basic block started at KRA.
  */
-t_stat sim_instr (void)
+static t_stat cpu_exec_block (PCPU_LOOP_STATE ls)
 {
     t_stat r;
-    int ticks;
-    int addr_tags, a1, a2, a3, t_sw, op, i;
-    uint16 t_ra;
-    t_value m1,m2,m3,t_rr;
-    double old_delay, instr_time;
+    int left, count;
+    uint16 next;
+    double limit, before, d;
+
+	left = cpu_block_len[regKRA];
+	if (left == 0) left = cpu_build_block (regKRA);
+
+	limit = sim_interval - 1;		/* delay giving sim_interval <= 0 */
+	count = 0;
+	do {
+	  next = regKRA + 1;
+	  before = delay;
+	  cpu_fetch_inst (ls);
+	  count++;
+
+	  r = SCPE_OK;
+	  if (memory_45_checking)
+	    r = memory_45_check (ls->ea1, ls->ea2, ls->ea3, "BEFORE");
+	  if (r == SCPE_OK) {
+	    r = ls->di->handler (ls->di->op, ls->ea1, ls->ea2, ls->ea3);
+	    if ((r == SCPE_OK) && memory_45_checking)
+	      r = memory_45_check (ls->ea1, ls->ea2, ls->ea3, "AFTER");
+	  }
+
+	  r = cpu_retire_inst (ls, r);
+	} while ((r == SCPE_OK) && (--left > 0) && (regKRA == next) &&
+		 (delay - before >= 1.0) && (delay > 0) && (delay <= limit));
+
+	/* count down block, last instruction separately */
+	d = delay - before;
+	if (count > 1) {
+	  delay = before;
+	  cpu_count_down ();
+	  delay += d;
+	}
+	cpu_count_down ();
 
-    /* Restore register state */
-    regKRA = regKRA & MAX_ADDR_VALUE;	        /* mask KRA */
-    sim_cancel_step ();				/* defang SCP step */
-    delay = 0;
+	return r;
+}
+
+
+/*
+ * Basic-block engine.
+ * Events, bounds and breakpoints are checked at block entry only,
+ * and delay is counted down once per block: while every instruction
+ * takes at least one tick this gives the same simulator time as
+ * per-instruction count down.  Block is left early on stop, jump,
+ * short delay, or when clock queue becomes due.
+ * Tracing and stepping run one instruction at a time.
+ */
+static t_stat cpu_run_block (PCPU_LOOP_STATE ls)
+{
+    t_stat r;
 
-    /* Main instruction fetch/decode loop */
     for (;;) {
-	if (sim_interval <= 0) {		/* check clock queue */
-  	  r = sim_process_event ();
-	 if (r) return r;
+	if (sim_step || (sim_deb && cpu_dev.dctrl)) {
+	  r = cpu_fetch (ls);
+	  if (r) return r;
+	  r = cpu_retire (ls, cpu_exec_inst (ls->di));
+	  if (r) return r;
+	  continue;
 	}
 
-	if (regKRA >= MAX_MEM_SIZE) {		/* выход за пределы памяти */
-            return STOP_RUNOUT;			/* stop simulation */
-	}
+	r = cpu_fetch_check ();
+	if (r) return r;
 
-	if (sim_brk_summ &&			/* breakpoint? */
-	    sim_brk_test (regKRA, SWMASK ('E'))) {
-            if (print_stat_on_break) print_commad_run_profile_stat();
-	    return STOP_IBKPT;			/* stop simulation */
-	}
+	r = cpu_exec_block (ls);
+	if (r) return r;
+    }
+}
 
-	regRK = MOSU[regKRA];				/* get instruction */
 
-	op = -1;
-	if (print_sys_stat) {
-          old_delay = delay;
-          op = regRK >> BITS_36 & MAX_OPCODE_VALUE;
+/*
+ * Translated block: instructions are run as by cpu_exec_block, with
+ * addresses and handlers fixed by m20aot.
+ *
+ *   AOT_INST (addr, i, op, ea1, ea2, ea3)   instruction as translated
+ *   AOT_VINST (addr, i, op, tags)           instruction read from MOSU,
+ *                                           blocks are dropped if its opcode
+ *                                           or tags are changed
+ *
+ * Store into a word of the running block drops it (cpu_invalidate), then
+ * the block is left after that instruction and the rest is interpreted.
+ */
+#define AOT_RA(a)       (((a) + regRA) & MAX_ADDR_VALUE)
+
+#define AOT_BEGIN(tab)                                                  \
+    const M20_DECODED_INST * const di_tab = (tab);                      \
+    t_stat r = SCPE_OK;                                                 \
+    int count = 0;                                                      \
+    double limit = sim_interval - 1, before = delay, d;                 \
+    const int start = regKRA;                                           \
+    ls->tr = NULL;                                                      \
+    ls->traced = 0
+
+#define AOT_EXEC(ad, oc)                                                \
+    before = delay;                                                     \
+    ls->cmd = regRK = MOSU[ad];                                         \
+    ls->op = -1;                                                        \
+    if (print_sys_stat || cpu_callprof) {                               \
+      ls->old_delay = delay;                                            \
+      ls->op = (oc);                                                    \
+      ls->addr = (ad);                                                  \
+    }                                                                   \
+    regKRA = (ad) + 1;                                                  \
+    count++;                                                            \
+    r = SCPE_OK;                                                        \
+    if (memory_45_checking)                                             \
+      r = memory_45_check (ls->ea1, ls->ea2, ls->ea3, "BEFORE");        \
+    if (r == SCPE_OK) {                                                 \
+      r = cpu_op_handler[oc] ((oc), ls->ea1, ls->ea2, ls->ea3);         \
+      if ((r == SCPE_OK) && memory_45_checking)                         \
+        r = memory_45_check (ls->ea1, ls->ea2, ls->ea3, "AFTER");       \
+    }                                                                   \
+    r = cpu_retire_inst (ls, r);                                        \
+    if ((r != SCPE_OK) || (regKRA != (ad) + 1) ||                       \
+        (delay - before < 1.0) || (delay <= 0) || (delay > limit) ||    \
+        !cpu_aot_valid[start])          /* store into this block */     \
+      goto aot_done
+
+#define AOT_INST(ad, i, oc, e1, e2, e3)                                 \
+    ls->di = (PM20_DECODED_INST) &di_tab[i];                            \
+    ls->ea1 = (e1);                                                     \
+    ls->ea2 = (e2);                                                     \
+    ls->ea3 = (e3);                                                     \
+    AOT_EXEC (ad, oc)
+
+#define AOT_VINST(ad, i, oc, tg)                                        \
+    if ((int)(MOSU[ad] >> BITS_36 & 0777) != (((tg) << 6) | (oc))) {    \
+      cpu_aot_drop (ad);                                                \
+      goto aot_done;                                                    \
+    }                                                                   \
+    cpu_decode_inst (&ls->vdi, MOSU[ad]);                               \
+    ls->di = &ls->vdi;                                                  \
+    ls->ea1 = ((tg) & 4) ? AOT_RA (ls->vdi.a1) : ls->vdi.a1;            \
+    ls->ea2 = ((tg) & 2) ? AOT_RA (ls->vdi.a2) : ls->vdi.a2;            \
+    ls->ea3 = ((tg) & 1) ? AOT_RA (ls->vdi.a3) : ls->vdi.a3;            \
+    AOT_EXEC (ad, oc)
+
+#define AOT_END                                                         \
+aot_done:                                                               \
+    (void) di_tab;                                                      \
+    if (count == 0) return r;           /* dropped at first word */     \
+    d = delay - before;                                                 \
+    if (count > 1) {                                                    \
+      delay = before;                                                   \
+      cpu_count_down ();                                                \
+      delay += d;                                                       \
+    }                                                                   \
+    cpu_count_down ();                                                  \
+    return r
+
+#if defined(M20_AOT_FILE)
+#include M20_AOT_FILE
+
+static const int cpu_aot_count = sizeof(cpu_aot_table) / sizeof(cpu_aot_table[0]);
+#else
+static const M20_AOT_BLOCK cpu_aot_table[1] = { { 0 } };
+static const int cpu_aot_count = 0;
+#endif
+
+
+/*
+ * SET CPU AOT: only in emulator with translated program
+ */
+t_stat cpu_set_aot (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+	if (cptr) return SCPE_ARG;
+	if (cpu_aot_count == 0)
+	  return sim_messagef (SCPE_NOFNC, "No translated program: build m20x with AOT=file from m20aot\n");
+	return SCPE_OK;
+}
+
+
+/*
+ * Map translated blocks on memory, to be checked on entry.
+ */
+static void cpu_aot_init (void)
+{
+    int i, j;
+    const M20_AOT_BLOCK * b;
+
+	memset (cpu_aot_at, 0, sizeof(cpu_aot_at));
+	memset (cpu_aot_valid, 0, sizeof(cpu_aot_valid));
+	memset (cpu_aot_cover, 0, sizeof(cpu_aot_cover));
+	for (i = 0; i < cpu_aot_count; i++) {
+	  b = &cpu_aot_table[i];
+	  cpu_aot_at[b->start] = (uint16)(i + 1);
+	  for (j = 0; j < b->len; j++)
+	    if (!(b->vmask >> j & 1)) cpu_aot_cover[b->start + j] = 1;
 	}
+}
 
-	trace_before_run(&a1,&a2,&a3,&t_ra,&t_sw,&t_rr,&m1,&m2,&m3,0);
 
-	regKRA += 1;				/* increment RVK */
+/*
+ * Check translated block against MOSU and breakpoints.
+ */
+static int cpu_aot_check (const M20_AOT_BLOCK * b)
+{
+    int i;
+    t_value mask;
+
+	for (i = 0; i < b->len; i++) {
+	  mask = (b->vmask >> i & 1) ? ~(t_value)0777777777777LL : ~(t_value)0;
+	  if ((MOSU[b->start + i] ^ b->code[i]) & mask)
+	    return 0;
+	  if ((i > 0) && sim_brk_summ && sim_brk_fnd (b->start + i))
+	    return 0;
+	}
+	cpu_aot_valid[b->start] = 1;
+	return 1;
+}
 
-	if (0) fprintf( stderr, "regKRA=%04o\n", regKRA );
-	r = cpu_one_inst ();
-	//if (r) return r;			/* one instr; error? */
-	if (0) fprintf( stderr, "regKRA=%04o\n", regKRA );
 
-	// save some state
-        old_trgSW = trgSW;
-        old_opcode = (int) (regRK >> BITS_36) & MAX_OPCODE_VALUE;
+/*
+ * Drop translated blocks containing given word.
+ */
+static void cpu_aot_drop (int addr)
+{
+    int start, i;
 
-	/* save reg P1 state */
-	addr_tags = regRK >> BITS_42 & MAX_ADDR_TAG_VALUE;
-	a1 = regRK >> BITS_24 & MAX_ADDR_VALUE;
-	if (addr_tags & 4) a1 = (a1 + regRA) & MAX_ADDR_VALUE;
-        regP1 = MOSU[a1];
-        //fprintf( stderr, "1: P1=%015llo\n", regP1 );
+	for (start = addr; (start >= 0) && (start > addr - CPU_BLOCK_MAX); start--) {
+	  i = cpu_aot_at[start];
+	  if (i && (cpu_aot_table[i - 1].len > addr - start)) cpu_aot_valid[start] = 0;
+	}
+}
 
-	// special check for stop codes
-        if ((r == STOP_NEGSQRT) || (r==STOP_CRBADSUM) || (r==STOP_READERR) || (r==STOP_STOP) ||
-            (r==STOP_TAPEREADERR)) {
-            if (regKRA > 0001) regKRA -= 1;	/* decrement RVK */
-            regRK = MOSU[regKRA];
-        }
-        if ((r==STOP_ASSERT) || (r==STOP_NOCD) || (r == STOP_DIVMOVF) || (r==STOP_DIVZERO)) {
-            //regKRA -= 1;	/* decrement RVK */
-            regRK = MOSU[regKRA-1];
-        }
 
+/*
+ * AOT engine.
+ * As basic-block engine, but block which is translated and matches MOSU
+ * runs translated code. Other blocks, ring trace, tracing and stepping
+ * are interpreted.
+ */
+static t_stat cpu_run_aot (PCPU_LOOP_STATE ls)
+{
+    t_stat r;
+    int i;
 
-	if (print_sys_stat) {
-          instr_time = delay - old_delay;
-          if (instr_time > 0) {
-            for( i=0; i<M20_SYM_OPCODE_TABLE_SIZE; i++ ) {
-              if (cmd_profile_table[i].op_code == op) {
-                  cmd_profile_table[i].us_count += 1;
-                  cmd_profile_table[i].us_time  += instr_time;
-                  break;
-              }
-            }
-          }
-          if (r) {
-            print_commad_run_profile_stat();
-          }
+    for (;;) {
+	if (sim_step || (sim_deb && cpu_dev.dctrl)) {
+	  r = cpu_fetch (ls);
+	  if (r) return r;
+	  r = cpu_retire (ls, cpu_exec_inst (ls->di));
+	  if (r) return r;
+	  continue;
 	}
 
-	trace_after_run(a1,a2,a3,t_ra,t_sw,t_rr,m1,m2,m3);
+	r = cpu_fetch_check ();
+	if (r) return r;
 
-	//getchar();
+	i = cpu_aot_at[regKRA];
+	if (i && !cpu_ring && (cpu_aot_valid[regKRA] || cpu_aot_check (&cpu_aot_table[i - 1])))
+	  r = cpu_aot_table[i - 1].func (ls);
+	else
+	  r = cpu_exec_block (ls);
+	if (r) return r;
+    }
+}
 
-	ticks = 1;
 
-	if (delay > 0)				/* delay to next instr */
-	    //ticks += delay - DBL_EPSILON;
-	    ticks += (int)(delay - DBL_EPSILON);
+/*
+ * Main instruction fetch/decode loop
+ */
+t_stat sim_instr (void)
+{
+    t_stat r;
+    CPU_LOOP_STATE ls;
 
-	delay -= ticks;				/* count down delay */
-	sim_interval -= ticks;
+    /* Restore register state */
+    regKRA = regKRA & MAX_ADDR_VALUE;	        /* mask KRA */
+    sim_cancel_step ();				/* defang SCP step */
+    delay = 0;
+    memset (&ls, 0, sizeof(ls));
+    memset (cpu_idle_tab, 0xff, sizeof(cpu_idle_tab));	/* RPU may be changed */
+    cpu_watch_pending = 0;
+    cpu_trace_map_build ();			/* DISABLE_*_TRACE may be changed */
+    if (m20_jrn_mode) {
+      r = m20_jrn_run ();			/* changes of SCP since last stop */
+      if (r) return r;
+    }
 
-        if (r) return r;			/* one instr; error? */
+    if ((cpu_unit.flags & UNIT_ENGINE) == UNIT_ENG_THREADED)
+      r = cpu_run_threaded (&ls);
 
-	if (sim_step && (--sim_step <= 0))	/* do step count */
-	   return SCPE_STOP;
+    else if ((cpu_unit.flags & UNIT_ENGINE) == UNIT_ENG_BLOCK) {
+      memset (cpu_block_len, 0, sizeof(cpu_block_len));	/* breakpoints may be changed */
+      r = cpu_run_block (&ls);
+    }
+
+    else if ((cpu_unit.flags & UNIT_ENGINE) == UNIT_ENG_AOT) {
+      memset (cpu_block_len, 0, sizeof(cpu_block_len));
+      cpu_aot_init ();				/* blocks are checked on entry */
+      r = cpu_run_aot (&ls);
     }
 
+    /* Main instruction fetch/decode loop */
+    else for (;;) {
+	r = cpu_fetch (&ls);
+	if (r) break;
+
+	r = cpu_exec_inst (ls.di);
+
+	r = cpu_retire (&ls, r);
+	if (r) break;
+    }
+
+    /* writes behind are done before CPU stops */
+    if (m20_aio_flush () != SCPE_OK)
+      r = SCPE_IOERR;
+
+    if (m20_jrn_mode)
+      m20_jrn_stop ();
+
+    /* post-mortem trace of stopped program */
+    if (cpu_ring && cpu_ring_file[0] && (r < SCPE_BASE) && (r != STOP_IBKPT))
+      cpu_ring_write (cpu_ring_file);
+    if (cpu_callprof && cpu_callprof_file[0])
+      cpu_callprof_write (cpu_callprof_file);
+
+    return r;
 }
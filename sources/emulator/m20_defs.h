@@ -155,6 +155,31 @@
 /* CPU options, stored in cpu_unit.flags */
 
 #define SHORT_SYM_OP          (1 << (UNIT_V_UF + 0))          /* short symbolic instruction name */
+#define UNIT_V_ENGINE         (UNIT_V_UF + 1)                 /* execution engine */
+#define UNIT_ENGINE           (3 << UNIT_V_ENGINE)
+#define UNIT_ENG_SWITCH       (0 << UNIT_V_ENGINE)            /* switch interpreter (reference) */
+#define UNIT_ENG_THREADED     (1 << UNIT_V_ENGINE)            /* threaded code, per-opcode handlers */
+#define UNIT_ENG_BLOCK        (2 << UNIT_V_ENGINE)            /* basic blocks of predecoded instructions */
+#define UNIT_ENG_AOT          (3 << UNIT_V_ENGINE)            /* blocks translated by m20aot */
+#define UNIT_V_IDLELOOP       (UNIT_V_UF + 3)                 /* idle loop detection */
+#define UNIT_IDLELOOP         (3 << UNIT_V_IDLELOOP)
+#define UNIT_IDLE_OFF         (0 << UNIT_V_IDLELOOP)          /* run loops as is */
+#define UNIT_IDLE_STOP        (1 << UNIT_V_IDLELOOP)          /* stop with STOP_IDLE */
+#define UNIT_IDLE_SKIP        (2 << UNIT_V_IDLELOOP)          /* skip time to next event */
+#define UNIT_V_HLE            (UNIT_V_UF + 5)                 /* native library routines */
+#define UNIT_HLE              (3 << UNIT_V_HLE)
+#define UNIT_HLE_OFF          (0 << UNIT_V_HLE)               /* interpret everything */
+#define UNIT_HLE_ON           (1 << UNIT_V_HLE)               /* native code for registered routines */
+#define UNIT_HLE_VERIFY       (2 << UNIT_V_HLE)               /* native and interpreted, compared */
+
+/* Force inlining of the hot fetch/retire helpers of the instruction loop */
+#if defined(__GNUC__)
+#define M20_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define M20_INLINE __forceinline
+#else
+#define M20_INLINE SIM_INLINE
+#endif
 
 
 /*
@@ -265,19 +290,19 @@ enum {
 	STOP_READERR,				/* drum read error */
 	STOP_BADRLEN,				/* invalid drum read length */
 	STOP_BADWLEN,				/* invalid drum write length */
-	STOP_WRERR,				/* drum write error error */
-	STOP_DRUMINVAL,				/* invalid drum control word */
+	STOP_WATCH,				/* MOSU watchpoint */
+	STOP_ICOUNT,				/* instruction count reached */
 	STOP_DRUMINVDATA,			/* reading uninialized drum data */
-	STOP_TAPEINVAL,				/* invalid tape control word */
+	STOP_REPLAY,				/* run differs from replayed journal */
 	STOP_TAPEFMTINVAL,			/* invalid tape format word */
 	STOP_TAPEUNSUPP,			/* tape not implemented */
 	STOP_TAPEFMTUNSUPP,			/* tape formatting not implemented */
 	STOP_PUNCHUNSUPP,			/* punch not implemented */
-	STOP_RPUNCHUNSUPP,			/* punch reader not implemented */
+	STOP_HLEVERIFY,				/* HLE routine differs from interpreter */
 	STOP_EXTINVAL,				/* invalid control word */
 	STOP_INVARG,				/* invalid argument of instruction */
 	STOP_ASSERT,				/* assertion failed */
-	STOP_MBINVAL,				/* MB command without MA */
+	STOP_IDLE,				/* idle loop, no effects */
 	STOP_EXTDEVIOUNSUPP,			/* external devices i/o not implemented */
         STOP_NOCD,                              /* no cards left */
         STOP_CRINVAL,                           /* CR instruction without CA */
@@ -316,6 +341,207 @@ enum {
 };
 
 
+/*
+ * Binary CPU trace (ring buffer of executed instructions).
+ * File: M20_TRACE_HDR followed by count records, oldest first.
+ */
+#define M20_TRACE_MAGIC      "M20TRACE"
+#define M20_TRACE_VERSION    1
+
+#define M20_TRACE_IRREG      1                  /* instruction executed by RK (write to 07777) */
+
+typedef struct m20_trace_hdr {
+    char     magic[8];
+    uint32   version;
+    uint32   rec_size;                          /* sizeof(M20_TRACE_REC) */
+    uint32   count;                             /* records in file */
+    uint32   reserved;
+} M20_TRACE_HDR;
+
+typedef struct m20_trace_rec {
+    t_value  rk;                                /* instruction */
+    t_value  rr, rr_after;                      /* result register before/after */
+    t_value  m[3];                              /* operands before execution */
+    t_value  m_after[3];                        /* operands after execution */
+    uint16   kra;                               /* instruction address */
+    uint16   ra, ra_after;                      /* address register before/after */
+    uint16   a[3];                              /* operand addresses before execution */
+    uint16   a1_after;                          /* first operand address after execution */
+    uint8    sw, sw_after;                      /* signal w before/after */
+    uint8    flags;
+    uint8    reserved[5];
+} M20_TRACE_REC, * PM20_TRACE_REC;
+
+
+/*
+ * Binary memory image (LOAD -B, DUMP -B, m20img).
+ * File: M20_IMAGE_HDR, ranges (M20_IMAGE_RANGE followed by count words),
+ * then with M20_IMAGE_REGS flag count and values of CPU registers
+ * in order of cpu_reg[] (KRA, RK, ROP, RA, SMA, SW, RR, RPU1-RPU4).
+ */
+#define M20_IMAGE_MAGIC      "M20IMAGE"
+#define M20_IMAGE_VERSION    1
+
+#define M20_IMAGE_REGS       1                  /* CPU registers follow ranges */
+#define M20_IMAGE_REG_COUNT  11
+#define M20_IMAGE_GAP        4                  /* zero words kept inside range */
+
+typedef struct m20_image_hdr {
+    char     magic[8];
+    uint32   version;
+    uint32   flags;
+    uint32   start;                             /* start address (@) */
+    uint32   ranges;                            /* ranges in file */
+} M20_IMAGE_HDR;
+
+typedef struct m20_image_range {
+    uint32   addr;                              /* first address */
+    uint32   count;                             /* words */
+} M20_IMAGE_RANGE;
+
+
+/*
+ * Compiled card deck (ATTACH -C CDR), cached in file <deck>.cdc:
+ * M20_CARD_HDR followed by count records, one per line read from deck.
+ */
+#define M20_CARD_MAGIC       "M20CARDS"
+#define M20_CARD_VERSION     1
+#define M20_CARD_EXT         ".cdc"
+
+typedef struct m20_card_hdr {
+    char     magic[8];
+    uint32   version;
+    uint32   flags;                             /* CDR unit flags (EXTFMT) */
+    t_uint64 size;                              /* deck file size */
+    t_int64  mtime;                             /* deck file time */
+    t_uint64 hash;                              /* FNV-1a of deck file */
+    uint32   count;                             /* records in file */
+    uint32   reserved;
+} M20_CARD_HDR;
+
+typedef struct m20_card_rec {
+    t_value  code;                              /* word of card */
+    uint32   pos;                               /* deck position after line */
+    int32    status;                            /* format error of line */
+    int8     main_marker, aux_marker;           /* -1: comment or empty line */
+    uint8    eof;                               /* end of deck after line */
+    uint8    reserved[5];
+} M20_CARD_REC;
+
+
+/*
+ * Saved state of M-20 machine (libm20, m20lib.c).
+ * Emulator globals hold the selected machine, others are kept in these
+ * structures: cpu_state_save() and device *_state_save() copy the globals
+ * out, *_state_restore() copy them back.
+ */
+typedef struct m20_cpu_state {
+    t_value  mosu[MAX_MEM_SIZE];
+    uint16   kra, ra, sma;
+    int      sw, rop;
+    t_value  rk, rr, rmr, p1;
+    t_value  rpu[4];
+    int      old_sw, old_opcode;
+    t_value  cr_io_addr[3];
+    double   delay;
+    int      ext_io_op, ext_io_dev_zone_addr, ext_io_ram_start, ext_io_ram_end;
+    int      ext_io_ram_jump, ext_io_ram_chksum;
+    t_value  cdr_csum, cdr_rsum;
+    int      cdr_rcodes, cdr_stop_blocking, cdr_control_blocking;
+    int      boot_device_req_cdr, active_lpt, active_cdp;
+    int      run_mode, mosu_mode, itep_mode;
+    int      new_add, new_mult, new_div, new_sqrt;
+    int      mosu_garbage_count;
+    uint32   unit_flags;                        /* cpu_unit.flags (ENGINE) */
+} M20_CPU_STATE;
+
+typedef struct m20_drum_state {
+    UNIT     unit[MAX_PHYS_DRUM_COUNT];
+    int      log_map[MAX_LOG_DRUM_COUNT];
+    int      access_mode[MAX_PHYS_DRUM_COUNT+1];
+    t_value  print_buf[MSU_DRUM_PRINT_BUF_SIZE];
+    int      print_last_pos;
+} M20_DRUM_STATE;
+
+typedef struct m20_mt_state {
+    UNIT     unit[MAX_TAPES_COUNT];
+    int      log_map[MAX_TAPES_COUNT];
+    int      access_mode[MAX_TAPES_COUNT];
+} M20_MT_STATE;
+
+typedef struct m20_cd_state {
+    UNIT     cdr_unit, cdp_unit;
+    int      cdr_codes_count;
+    int      cdp_codes_count;
+    int32    cdp_buf_full;
+    t_value  cdp_sum;
+    int      bcd_print;
+} M20_CD_STATE;
+
+typedef struct m20_lp_state {
+    UNIT     unit;
+    t_value  sum;
+    int      codes_count;
+    int      print_width, decimal_print_type;
+} M20_LP_STATE;
+
+extern void cpu_state_save (M20_CPU_STATE * st);
+extern void cpu_state_restore (const M20_CPU_STATE * st);
+extern void drum_state_save (M20_DRUM_STATE * st);
+extern void drum_state_restore (const M20_DRUM_STATE * st);
+extern void mt_state_save (M20_MT_STATE * st);
+extern void mt_state_restore (const M20_MT_STATE * st);
+extern void cd_state_save (M20_CD_STATE * st);
+extern void cd_state_restore (const M20_CD_STATE * st);
+extern void lp_state_save (M20_LP_STATE * st);
+extern void lp_state_restore (const M20_LP_STATE * st);
+
+
+/* Write-behind of drum and tape transfers (m20_aio.c) */
+
+extern t_stat m20_aio_write (UNIT * uptr, long pos, const t_value * buf, int nwords);
+extern t_stat m20_aio_wait (UNIT * uptr);
+extern t_stat m20_aio_check (void);
+extern t_stat m20_aio_flush (void);
+extern void   m20_aio_forked (void);
+
+
+/* Copy-on-write overlay on drum and tape files (m20_ovl.c) */
+
+extern t_stat m20_ovl_attach (UNIT * uptr, CONST char * cptr);
+extern t_stat m20_ovl_detach (UNIT * uptr, int commit);
+extern t_stat m20_ovl_fork (UNIT * uptr);
+
+
+/* FORK command (m20_fork.c) */
+
+extern CTAB   m20_cmd[];
+
+
+/* High-level emulation of library routines (m20_hle.c) */
+
+extern t_stat m20_hle_call (int ret, int entry, int link);
+extern t_stat m20_hle_show (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+extern t_stat m20_hle_sig_cmd (int32 flag, CONST char *cptr);
+extern t_stat cpu_run_routine (int ret, long max);
+extern void   cpu_mosu_restore (const t_value * mem);
+
+
+/* Journal of external inputs, record and replay (m20_jrn.c) */
+
+typedef t_stat (*M20_JRN_IO) (int op, int a1, int a2, int a3);
+
+extern int    m20_jrn_mode;
+extern t_stat m20_jrn_io (int op, int a1, int a2, int a3, M20_JRN_IO io);
+extern t_stat m20_jrn_run (void);
+extern void   m20_jrn_stop (void);
+extern t_stat m20_jrn_mark (t_stat r);
+extern t_stat m20_jrn_set (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+extern t_stat m20_jrn_show (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+extern void   m20_jrn_forked (int k);
+extern void   cpu_state_apply (const M20_CPU_STATE * st);
+
+
 #if !defined(WIN32)
 #define  _snprintf  snprintf
 #endif
@@ -29,6 +29,10 @@
  *  08-Mar-2015  DVS  Added more checksum control logic
  *  13-May-2023  LOY  Make variables for external devices external itself
  *  11-Mar-2025  LOY  Add some const in declarations, as in SIMH declarations
+ *  18-Oct-2026  AGT  Drum image kept in memory (att -m), SET DRUM SYNC
+ *  18-Oct-2026  AGT  drum_state_save/drum_state_restore for libm20
+ *  18-Oct-2026  AGT  Write to drum file is written behind by worker thread (m20_aio)
+ *  18-Oct-2026  AGT  Copy-on-write overlay on drum image (att -o, det -c)
  *
  */
 
@@ -52,6 +56,7 @@ t_stat drum_svc (UNIT *uptr);
 t_stat drum_reset (DEVICE *dptr);
 t_stat drum_attach (UNIT *uptr, const char *cptr);
 t_stat drum_detach (UNIT *uptr);
+t_stat drum_sync (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 
 static int drum_map_check = 1;
 static int drum_auto_skip_zero_address = 1;
@@ -96,6 +101,8 @@ REG drum_reg[] = {
 };
 
 MTAB drum_mod[] = {
+	{ MTAB_XTD|MTAB_VDV, 0, NULL, "SYNC",
+	  &drum_sync, NULL, NULL, "Write drum images kept in memory (att -m) to files" },
 	{ 0 }
 };
 
@@ -182,8 +189,17 @@ t_stat drum_attach (UNIT *uptr, const char *cptr)
     t_stat s;
 
     sim_cancel(uptr);				           /* cancel current IO */
-   
-    s = attach_unit (uptr, cptr);
+
+    /* att -m: drum image is kept in memory, written back on detach or SET DRUM SYNC */
+    if (sim_switches & SWMASK ('M'))
+        uptr->flags |= UNIT_BUFABLE | UNIT_MUSTBUF;
+
+    /* att -o: writes go into overlay, image is not changed (m20_ovl) */
+    if (sim_switches & SWMASK ('O'))
+        s = m20_ovl_attach (uptr, cptr);
+    else
+        s = attach_unit (uptr, cptr);
+    if (s != SCPE_OK) uptr->flags &= ~(UNIT_BUFABLE | UNIT_MUSTBUF);
 
     if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: drum_attach(..), name='%s' res=%d\n", cptr, s);
 
@@ -197,12 +213,137 @@ t_stat drum_attach (UNIT *uptr, const char *cptr)
  */
 t_stat drum_detach (UNIT *uptr)
 {
+    t_stat s, err;
 
     if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: drum_detach(..)\n");
 
     sim_cancel(uptr);
+    err = m20_aio_wait (uptr);
+
+    /* det -c: overlay is written into image */
+    s = m20_ovl_detach (uptr, (sim_switches & SWMASK ('C')) != 0);
+    uptr->flags &= ~(UNIT_BUFABLE | UNIT_MUSTBUF);
 
-    return detach_unit (uptr);
+    return (s != SCPE_OK) ? s : err;
+}
+
+
+
+/*
+ *  Write drum images kept in memory to files
+ */
+t_stat drum_sync (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+    uint32 i;
+    size_t count;
+
+    if (cptr) return SCPE_ARG;
+
+    for (i = 0; i < drum_dev.numunits; i++) {
+	uptr = &drum_unit[i];
+	if (!(uptr->flags & UNIT_BUF) || (uptr->flags & UNIT_RO) || !uptr->hwmark) continue;
+	if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: drum_sync(..), unit=%d words=%u\n", i, uptr->hwmark);
+	rewind (uptr->fileref);
+	count = fxwrite (uptr->filebuf, sizeof(t_value), uptr->hwmark, uptr->fileref);
+	if ((count != uptr->hwmark) || fflush (uptr->fileref)) return SCPE_IOERR;
+    }
+
+    return SCPE_OK;
+}
+
+
+
+/*
+ * Запись на барабан, образ которого в памяти (att -m).
+ * Words go from MOSU to image directly, checksum is computed on the way.
+ */
+static t_stat drum_write_image (int drum_no, int addr, int first, int nwords, t_value *sum, int * ocodes,
+                                int no_mosu_access, int disable_control)
+{
+    UNIT * uptr = &drum_unit[drum_no];
+    t_value * image = (t_value *) uptr->filebuf;
+    t_value  chksum, val;
+    uint32  end;
+    int  i;
+
+    /* file is opened for read only */
+    if (uptr->flags & UNIT_RO) {
+        if (ocodes) *ocodes = 0;
+        return SCPE_IOERR;
+    }
+
+    chksum = 0;
+    for( i=0; i<nwords; i++ ) {
+       val = no_mosu_access ? 0 : mosu_load(first+i);
+       if (sim_deb && drum_dev.dctrl && drum_write_data_dump) fprintf (sim_deb, "drm: write_value=%015llo\n", val);
+       image[addr+i] = val;
+       chksum = cyclic_checksum (chksum, val);
+    }
+    if (ocodes) *ocodes = nwords;
+    end = addr + nwords;
+
+    if (sum) {
+        if (!disable_control) {
+          image[end++] = chksum;
+          if (ocodes) *ocodes += 1;
+        }
+        if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: chksum=%015llo (0x%016llX)\n", chksum,chksum);
+        *sum = chksum;
+    }
+    if (end > uptr->hwmark) uptr->hwmark = end;
+
+    if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: writing_done\n");
+
+    return SCPE_OK;
+}
+
+
+
+/*
+ * Чтение с барабана, образ которого в памяти (att -m).
+ * Words go from image to MOSU directly, checksum is computed on the way.
+ */
+static t_stat drum_read_image (int drum_no, int addr, int first, int nwords, t_value *sum, int * ocodes,
+                               int no_mosu_access, int disable_control)
+{
+    UNIT * uptr = &drum_unit[drum_no];
+    t_value * image = (t_value *) uptr->filebuf;
+    t_value  chksum, old_sum, val;
+    int  count, i;
+
+    /* words beyond end of file are not initialized */
+    count = ((uint32)addr < uptr->hwmark) ? (int)(uptr->hwmark - addr) : 0;
+    if (count > nwords) count = nwords;
+    if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: read_count=%04o\n", count);
+    if (ocodes) *ocodes = count;
+
+    chksum = 0;
+    for( i=0; i<count; i++ ) {
+        val = image[addr+i];
+        if (sim_deb && drum_dev.dctrl && drum_read_data_dump) fprintf (sim_deb, "drm: read_value=%015llo\n", val);
+        if (!no_mosu_access) mosu_store(first+i,val);
+        chksum = cyclic_checksum (chksum, val);
+    }
+
+    /* Reading uninitialized drum storage */
+    if (count != nwords) return STOP_DRUMINVDATA;
+
+    if (sum) {
+	/* Test checksum  */
+	old_sum = 0;
+	count = ((uint32)(addr + nwords) < uptr->hwmark);
+	if (count) old_sum = image[addr+nwords];
+	if (!disable_control && !count) return SCPE_IOERR;
+	if (ocodes) *ocodes += count;
+        if (sim_deb && drum_dev.dctrl) 
+            fprintf (sim_deb, "drm: old_sum=%015llo chksum=%015llo\n", old_sum, chksum);
+	*sum = chksum;
+	if (!disable_control && (old_sum != chksum)) return STOP_READERR;
+    }
+
+    if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: reading_done\n");
+
+    return SCPE_OK;
 }
 
 
@@ -216,7 +357,7 @@ t_stat drum_detach (UNIT *uptr)
 t_stat drum_write (int drum_no, int addr, int first, int last, t_value *sum,int * ocodes,int no_mosu_access,
                    int disable_control)
 {
-    int nwords, i, res, chksum_word;
+    int nwords, i, chksum_word;
     size_t count;
     t_value chksum;
 
@@ -231,6 +372,9 @@ t_stat drum_write (int drum_no, int addr, int first, int last, t_value *sum,int
     if (!disable_control && sum) chksum_word = 1;
     if (nwords <= 0 || ((nwords+addr+chksum_word) > DRUM_SIZE)) return STOP_BADWLEN;
 
+    if (drum_unit[drum_no].flags & UNIT_BUF)
+        return drum_write_image (drum_no, addr, first, nwords, sum, ocodes, no_mosu_access, disable_control);
+
     if (sim_deb && drum_dev.dctrl)
         fprintf (sim_deb, "drm: writing MD %05o mem_region %04o-%04o\n", addr, first, last);
 
@@ -252,16 +396,13 @@ t_stat drum_write (int drum_no, int addr, int first, int last, t_value *sum,int
     }
 
     if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: seek file_pos=%llu\n", addr*sizeof(t_value));
-    res = fseek (drum_unit[drum_no].fileref, addr*sizeof(t_value), SEEK_SET);
-    if (res) return SCPE_IOERR;
 
     if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: nwords=%04o\n", nwords);
 
-    count = fxwrite (&temp_drum_buf[first], sizeof(t_value), nwords, drum_unit[drum_no].fileref);
+    /* words and checksum are written behind from temp_drum_buf[first..] */
+    count = nwords;
     if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: write_count=%04o\n", count);
-    if (ocodes && (count <= nwords)) *ocodes = (int)count;
-    if (ferror (drum_unit[drum_no].fileref)) return SCPE_IOERR;
-    if (count != nwords) return SCPE_IOERR;
+    if (ocodes) *ocodes = (int)count;
 
     if (sum) {
 	/* Compute and write checksum */
@@ -275,11 +416,10 @@ t_stat drum_write (int drum_no, int addr, int first, int last, t_value *sum,int
           if (drum_write_data_dump) fprintf (sim_deb, "drm: write_value=%015llo\n", chksum);
         }
         if (!disable_control) {
-          count = fxwrite (&chksum, sizeof(t_value), 1, drum_unit[drum_no].fileref);
-          if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: write_count=%04o\n", count);
-          if (ferror (drum_unit[drum_no].fileref)) return SCPE_IOERR;
-          if (count != 1) return SCPE_IOERR;
-          if (ocodes) *ocodes += (int)count;
+          temp_drum_buf[last+1] = chksum;
+          count++;
+          if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: write_count=0001\n");
+          if (ocodes) *ocodes += 1;
         }
         else if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: write_count=0\n");
         if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: chksum=%015llo (0x%016llX)\n", chksum,chksum);
@@ -288,7 +428,7 @@ t_stat drum_write (int drum_no, int addr, int first, int last, t_value *sum,int
 
     if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: writing_done\n");
 
-    return SCPE_OK;
+    return m20_aio_write (&drum_unit[drum_no], addr*sizeof(t_value), &temp_drum_buf[first], (int)count);
 }
 
 
@@ -315,9 +455,16 @@ t_stat drum_read (int drum_no, int addr, int first, int last, t_value *sum,int *
     if (!disable_control && sum) chksum_word = 1;
     if (nwords <= 0 || ((nwords+addr+chksum_word) > DRUM_SIZE)) return STOP_BADRLEN;
 
+    if (drum_unit[drum_no].flags & UNIT_BUF)
+        return drum_read_image (drum_no, addr, first, nwords, sum, ocodes, no_mosu_access, disable_control);
+
     if (sim_deb && drum_dev.dctrl) 
         fprintf (sim_deb, "drm: reading MD %05o mem_region %04o-%04o\n", addr, first, last);
 
+    /* words may be written behind yet */
+    res = m20_aio_wait (&drum_unit[drum_no]);
+    if (res) return res;
+
     if (sim_deb && drum_dev.dctrl) fprintf (sim_deb, "drm: seek file_pos=%llu\n", addr*sizeof(t_value));
     res = fseek (drum_unit[drum_no].fileref, addr*8, SEEK_SET);
     if (res) return SCPE_IOERR;
@@ -460,3 +607,33 @@ t_stat drum_io(t_value *sum, int * ocodes)
 }
 
 
+
+/*
+ * Save drum units and switches of machine (libm20).
+ */
+void drum_state_save (M20_DRUM_STATE * st)
+{
+    int i;
+
+    for (i = 0; i < MAX_PHYS_DRUM_COUNT; i++)
+         sim_cancel (&drum_unit[i]);
+
+    memcpy (st->unit, drum_unit, sizeof(st->unit));
+    memcpy (st->log_map, log_drum_map_array, sizeof(st->log_map));
+    memcpy (st->access_mode, drum_access_mode_array, sizeof(st->access_mode));
+    memcpy (st->print_buf, msu_drum_print_buf, sizeof(st->print_buf));
+    st->print_last_pos = msu_drum_print_last_pos;
+}
+
+
+/*
+ * Restore drum units and switches of machine (libm20).
+ */
+void drum_state_restore (const M20_DRUM_STATE * st)
+{
+    memcpy (drum_unit, st->unit, sizeof(st->unit));
+    memcpy (log_drum_map_array, st->log_map, sizeof(st->log_map));
+    memcpy (drum_access_mode_array, st->access_mode, sizeof(st->access_mode));
+    memcpy (msu_drum_print_buf, st->print_buf, sizeof(st->print_buf));
+    msu_drum_print_last_pos = st->print_last_pos;
+}
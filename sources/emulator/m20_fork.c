@@ -0,0 +1,228 @@
+/*
+ * File:     m20_fork.c
+ * Purpose:  M-20 simulator FORK command: runs from the current state in child processes
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ *   FORK n file {arg,...}
+ *
+ * Starts n processes from the current state of machine (MOSU, registers,
+ * ext_io state, attached units) and waits for them. Child k (0..n-1) does
+ * DO file k arg... and ends, so load phase is done once and every child
+ * sets its own RPU, cards, breakpoints and runs:
+ *
+ *   load big_prog.m20
+ *   run                               ; load phase up to breakpoint
+ *   fork 4 sweep.simh                 ; sweep.simh: do rpu%1.simh, go ...
+ *
+ * Units of child are its own:
+ *   drums, tapes   - copy-on-write overlay (m20_ovl.c), changes are lost
+ *                    at the end of child unless det -c
+ *   card reader    - same file at the same card
+ *   printer, punch - new file <file>.k
+ * Console and debug output of child go to <file>.k.log, exit code of
+ * child is 0 if DO file has no error.
+ *
+ * Only where fork() is (not on Windows).
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *  18-Oct-2026  AGT  HLESIG in m20_cmd
+ *  18-Oct-2026  AGT  Journal of child (m20_jrn_forked)
+ *
+ */
+
+
+#include "m20_defs.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+
+#define  M20_FORK_MAX   256                     /* children of one FORK */
+
+extern DEVICE cdr_dev;
+extern DEVICE cdp_dev;
+extern DEVICE lpt_dev;
+extern DEVICE drum_dev;
+extern DEVICE mt_dev;
+
+extern t_stat detach_all (int32 start_device, t_bool shutdown);
+
+t_stat m20_fork_cmd (int32 flag, CONST char *cptr);
+
+
+/* SCP commands of M-20 (sim_vm_cmd, set by cpu_reset) */
+
+CTAB m20_cmd[] = {
+    { "FORK", &m20_fork_cmd, 0,
+      "fork n file {arg,...}     run DO file k arg... in n processes (k = 0..n-1)\n"
+      "                          from the current state, wait for them\n" },
+    { "HLESIG", &m20_hle_sig_cmd, 0,
+      "hlesig addr len           signature of len words at addr for HLE registry\n" },
+    { NULL }
+};
+
+
+#if !defined(_WIN32)
+
+/*
+ *  Unit of child: reopen file at pos, same or new (suffix .k)
+ */
+static t_stat fork_reopen (UNIT * uptr, int k, int new_file)
+{
+    FILE * f;
+    char * name;
+
+    name = (char *) malloc (CBUFSIZE);
+    if (name == NULL) return SCPE_MEM;
+    if (new_file) _snprintf (name, CBUFSIZE, "%s.%d", uptr->filename, k);
+    else strlcpy (name, uptr->filename, CBUFSIZE);
+
+    f = sim_fopen (name, new_file ? "wb+" : "rb");
+    if (f == NULL) {
+        free (name);
+        return SCPE_OPENERR;
+    }
+    if (new_file) uptr->pos = 0;
+    else if (feof (uptr->fileref)) fseek (f, 0, SEEK_END);
+    else fseek (f, uptr->pos, SEEK_SET);
+
+    fclose (uptr->fileref);                     /* flushed before fork */
+    uptr->fileref = f;
+    free (uptr->filename);
+    uptr->filename = name;
+    return SCPE_OK;
+}
+
+
+/*
+ *  Attached units of child are its own, file offsets are shared with parent
+ */
+static t_stat fork_units (int k)
+{
+    DEVICE * dptr;
+    UNIT * uptr;
+    uint32 i, j;
+    t_stat r;
+
+    for (i = 0; (dptr = sim_devices[i]) != NULL; i++) {
+        for (j = 0; j < dptr->numunits; j++) {
+            uptr = &dptr->units[j];
+            if (!(uptr->flags & UNIT_ATT) || (uptr->fileref == NULL)) continue;
+            if ((dptr == &drum_dev) || (dptr == &mt_dev))
+                r = m20_ovl_fork (uptr);
+            else if (dptr == &cdr_dev)
+                r = fork_reopen (uptr, k, 0);
+            else if ((dptr == &lpt_dev) || (dptr == &cdp_dev))
+                r = fork_reopen (uptr, k, 1);
+            else
+                r = SCPE_OK;
+            if (r != SCPE_OK) {
+                fprintf (stderr, "%s: %s\n", sim_uname (uptr), sim_error_text (r));
+                return r;
+            }
+        }
+    }
+    return SCPE_OK;
+}
+
+
+/*
+ *  Child k: DO file k arg...
+ */
+static void fork_child (int k, const char * file, const char * args)
+{
+    char cmd[CBUFSIZE];
+    t_stat r;
+
+    _snprintf (cmd, sizeof(cmd), "%s.%d.log", file, k);
+    if ((freopen (cmd, "w", stdout) == NULL) ||
+        (dup2 (fileno (stdout), fileno (stderr)) < 0))
+        _exit (2);
+    setvbuf (stderr, NULL, _IONBF, 0);
+    freopen ("/dev/null", "r", stdin);
+    if (sim_deb) sim_deb = stdout;              /* debug of child into its log */
+
+    m20_aio_forked ();
+    m20_jrn_forked (k);
+    if (fork_units (k) != SCPE_OK) {
+        fflush (NULL);
+        _exit (2);
+    }
+
+    _snprintf (cmd, sizeof(cmd), "\"%s\" %d %s", file, k, args);
+    r = SCPE_BARE_STATUS (do_cmd (0, cmd));
+    if (r == SCPE_EXIT) r = SCPE_OK;             /* quit in file */
+    printf ("Fork %d: %s\n", k, (r < SCPE_BASE) ? "done" : sim_error_text (r));
+
+    detach_all (0, TRUE);
+    fflush (NULL);
+    _exit ((r < SCPE_BASE) ? 0 : 1);
+}
+
+
+/*
+ *  FORK n file {arg,...}
+ */
+t_stat m20_fork_cmd (int32 flag, CONST char *cptr)
+{
+    char gbuf[CBUFSIZE], file[CBUFSIZE];
+    pid_t pid[M20_FORK_MAX];
+    int n, k, status, failed = 0;
+    uint32 j;
+    t_stat r;
+
+    cptr = get_glyph (cptr, gbuf, 0);
+    n = (int) get_uint (gbuf, 10, M20_FORK_MAX, &r);
+    if ((r != SCPE_OK) || (n == 0)) return SCPE_ARG;
+    cptr = get_glyph_quoted (cptr, file, 0);
+    if (file[0] == '\0') return SCPE_2FARG;
+    if (file[0] == '"') {                       /* "name with spaces" */
+        memmove (file, file + 1, strlen (file));
+        if (file[0] && (file[strlen (file) - 1] == '"')) file[strlen (file) - 1] = '\0';
+    }
+
+    /* nothing queued or buffered is inherited */
+    for (j = 0; j < drum_dev.numunits; j++) m20_aio_wait (&drum_dev.units[j]);
+    for (j = 0; j < mt_dev.numunits; j++) m20_aio_wait (&mt_dev.units[j]);
+    sim_flush_buffered_files ();
+    fflush (NULL);
+
+    for (k = 0; k < n; k++) {
+        pid[k] = fork ();
+        if (pid[k] == 0) fork_child (k, file, cptr);
+        if (pid[k] < 0) {
+            sim_printf ("Fork %d: %s\n", k, strerror (errno));
+            break;
+        }
+    }
+    n = k;
+
+    for (k = 0; k < n; k++) {
+        if (waitpid (pid[k], &status, 0) < 0) status = -1;
+        if ((status != -1) && WIFEXITED (status) && (WEXITSTATUS (status) == 0))
+            sim_printf ("Fork %d: done, %s.%d.log\n", k, file, k);
+        else {
+            sim_printf ("Fork %d: failed, %s.%d.log\n", k, file, k);
+            failed++;
+        }
+    }
+
+    return failed ? SCPE_INCOMP : SCPE_OK;
+}
+
+#else
+
+t_stat m20_fork_cmd (int32 flag, CONST char *cptr)
+{
+    return SCPE_NOFNC;
+}
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ * File:     m20_hle.c
+ * Purpose:  M-20 simulator high-level emulation of standard library routines
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Library-heavy jobs spend most of their instructions in a few resident
+ * routines of IS-2 (07200-07767) and B-61 (00200-00677): elementary
+ * functions, decimal conversion. Routine of the registry below is done
+ * by native code when KRA enters it by 016.
+ *
+ * Routine is known by signature of its resident code (hle_sig, see
+ * HLESIG command), not by address only: other version of library or
+ * user code loaded over it is interpreted as usual.
+ *
+ *   SET CPU NOHLE       interpret everything (default)
+ *   SET CPU HLE         native code for registered routines
+ *   SET CPU HLEVERIFY   run native code and interpreter from the same
+ *                       state, stop with STOP_HLEVERIFY if MOSU, registers
+ *                       or delay differ (interpreted state is kept)
+ *   SHOW CPU HLE        registry with counts of calls
+ *   HLESIG addr len     signature of len words at addr (octal)
+ *
+ * Native function gets machine after 016 (KRA = entry, return word stored
+ * at link). It stores results by mosu_store, sets registers left by the
+ * routine and adds its time to delay, up to the jump to link word, and
+ * sets KRA to that word (or other last words of the routine); they are
+ * then interpreted up to return address. SCPE_NOFNC means it does not
+ * handle these arguments and has changed nothing: the routine is
+ * interpreted. Whole routine counts as 016 for events, trace and profile.
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *  18-Oct-2026  AGT  Division check of complex test 1963 (kt_div), native code sets KRA
+ *
+ */
+
+
+#include "m20_defs.h"
+#include <math.h>
+
+
+#define  HLE_RETURN_MAX   16                    /* instructions from link word to return */
+#define  HLE_VERIFY_MAX   1000000L              /* interpreted instructions of routine */
+#define  HLE_REPORT_MAX   8                     /* differing MOSU words shown */
+
+extern t_value  MOSU[MAX_MEM_SIZE];
+extern uint16   regKRA, regRA, regSMA;
+extern int      trgSW, regROP;
+extern t_value  regRR, regRMR;
+extern double   delay;
+extern t_value  RPU4;
+extern int      new_div;
+extern UNIT     cpu_unit;
+extern DEVICE   cpu_dev;
+
+extern t_value mosu_load (int addr);
+extern void    mosu_store (int addr, t_value val);
+extern t_stat  division (t_value *result, t_value x, t_value y, int no_round);
+extern t_stat  new_arithmetic_div_op (t_value *result, t_value x, t_value y, int op_code);
+
+typedef struct m20_hle_call {
+    int       ret;                              /* a1 of 016, return address */
+    int       entry;                            /* a2, first instruction */
+    int       link;                             /* a3, return word */
+} M20_HLE_CALL;
+
+typedef t_stat (*M20_HLE_FUNC) (const M20_HLE_CALL * call);
+
+typedef struct m20_hle_routine {
+    const char *  name;
+    int           addr;                         /* entry, -1: anywhere */
+    int           len;                          /* words of signature from entry */
+    t_uint64      sig;                          /* m20_hle_sig of resident code */
+    M20_HLE_FUNC  func;
+    long          calls, verified;
+} M20_HLE_ROUTINE;
+
+typedef struct m20_hle_state {
+    t_value   mosu[MAX_MEM_SIZE];
+    uint16    kra, ra, sma;
+    int       sw, rop;
+    t_value   rr, rmr;
+    double    delay;
+} M20_HLE_STATE;
+
+
+/*
+ *  Complex test 1963 (kt_1963), resident division check, called by
+ *  016 at 07753 after every section is read from drum:
+ *
+ *    7647    075 7646 0000 7767   7767 = ones
+ *    7650    020 7774 0000 7667   7667 = RPU4
+ *    7651    072 0000 7667 0000   RA = a2 of RPU4
+ *    7652    004 7767 7645 7767   9 times: 7767 = 7767 / 7645 (1.0)
+ *    7663  1 032 0001 7652 7777   again while RA >= 1, RA = RA - 1
+ *    7664    035 7767 7646 7644   stop if 7767 is not ones
+ *    7665    056 0000 0001 7665   to section at 0001
+ *
+ *  Native code runs up to 7665. Division error or mismatch is left to
+ *  interpreter, which stops there.
+ */
+static t_stat hle_kt_div (const M20_HLE_CALL * call)
+{
+    t_value ones, x, y, q, rr;
+    double t;
+    int ra, i;
+
+    if (call->ret != 00001) return SCPE_NOFNC;          /* 7665 does not return */
+
+    ones = mosu_load (07646);
+    x = ones | mosu_load (0);
+    y = mosu_load (07645);
+    t = 24.0 + 24.0 + 28.5;
+    for (ra = (int) (RPU4 >> BITS_12 & MAX_ADDR_VALUE); ra >= 0; ra--) {
+        for (i = 0; i < 9; i++) {
+            if (new_div ? new_arithmetic_div_op (&q, x, y, 004) : division (&q, x, y, 0))
+                return SCPE_NOFNC;
+            x = q;
+        }
+        t += 9 * 136.5 + 24.0;
+    }
+    rr = x ^ ones;
+    if (rr != 0) return SCPE_NOFNC;
+
+    mosu_store (07767, x);
+    mosu_store (07667, RPU4);
+    mosu_store (07644, rr);
+    regRA = MAX_ADDR_VALUE;                             /* 032 after RA = 0 */
+    regRR = rr;
+    trgSW = 1;
+    delay += t + 24.0;
+    regKRA = 07665;
+    return SCPE_OK;
+}
+
+
+/*
+ * Registry of routines. New entry: load library, get signature of the
+ * routine by HLESIG, write native function with the contract above and
+ * check it by SET CPU HLEVERIFY on jobs calling it.
+ *
+ *   { "name", entry, len, signature, &native_function },
+ */
+static M20_HLE_ROUTINE hle_routines[] = {
+    { "kt_div", 07647, 020, 0x1f9fcc406f2b77b8ULL, &hle_kt_div },
+    { NULL }
+};
+
+static M20_HLE_STATE hle_before, hle_native;
+static int hle_depth = 0;
+
+
+/*
+ *  Signature of code: FNV-1a over 45-bit words
+ */
+static t_uint64 hle_sig (int addr, int len)
+{
+    t_uint64 h = 0xcbf29ce484222325ULL;
+    t_value w;
+    int i, b;
+
+    for (i = 0; i < len; i++) {
+        w = MOSU[(addr + i) & MAX_ADDR_VALUE] & WORD45;
+        for (b = 0; b < 6; b++) {
+            h ^= (t_uint64) (w & 0377);
+            h *= 0x100000001b3ULL;
+            w >>= 8;
+        }
+    }
+    return h;
+}
+
+
+/*
+ *  Registered routine resident at entry
+ */
+static M20_HLE_ROUTINE * hle_find (int entry)
+{
+    M20_HLE_ROUTINE * rt;
+
+    for (rt = hle_routines; rt->name != NULL; rt++) {
+        if ((rt->addr >= 0) && (rt->addr != entry)) continue;
+        if (entry + rt->len > MAX_MEM_SIZE) continue;
+        if (hle_sig (entry, rt->len) == rt->sig) return rt;
+    }
+    return NULL;
+}
+
+
+static void hle_save (M20_HLE_STATE * st)
+{
+    memcpy (st->mosu, MOSU, sizeof(MOSU));
+    st->kra = regKRA;
+    st->ra = regRA;
+    st->sma = regSMA;
+    st->sw = trgSW;
+    st->rop = regROP;
+    st->rr = regRR;
+    st->rmr = regRMR;
+    st->delay = delay;
+}
+
+
+static void hle_restore (const M20_HLE_STATE * st)
+{
+    cpu_mosu_restore (st->mosu);
+    regKRA = st->kra;
+    regRA = st->ra;
+    regSMA = st->sma;
+    trgSW = st->sw;
+    regROP = st->rop;
+    regRR = st->rr;
+    regRMR = st->rmr;
+    delay = st->delay;
+}
+
+
+/*
+ *  Compare native result with machine state after interpreter, report
+ *  differences, return number of them
+ */
+static int hle_compare (const M20_HLE_ROUTINE * rt, const M20_HLE_CALL * call,
+                        const M20_HLE_STATE * st)
+{
+    int addr, n = 0;
+
+    for (addr = 0; addr < MAX_MEM_SIZE; addr++) {
+        if (st->mosu[addr] == MOSU[addr]) continue;
+        if (n++ < HLE_REPORT_MAX)
+            sim_printf ("HLE %s: MOSU[%04o] native %015" LL_FMT "o, interpreter %015" LL_FMT "o\n",
+                        rt->name, addr, st->mosu[addr], MOSU[addr]);
+    }
+    if (n > HLE_REPORT_MAX)
+        sim_printf ("HLE %s: %d more MOSU words differ\n", rt->name, n - HLE_REPORT_MAX);
+
+#define HLE_REG(reg, fmt, native, interp)                                           \
+    if ((native) != (interp)) {                                                     \
+        sim_printf ("HLE %s: %s native " fmt ", interpreter " fmt "\n",             \
+                    rt->name, reg, native, interp);                                 \
+        n++;                                                                        \
+    }
+    HLE_REG ("KRA", "%04o", st->kra, regKRA);
+    HLE_REG ("RA", "%04o", st->ra, regRA);
+    HLE_REG ("SMA", "%04o", st->sma, regSMA);
+    HLE_REG ("SW", "%d", st->sw, trgSW);
+    HLE_REG ("ROP", "%d", st->rop, regROP);
+    HLE_REG ("RR", "%015" LL_FMT "o", st->rr, regRR);
+    HLE_REG ("RMR", "%015" LL_FMT "o", st->rmr, regRMR);
+#undef HLE_REG
+
+    if (fabs (st->delay - delay) > 0.001) {
+        sim_printf ("HLE %s: time native %.1f, interpreter %.1f us\n", rt->name,
+                    st->delay - hle_before.delay, delay - hle_before.delay);
+        n++;
+    }
+
+    if (n)
+        sim_printf ("HLE %s: called at %04o, return to %04o by %04o\n",
+                    rt->name, call->entry, call->ret, call->link);
+    return n;
+}
+
+
+/*
+ *  Native routine and return word
+ */
+static t_stat hle_native_run (M20_HLE_ROUTINE * rt, const M20_HLE_CALL * call)
+{
+    t_stat r;
+
+    r = rt->func (call);
+    if (r) return r;
+    return cpu_run_routine (call->ret, HLE_RETURN_MAX);
+}
+
+
+/*
+ *  016 has entered entry (KRA), called from op_jump_with_return.
+ *  Registered routine is done here, KRA is at ret then.
+ */
+t_stat m20_hle_call (int ret, int entry, int link)
+{
+    M20_HLE_ROUTINE * rt;
+    M20_HLE_CALL call;
+    t_stat r, rn;
+
+    if (hle_depth) return SCPE_OK;              /* return word or call inside routine */
+    rt = hle_find (entry);
+    if (rt == NULL) return SCPE_OK;
+
+    call.ret = ret;
+    call.entry = entry;
+    call.link = link;
+    hle_depth++;
+
+    if ((cpu_unit.flags & UNIT_HLE) != UNIT_HLE_VERIFY) {
+        r = hle_native_run (rt, &call);
+        if (r == SCPE_NOFNC) r = SCPE_OK;       /* declined, interpreted */
+        else rt->calls++;
+        hle_depth--;
+        return r;
+    }
+
+    hle_save (&hle_before);
+    rn = hle_native_run (rt, &call);
+    if (rn == SCPE_NOFNC) {
+        hle_depth--;
+        return SCPE_OK;
+    }
+    rt->calls++;
+    hle_save (&hle_native);
+
+    hle_restore (&hle_before);
+    r = cpu_run_routine (ret, HLE_VERIFY_MAX);
+    hle_depth--;
+
+    if (r != rn) {
+        sim_printf ("HLE %s: native %s, interpreter %s\n", rt->name,
+                    rn ? sim_error_text (rn) : "done",
+                    r ? sim_error_text (r) : "done");
+        hle_compare (rt, &call, &hle_native);
+        return r ? r : STOP_HLEVERIFY;
+    }
+    if (r) return r;
+    if (hle_compare (rt, &call, &hle_native)) return STOP_HLEVERIFY;
+
+    rt->verified++;
+    if (sim_deb && cpu_dev.dctrl)
+        fprintf (sim_deb, "cpu: HLE %s at %04o verified\n", rt->name, entry);
+    return SCPE_OK;
+}
+
+
+/*
+ *  SHOW CPU HLE
+ */
+t_stat m20_hle_show (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+    M20_HLE_ROUTINE * rt;
+
+    if (hle_routines[0].name == NULL) {
+        fprintf (st, "no HLE routines registered\n");
+        return SCPE_OK;
+    }
+    fprintf (st, "Routine       Entry  Len  Signature          Resident      Calls   Verified\n");
+    for (rt = hle_routines; rt->name != NULL; rt++) {
+        fprintf (st, "%-12s  ", rt->name);
+        if (rt->addr >= 0) fprintf (st, "%04o  ", rt->addr);
+        else fprintf (st, " any  ");
+        fprintf (st, "%4o  %016" LL_FMT "x  %-8s  %9ld  %9ld\n", rt->len, rt->sig,
+                 (rt->addr < 0) ? "-" : (hle_find (rt->addr) == rt) ? "yes" : "no",
+                 rt->calls, rt->verified);
+    }
+    return SCPE_OK;
+}
+
+
+/*
+ *  HLESIG addr len
+ */
+t_stat m20_hle_sig_cmd (int32 flag, CONST char *cptr)
+{
+    char gbuf[CBUFSIZE];
+    int addr, len;
+    t_stat r;
+
+    cptr = get_glyph (cptr, gbuf, 0);
+    if (gbuf[0] == '\0') return SCPE_2FARG;
+    addr = (int) get_uint (gbuf, 8, MAX_ADDR_VALUE, &r);
+    if (r != SCPE_OK) return SCPE_ARG;
+    cptr = get_glyph (cptr, gbuf, 0);
+    if (gbuf[0] == '\0') return SCPE_2FARG;
+    len = (int) get_uint (gbuf, 8, MAX_MEM_SIZE - addr, &r);
+    if ((r != SCPE_OK) || (len == 0)) return SCPE_ARG;
+    if (*cptr) return SCPE_2MARG;
+
+    sim_printf ("{ \"name\", 0%04o, 0%o, 0x%016" LL_FMT "xULL, &native_function },\n",
+                addr, len, hle_sig (addr, len));
+    return SCPE_OK;
+}
@@ -0,0 +1,629 @@
+/*
+ * File:     m20_jrn.c
+ * Purpose:  M-20 simulator journal of external inputs: record and replay
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Run of a program depends on what comes from outside of CPU and MOSU:
+ * cards read by 010/030, drum and tape words read by 070, RPU and
+ * everything changed by SCP (DEPOSIT, LOAD, SET) while machine is stopped.
+ * Journal keeps these inputs, stamped by count of done instructions
+ * (ICOUNT register), so the run is reproduced without card, drum and tape
+ * images, on other engine or other version of emulator.
+ *
+ *   SET CPU RECORD=file   write journal from next run on
+ *   SET CPU REPLAY=file   take inputs from journal
+ *   SET CPU NOJOURNAL     close journal, devices are used again
+ *   SET CPU STOPAT=n      stop with STOP_ICOUNT when ICOUNT is n
+ *   SET CPU NOSTOPAT
+ *   SHOW CPU JOURNAL      journal, ICOUNT and stop count
+ *
+ * Records of journal:
+ *   start    machine state at first run after RECORD (as changes of
+ *            zeroed machine), ICOUNT
+ *   resume   changes made by SCP since previous stop
+ *   I/O      010, 030, 050 or 070: its MOSU words and registers changed,
+ *            status and time; instruction itself is not done on replay
+ *   end      ICOUNT of last stop, rewritten by next record
+ *
+ * Replay stops where instruction stops of recorded run were (STOP, read
+ * errors, no cards), but not on its breakpoints, and resume record is
+ * applied on the same ICOUNT then. At the end of journal replay stops with
+ * STOP_ICOUNT and closes journal: next GO goes on with attached devices.
+ * I/O instruction not in journal (other ICOUNT, opcode or addresses)
+ * stops with STOP_REPLAY and closes journal as well. Printer and punch
+ * are not written on replay, changes done by SCP on replay are not checked
+ * and may be overwritten by journal.
+ *
+ * Format: "M20JRN1\n", then records: kind byte, ICOUNT, for I/O opcode,
+ * addresses, status and time (8 bytes of double), changed registers as
+ * (index in jrn_fields, value), changed MOSU words as (address step,
+ * value). Numbers are 7 bits per byte, low first, high bit set if more.
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *
+ */
+
+
+#include "m20_defs.h"
+#include <stddef.h>
+
+
+#define  JRN_MAGIC     "M20JRN1\n"
+#define  JRN_NONE      (~(t_uint64) 0)
+
+enum { JRN_OFF, JRN_RECORD, JRN_REPLAY };
+enum { JRN_EOF = 0, JRN_START = 'S', JRN_RUN = 'R', JRN_IO = 'I', JRN_END = 'E' };
+
+extern t_uint64 cpu_inst_count, cpu_inst_mark;
+extern uint16   regKRA;
+extern double   delay;
+extern DEVICE   cpu_dev;
+
+typedef struct m20_jrn_field {
+    size_t    offset;
+    size_t    size;                             /* 2, 4 or 8 */
+} M20_JRN_FIELD;
+
+#define JRN_FIELD(f)   { offsetof (M20_CPU_STATE, f), sizeof (((M20_CPU_STATE *) 0)->f) }
+
+/*
+ * Registers of journal. Index is in file: new ones only at the end.
+ * Not here: delay (time of I/O is in its record, run starts at 0),
+ * mosu_garbage_count (kept by MOSU writes), unit_flags (engine).
+ */
+static const M20_JRN_FIELD jrn_fields[] = {
+    JRN_FIELD (kra), JRN_FIELD (ra), JRN_FIELD (sma), JRN_FIELD (sw), JRN_FIELD (rop),
+    JRN_FIELD (rk), JRN_FIELD (rr), JRN_FIELD (rmr), JRN_FIELD (p1),
+    JRN_FIELD (rpu[0]), JRN_FIELD (rpu[1]), JRN_FIELD (rpu[2]), JRN_FIELD (rpu[3]),
+    JRN_FIELD (old_sw), JRN_FIELD (old_opcode),
+    JRN_FIELD (cr_io_addr[0]), JRN_FIELD (cr_io_addr[1]), JRN_FIELD (cr_io_addr[2]),
+    JRN_FIELD (ext_io_op), JRN_FIELD (ext_io_dev_zone_addr),
+    JRN_FIELD (ext_io_ram_start), JRN_FIELD (ext_io_ram_end),
+    JRN_FIELD (ext_io_ram_jump), JRN_FIELD (ext_io_ram_chksum),
+    JRN_FIELD (cdr_csum), JRN_FIELD (cdr_rsum), JRN_FIELD (cdr_rcodes),
+    JRN_FIELD (cdr_stop_blocking), JRN_FIELD (cdr_control_blocking),
+    JRN_FIELD (boot_device_req_cdr), JRN_FIELD (active_lpt), JRN_FIELD (active_cdp),
+    JRN_FIELD (run_mode), JRN_FIELD (mosu_mode), JRN_FIELD (itep_mode),
+    JRN_FIELD (new_add), JRN_FIELD (new_mult), JRN_FIELD (new_div), JRN_FIELD (new_sqrt),
+};
+
+#define  JRN_NFIELDS   ((int) (sizeof(jrn_fields) / sizeof(jrn_fields[0])))
+
+typedef struct m20_jrn_rec {
+    int       kind;
+    t_uint64  icount;
+    int       op, a1, a2, a3;                   /* I/O */
+    t_stat    status;
+    double    time;
+    int       nfields, nwords;
+    int       field[JRN_NFIELDS];
+    t_uint64  value[JRN_NFIELDS];
+    int       addr[MAX_MEM_SIZE];
+    t_value   word[MAX_MEM_SIZE];
+} M20_JRN_REC;
+
+int  m20_jrn_mode = JRN_OFF;
+
+static FILE *         jrn_file = NULL;
+static char           jrn_name[CBUFSIZE];
+static long           jrn_end_pos = -1;         /* end record to be rewritten */
+static long           jrn_records = 0;
+static int            jrn_started = 0;          /* start record written */
+static t_uint64       jrn_stopat = JRN_NONE;
+static M20_JRN_REC    jrn_rec;                  /* next record of replay */
+static M20_CPU_STATE  jrn_last;                 /* state at last stop (record) */
+static M20_CPU_STATE  jrn_before, jrn_after;
+
+
+static t_uint64 jrn_get_field (const M20_CPU_STATE * st, int i)
+{
+    const char * p = (const char *) st + jrn_fields[i].offset;
+
+    switch (jrn_fields[i].size) {
+      case 2:  return *(const uint16 *) p;
+      case 4:  return (uint32) *(const int32 *) p;
+      default: return *(const t_uint64 *) p;
+    }
+}
+
+
+static void jrn_set_field (M20_CPU_STATE * st, int i, t_uint64 v)
+{
+    char * p = (char *) st + jrn_fields[i].offset;
+
+    switch (jrn_fields[i].size) {
+      case 2:  *(uint16 *) p = (uint16) v;  break;
+      case 4:  *(int32 *) p = (int32) (uint32) v;  break;
+      default: *(t_uint64 *) p = v;  break;
+    }
+}
+
+
+/*
+ *  Number: 7 bits per byte, low first
+ */
+static void jrn_put (t_uint64 v)
+{
+    do {
+        putc ((int) ((v & 0177) | ((v > 0177) ? 0200 : 0)), jrn_file);
+        v >>= 7;
+    } while (v);
+}
+
+
+static int jrn_get (t_uint64 * v)
+{
+    int c, shift;
+
+    *v = 0;
+    for (shift = 0; shift < 64; shift += 7) {
+        c = getc (jrn_file);
+        if (c == EOF) return 0;
+        *v |= (t_uint64) (c & 0177) << shift;
+        if (!(c & 0200)) return 1;
+    }
+    return 0;
+}
+
+
+static void jrn_put_time (double t)
+{
+    t_uint64 v;
+    int i;
+
+    memcpy (&v, &t, sizeof(v));
+    for (i = 0; i < 8; i++, v >>= 8)
+        putc ((int) (v & 0377), jrn_file);
+}
+
+
+static int jrn_get_time (double * t)
+{
+    t_uint64 v = 0;
+    int i, c;
+
+    for (i = 0; i < 8; i++) {
+        c = getc (jrn_file);
+        if (c == EOF) return 0;
+        v |= (t_uint64) c << (8 * i);
+    }
+    memcpy (t, &v, sizeof(v));
+    return 1;
+}
+
+
+/*
+ *  Start of record; end record of last stop is overwritten
+ */
+static void jrn_put_head (int kind)
+{
+    if (jrn_end_pos >= 0) {
+        fseek (jrn_file, jrn_end_pos, SEEK_SET);
+        jrn_end_pos = -1;
+    }
+    putc (kind, jrn_file);
+    jrn_put (cpu_inst_count);
+    jrn_records++;
+}
+
+
+/*
+ *  Changes from old to st, returns their number (0: nothing written)
+ */
+static int jrn_put_changes (const M20_CPU_STATE * old, const M20_CPU_STATE * st, int kind)
+{
+    int i, addr, prev, nfields = 0, nwords = 0;
+
+    for (i = 0; i < JRN_NFIELDS; i++)
+        if (jrn_get_field (old, i) != jrn_get_field (st, i)) nfields++;
+    for (addr = 0; addr < MAX_MEM_SIZE; addr++)
+        if (old->mosu[addr] != st->mosu[addr]) nwords++;
+    if ((kind == JRN_RUN) && (nfields + nwords == 0)) return 0;
+
+    if (kind != JRN_IO) jrn_put_head (kind);
+    jrn_put (nfields);
+    for (i = 0; i < JRN_NFIELDS; i++) {
+        if (jrn_get_field (old, i) == jrn_get_field (st, i)) continue;
+        jrn_put (i);
+        jrn_put (jrn_get_field (st, i));
+    }
+    jrn_put (nwords);
+    for (addr = prev = 0; addr < MAX_MEM_SIZE; addr++) {
+        if (old->mosu[addr] == st->mosu[addr]) continue;
+        jrn_put (addr - prev);
+        jrn_put (st->mosu[addr]);
+        prev = addr;
+    }
+    return nfields + nwords;
+}
+
+
+/*
+ *  Next record of replay into jrn_rec, JRN_EOF at end or bad record
+ */
+static void jrn_read (void)
+{
+    M20_JRN_REC * rec = &jrn_rec;
+    t_uint64 v, a, s;
+    int c, i, addr;
+
+    rec->kind = JRN_EOF;
+    c = getc (jrn_file);
+    if (c == EOF) return;
+    if (!jrn_get (&rec->icount)) goto bad;
+
+    if (c == JRN_END) {
+        rec->kind = c;
+        return;
+    }
+    if ((c != JRN_START) && (c != JRN_RUN) && (c != JRN_IO)) goto bad;
+
+    rec->op = rec->a1 = rec->a2 = rec->a3 = 0;
+    rec->status = SCPE_OK;
+    rec->time = 0;
+    if (c == JRN_IO) {
+        if (!jrn_get (&v)) goto bad;
+        rec->op = (int) v;
+        if (!jrn_get (&v)) goto bad;
+        rec->a1 = (int) v;
+        if (!jrn_get (&v)) goto bad;
+        rec->a2 = (int) v;
+        if (!jrn_get (&v)) goto bad;
+        rec->a3 = (int) v;
+        if (!jrn_get (&v)) goto bad;
+        rec->status = (t_stat) v;
+        if (!jrn_get_time (&rec->time)) goto bad;
+    }
+
+    if (!jrn_get (&v) || (v > JRN_NFIELDS)) goto bad;
+    rec->nfields = (int) v;
+    for (i = 0; i < rec->nfields; i++) {
+        if (!jrn_get (&a) || (a >= JRN_NFIELDS) || !jrn_get (&v)) goto bad;
+        rec->field[i] = (int) a;
+        rec->value[i] = v;
+    }
+    if (!jrn_get (&v) || (v > MAX_MEM_SIZE)) goto bad;
+    rec->nwords = (int) v;
+    for (i = addr = 0; i < rec->nwords; i++) {
+        if (!jrn_get (&a) || !jrn_get (&s)) goto bad;
+        addr += (int) a;
+        if (addr >= MAX_MEM_SIZE) goto bad;
+        rec->addr[i] = addr;
+        rec->word[i] = s;
+    }
+    rec->kind = c;
+    return;
+
+bad:
+    sim_printf ("Replay: bad record in %s at ICOUNT %" LL_FMT "u\n", jrn_name, rec->icount);
+    rec->kind = JRN_EOF;
+}
+
+
+/*
+ *  Changes of jrn_rec into st
+ */
+static void jrn_apply (M20_CPU_STATE * st)
+{
+    int i;
+
+    for (i = 0; i < jrn_rec.nfields; i++)
+        jrn_set_field (st, jrn_rec.field[i], jrn_rec.value[i]);
+    for (i = 0; i < jrn_rec.nwords; i++)
+        st->mosu[jrn_rec.addr[i]] = jrn_rec.word[i];
+}
+
+
+/*
+ *  Next ICOUNT for m20_jrn_mark
+ */
+static void jrn_set_mark (void)
+{
+    t_uint64 m = jrn_stopat;
+
+    if (m20_jrn_mode == JRN_REPLAY) {
+        if (((jrn_rec.kind == JRN_RUN) || (jrn_rec.kind == JRN_END)) && (jrn_rec.icount < m))
+            m = jrn_rec.icount;
+        if ((jrn_rec.kind == JRN_IO) && (jrn_rec.icount + 1 < m))
+            m = jrn_rec.icount + 1;                   /* I/O must be done by then */
+    }
+    cpu_inst_mark = m;
+}
+
+
+static void jrn_close (void)
+{
+    if (jrn_file) fclose (jrn_file);
+    jrn_file = NULL;
+    jrn_end_pos = -1;
+    m20_jrn_mode = JRN_OFF;
+    jrn_set_mark ();
+}
+
+
+/*
+ *  Start or resume record of replay: SCP changes, new run from time 0
+ */
+static void jrn_resume (void)
+{
+    int i;
+
+    cpu_state_save (&jrn_after);
+    if (jrn_rec.kind == JRN_START) {
+        memset (jrn_after.mosu, 0, sizeof(jrn_after.mosu));
+        for (i = 0; i < JRN_NFIELDS; i++)
+            jrn_set_field (&jrn_after, i, 0);
+        cpu_inst_count = jrn_rec.icount;
+    }
+    jrn_apply (&jrn_after);
+    jrn_after.delay = 0;
+    cpu_state_apply (&jrn_after);
+    jrn_read ();
+}
+
+
+/*
+ *  sim_instr entry: record what SCP has changed, replay it
+ */
+t_stat m20_jrn_run (void)
+{
+    if (m20_jrn_mode == JRN_RECORD) {
+        cpu_state_save (&jrn_before);
+        jrn_put_changes (&jrn_last, &jrn_before, jrn_started ? JRN_RUN : JRN_START);
+        jrn_started = 1;
+        return ferror (jrn_file) ? SCPE_IOERR : SCPE_OK;
+    }
+
+    if ((jrn_rec.kind == JRN_START) ||
+        ((jrn_rec.kind == JRN_RUN) && (jrn_rec.icount == cpu_inst_count)))
+        jrn_resume ();
+    if ((jrn_rec.kind == JRN_END) && (jrn_rec.icount == cpu_inst_count)) {
+        sim_printf ("Replay: end of %s, devices are used from now\n", jrn_name);
+        jrn_close ();
+    }
+    jrn_set_mark ();
+    return SCPE_OK;
+}
+
+
+/*
+ *  sim_instr exit: state for next resume record, end record
+ */
+void m20_jrn_stop (void)
+{
+    long pos;
+
+    if (m20_jrn_mode != JRN_RECORD) return;
+
+    cpu_state_save (&jrn_last);
+    if (jrn_end_pos >= 0) fseek (jrn_file, jrn_end_pos, SEEK_SET);
+    pos = ftell (jrn_file);
+    putc (JRN_END, jrn_file);
+    jrn_put (cpu_inst_count);
+    fflush (jrn_file);
+    jrn_end_pos = pos;
+}
+
+
+/*
+ *  ICOUNT has reached cpu_inst_mark, called from cpu_retire_inst
+ */
+t_stat m20_jrn_mark (t_stat r)
+{
+    if ((m20_jrn_mode == JRN_REPLAY) && (jrn_rec.kind == JRN_RUN) &&
+        (jrn_rec.icount == cpu_inst_count) && (r == SCPE_OK))
+        jrn_resume ();                          /* on stop: by m20_jrn_run */
+
+    if ((m20_jrn_mode == JRN_REPLAY) && (jrn_rec.kind == JRN_END) &&
+        (jrn_rec.icount == cpu_inst_count)) {
+        sim_printf ("Replay: end of %s at ICOUNT %" LL_FMT "u\n", jrn_name, cpu_inst_count);
+        jrn_close ();
+        if (r == SCPE_OK) r = STOP_ICOUNT;
+    }
+
+    if ((m20_jrn_mode == JRN_REPLAY) && (jrn_rec.kind == JRN_IO) &&
+        (jrn_rec.icount < cpu_inst_count)) {
+        sim_printf ("Replay: no %02o %04o %04o %04o at ICOUNT %" LL_FMT "u\n",
+                    jrn_rec.op, jrn_rec.a1, jrn_rec.a2, jrn_rec.a3, jrn_rec.icount);
+        jrn_close ();
+        if (r == SCPE_OK) r = STOP_REPLAY;
+    }
+
+    if ((cpu_inst_count == jrn_stopat) && (r == SCPE_OK))
+        r = STOP_ICOUNT;
+
+    jrn_set_mark ();
+    return r;
+}
+
+
+/*
+ *  I/O instruction, called by its handler io when journal is on
+ */
+t_stat m20_jrn_io (int op, int a1, int a2, int a3, M20_JRN_IO io)
+{
+    t_stat r;
+
+    if (m20_jrn_mode == JRN_RECORD) {
+        cpu_state_save (&jrn_before);
+        m20_jrn_mode = JRN_OFF;
+        r = io (op, a1, a2, a3);
+        m20_jrn_mode = JRN_RECORD;
+        cpu_state_save (&jrn_after);
+
+        jrn_put_head (JRN_IO);
+        jrn_put (op);
+        jrn_put (a1);
+        jrn_put (a2);
+        jrn_put (a3);
+        jrn_put (r);
+        jrn_put_time (jrn_after.delay - jrn_before.delay);
+        jrn_put_changes (&jrn_before, &jrn_after, JRN_IO);
+        if (sim_deb && cpu_dev.dctrl)
+            fprintf (sim_deb, "cpu: journal %02o %04o %04o %04o at ICOUNT %" LL_FMT "u recorded\n",
+                     op, a1, a2, a3, cpu_inst_count);
+        if ((r == SCPE_OK) && ferror (jrn_file)) r = SCPE_IOERR;
+        return r;
+    }
+
+    if ((jrn_rec.kind != JRN_IO) || (jrn_rec.icount != cpu_inst_count) || (jrn_rec.op != op) ||
+        (jrn_rec.a1 != a1) || (jrn_rec.a2 != a2) || (jrn_rec.a3 != a3)) {
+        sim_printf ("Replay: %02o %04o %04o %04o at ICOUNT %" LL_FMT "u, journal has ",
+                    op, a1, a2, a3, cpu_inst_count);
+        if (jrn_rec.kind == JRN_IO)
+            sim_printf ("%02o %04o %04o %04o", jrn_rec.op, jrn_rec.a1, jrn_rec.a2, jrn_rec.a3);
+        else if (jrn_rec.kind == JRN_EOF)
+            sim_printf ("no more records\n");
+        else
+            sim_printf ("%s", (jrn_rec.kind == JRN_END) ? "end" : "resume");
+        if (jrn_rec.kind != JRN_EOF)
+            sim_printf (" at ICOUNT %" LL_FMT "u\n", jrn_rec.icount);
+        jrn_close ();
+        return STOP_REPLAY;
+    }
+
+    cpu_state_save (&jrn_after);
+    jrn_apply (&jrn_after);
+    jrn_after.delay += jrn_rec.time;
+    cpu_state_apply (&jrn_after);
+    r = jrn_rec.status;
+    if (sim_deb && cpu_dev.dctrl)
+        fprintf (sim_deb, "cpu: journal %02o %04o %04o %04o at ICOUNT %" LL_FMT "u replayed\n",
+                 op, a1, a2, a3, cpu_inst_count);
+    jrn_read ();
+    jrn_set_mark ();
+    return r;
+}
+
+
+/*
+ *  SET CPU RECORD=file (0), REPLAY=file (1), NOJOURNAL (2), STOPAT=n (3), NOSTOPAT (4)
+ */
+t_stat m20_jrn_set (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+    char magic[sizeof(JRN_MAGIC)];
+    FILE * f;
+    t_stat r;
+
+    if ((val == 0) || (val == 1) || (val == 3)) {
+        if ((cptr == NULL) || (*cptr == '\0')) return SCPE_MISVAL;
+    }
+    else if (cptr) return SCPE_ARG;
+
+    switch (val) {
+      case 0:
+      case 1:
+        f = sim_fopen (cptr, (val == 0) ? "wb" : "rb");
+        if (f == NULL) return SCPE_OPENERR;
+        if (val == 1) {
+            if ((fread (magic, 1, sizeof(JRN_MAGIC) - 1, f) != sizeof(JRN_MAGIC) - 1) ||
+                memcmp (magic, JRN_MAGIC, sizeof(JRN_MAGIC) - 1)) {
+                fclose (f);
+                return SCPE_FMT;
+            }
+        }
+        else fputs (JRN_MAGIC, f);
+        jrn_close ();
+        jrn_file = f;
+        strlcpy (jrn_name, cptr, sizeof(jrn_name));
+        jrn_records = 0;
+        if (val == 0) {
+            m20_jrn_mode = JRN_RECORD;
+            memset (&jrn_last, 0, sizeof(jrn_last));
+            jrn_started = 0;
+        }
+        else {
+            m20_jrn_mode = JRN_REPLAY;
+            jrn_read ();
+            if (jrn_rec.kind != JRN_START) {
+                jrn_close ();
+                return SCPE_FMT;
+            }
+        }
+        break;
+
+      case 2:
+        jrn_close ();
+        break;
+
+      case 3:
+        jrn_stopat = get_uint (cptr, 10, JRN_NONE - 1, &r);
+        if (r != SCPE_OK) {
+            jrn_stopat = JRN_NONE;
+            return SCPE_ARG;
+        }
+        break;
+
+      case 4:
+        jrn_stopat = JRN_NONE;
+        break;
+    }
+    jrn_set_mark ();
+    return SCPE_OK;
+}
+
+
+/*
+ *  SHOW CPU JOURNAL
+ */
+t_stat m20_jrn_show (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+    if (m20_jrn_mode == JRN_RECORD)
+        fprintf (st, "recording %s, %ld records\n", jrn_name, jrn_records);
+    else if (m20_jrn_mode == JRN_REPLAY) {
+        fprintf (st, "replaying %s, ", jrn_name);
+        if (jrn_rec.kind == JRN_EOF) fprintf (st, "no more records\n");
+        else fprintf (st, "next record at ICOUNT %" LL_FMT "u\n", jrn_rec.icount);
+    }
+    else
+        fprintf (st, "no journal\n");
+    fprintf (st, "ICOUNT %" LL_FMT "u", cpu_inst_count);
+    if (jrn_stopat != JRN_NONE)
+        fprintf (st, ", stop at %" LL_FMT "u", jrn_stopat);
+    fprintf (st, "\n");
+    return SCPE_OK;
+}
+
+
+/*
+ *  Child k of FORK: record into <file>.k from its start, replay
+ *  from the same record. File of parent is left to it.
+ */
+void m20_jrn_forked (int k)
+{
+    char name[CBUFSIZE];
+    FILE * f;
+
+    if (m20_jrn_mode == JRN_RECORD) {
+        _snprintf (name, sizeof(name), "%s.%d", jrn_name, k);
+        f = sim_fopen (name, "wb");
+        if (f) fputs (JRN_MAGIC, f);
+    }
+    else if (m20_jrn_mode == JRN_REPLAY) {
+        strlcpy (name, jrn_name, sizeof(name));
+        f = sim_fopen (name, "rb");
+        if (f) fseek (f, ftell (jrn_file), SEEK_SET);
+    }
+    else return;
+
+    if (f == NULL) {
+        fprintf (stderr, "Journal %s: %s\n", name, strerror (errno));
+        m20_jrn_mode = JRN_OFF;
+        jrn_file = NULL;
+        jrn_set_mark ();
+        return;
+    }
+    jrn_file = f;
+    jrn_end_pos = -1;
+    strlcpy (jrn_name, name, sizeof(jrn_name));
+    if (m20_jrn_mode == JRN_RECORD) {
+        memset (&jrn_last, 0, sizeof(jrn_last));
+        jrn_started = 0;
+        jrn_records = 0;
+    }
+}
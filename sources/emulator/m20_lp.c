@@ -19,6 +19,8 @@
  *  05-Dec-2014  DVS  Minor fixes
  *  27-Dec-2014  DVS  Added +,- bcd-codes according [1973 Lavrov]
  *  11-Mar-2025  LOY  Add some const in declarations, as in SIMH declarations
+ *  18-Oct-2026  AGT  Line-buffered output, no ftell per character
+ *  18-Oct-2026  AGT  lp_state_save/lp_state_restore for libm20
  *
  */
 
@@ -32,6 +34,8 @@
 #define UNIT_V_OCTALHELPFMT     (UNIT_V_UF + 1)         
 #define UNIT_OCTALHELPFMT       (1u << UNIT_V_OCTALHELPFMT)
 
+#define LPT_OUT_BUF_SIZE        256                     /* output line buffer */
+
 
 /* external memory references */
 extern t_value  msu_drum_print_buf[MSU_DRUM_PRINT_BUF_SIZE];
@@ -55,6 +59,7 @@ extern double m20_to_ieee (t_value word);
 t_stat lpt_reset (DEVICE *dptr);
 t_stat lpt_attach (UNIT *uptr, const char *cptr);
 t_stat lpt_detach (UNIT *uptr);
+t_stat flush_lp_line (void);
 
 
 static t_value  lp_sum = 0;
@@ -66,6 +71,9 @@ static char cr_lf_str[] = "\r\n";
 
 static char lbuf[LPT_WIDTH + 1];                        /* + null */
 
+static char   lp_out_buf[LPT_OUT_BUF_SIZE];             /* current output line */
+static size_t lp_out_buf_len = 0;
+
 
 /* 
    LPT data structures
@@ -142,6 +150,7 @@ t_stat lpt_attach (UNIT *uptr, const char *cptr)
 
     lp_sum = 0;
     memset( lbuf, 0, sizeof(lbuf) );
+    lp_out_buf_len = 0;
 
     active_lpt++;
 
@@ -153,6 +162,7 @@ t_stat lpt_detach (UNIT *uptr)
 {
     if (sim_deb && lpt_dev.dctrl) fprintf (sim_deb, "lpt: lpt_detach(..)\n");
 
+    if (uptr->flags & UNIT_ATT) flush_lp_line ();
     lp_sum = 0;
     memset( lbuf, 0, sizeof(lbuf) );
 
@@ -163,10 +173,19 @@ t_stat lpt_detach (UNIT *uptr)
 
 
 
-t_stat  output_lp_char( char ch )
+/*
+ * Output is collected into line buffer and written by one call per line;
+ * unit position is counted instead of ftell after every character.
+ */
+t_stat  flush_lp_line( void )
 {
-    fputc(ch, lpt_unit.fileref);                         /* write line */
-    lpt_unit.pos = ftell (lpt_unit.fileref);               /* update position */
+    size_t len = lp_out_buf_len;
+
+    lp_out_buf_len = 0;
+    if (len == 0) return SCPE_OK;
+
+    if (fwrite (lp_out_buf, 1, len, lpt_unit.fileref) == len)   /* write line */
+        lpt_unit.pos += (t_addr)len;                       /* update position */
 
     if (ferror (lpt_unit.fileref)) {                       /* error? */
         perror ("Line printer I/O error");
@@ -179,15 +198,24 @@ t_stat  output_lp_char( char ch )
 
 
 
+t_stat  output_lp_char( char ch )
+{
+    lp_out_buf[lp_out_buf_len++] = ch;
+    if ((ch == '\n') || (lp_out_buf_len == sizeof(lp_out_buf)))
+        return flush_lp_line ();
+
+    return SCPE_OK;
+}
+
+
+
 t_stat  output_lp_line( char * out_line )
 {
-    fputs (out_line, lpt_unit.fileref);                         /* write line */
-    lpt_unit.pos = ftell (lpt_unit.fileref);               /* update position */
+    t_stat err;
 
-    if (ferror (lpt_unit.fileref)) {                       /* error? */
-        perror ("Line printer I/O error");
-        clearerr (lpt_unit.fileref);
-        return SCPE_IOERR;
+    while (*out_line) {
+        err = output_lp_char (*out_line++);
+        if (err) return err;
     }
 
     return SCPE_OK;
@@ -713,6 +741,9 @@ t_stat write_line_printer (int start_addr, int end_addr, int zone_buf_addr,
 
     if (ocodes != NULL) *ocodes = out_codes;
 
+    err = flush_lp_line ();
+    if (err) return err;
+
     /* reset output buffer */
     output_codes_count = 0;
     lp_sum = 0;
@@ -722,3 +753,32 @@ t_stat write_line_printer (int start_addr, int end_addr, int zone_buf_addr,
     return SCPE_OK;
 }
 
+
+
+/*
+ * Save line printer of machine (libm20).
+ * Line buffer is written out first.
+ */
+void lp_state_save (M20_LP_STATE * st)
+{
+    if (lpt_unit.flags & UNIT_ATT) flush_lp_line ();
+
+    st->unit = lpt_unit;
+    st->sum = lp_sum;
+    st->codes_count = output_codes_count;
+    st->print_width = print_width;
+    st->decimal_print_type = decimal_print_type;
+}
+
+
+/*
+ * Restore line printer of machine (libm20).
+ */
+void lp_state_restore (const M20_LP_STATE * st)
+{
+    lpt_unit = st->unit;
+    lp_sum = st->sum;
+    output_codes_count = st->codes_count;
+    print_width = st->print_width;
+    decimal_print_type = st->decimal_print_type;
+}
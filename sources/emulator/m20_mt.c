@@ -23,6 +23,10 @@
  *                    Added tape read/write data dump debugging option
  *  13-May-2023  LOY  Make variables for external devices external itself
  *  11-Mar-2025  LOY  Add some const in declarations, as in SIMH declarations
+ *  18-Oct-2026  AGT  Zone index, read/write of zone without scan of tape
+ *  18-Oct-2026  AGT  mt_state_save/mt_state_restore for libm20
+ *  18-Oct-2026  AGT  Zone write is written behind by worker thread (m20_aio)
+ *  18-Oct-2026  AGT  Copy-on-write overlay on tape (att -o, det -c)
  *
  */
 
@@ -123,6 +127,163 @@ extern t_value  cyclic_checksum( t_value x, t_value y);
 static t_value  temp_zone_buf[MAX_TAPE_ZONE_SIZE+1];
 
 
+/*
+ * Индекс зон МЛ.
+ * Zones of attached tape in file order: number, size, file offset and
+ * count of codes passed by linear search before the zone. Index is built
+ * from zone headers on attach and appended by mt_format_tape, so read
+ * or write of zone takes one seek instead of scan from the beginning.
+ * Stop codes and codes counts are the same as for linear search.
+ * Damaged tail of tape (truncated zone, bad zone size) is left to linear
+ * search; with MT debugging linear search is always used.
+ */
+typedef struct mt_zone {
+    int       num;                      /* zone number */
+    int       size;                     /* zone size, words */
+    long      pos;                      /* file offset of zone header */
+    int       codes;                    /* codes passed before zone */
+    int       max_num;                  /* max zone number up to this zone */
+} MT_ZONE;
+
+typedef struct mt_index {
+    int       valid;
+    int       clean;                    /* no damaged tail after last zone */
+    int       count, alloc;
+    int       end_codes;                /* codes in all zones */
+    int       first[MAX_TAPE_ZONE_NUM+1];   /* first zone with number, -1 if none */
+    MT_ZONE * zones;
+} MT_INDEX;
+
+static MT_INDEX  mt_index[MAX_TAPES_COUNT];
+
+
+/*
+ *  Free tape zone index
+ */
+static void mt_index_free (int mt_no)
+{
+    free (mt_index[mt_no].zones);
+    memset (&mt_index[mt_no], 0, sizeof(MT_INDEX));
+}
+
+
+/*
+ *  Append zone to tape zone index
+ */
+static int mt_index_add (MT_INDEX * ix, int num, int size, long pos)
+{
+    MT_ZONE * z;
+    int n;
+
+    if (ix->count == ix->alloc) {
+	n = ix->alloc ? 2*ix->alloc : 64;
+	z = (MT_ZONE *) realloc (ix->zones, n * sizeof(MT_ZONE));
+	if (z == NULL) return 0;
+	ix->zones = z;
+	ix->alloc = n;
+    }
+
+    z = &ix->zones[ix->count];
+    z->num = num;
+    z->size = size;
+    z->pos = pos;
+    z->codes = ix->end_codes;
+    z->max_num = num;
+    if (ix->count && (z[-1].max_num > num)) z->max_num = z[-1].max_num;
+    if ((num <= MAX_TAPE_ZONE_NUM) && (ix->first[num] < 0)) ix->first[num] = ix->count;
+
+    ix->count++;
+    ix->end_codes += size + 2;
+    return 1;
+}
+
+
+/*
+ *  Get tape zone index, build it if needed
+ */
+static MT_INDEX * mt_index_get (int mt_no)
+{
+    MT_INDEX * ix = &mt_index[mt_no];
+    FILE * f = mt_unit[mt_no].fileref;
+    t_value  temp_value;
+    long  pos, tape_len;
+    int  i, num, size;
+
+    if (ix->valid) return ix;
+
+    mt_index_free (mt_no);
+    for( i=0; i<=MAX_TAPE_ZONE_NUM; i++ ) ix->first[i] = -1;
+
+    if (fseek (f, 0, SEEK_END)) return NULL;
+    tape_len = ftell (f);
+
+    ix->clean = 1;
+    pos = 0;
+    while( pos < tape_len ) {
+	if (fseek (f, pos, SEEK_SET) ||
+	    (fxread (&temp_value, sizeof(t_value), 1, f) != 1)) {
+	    ix->clean = 0;
+	    break;
+	}
+	num = temp_value & 0xFFFFFFF;
+	size = temp_value >> BITS_32;
+	if ((size < 0) || (size > MAX_TAPE_ZONE_SIZE) ||
+	    (pos + (long)((size+2)*sizeof(t_value)) > tape_len)) {
+	    ix->clean = 0;
+	    break;
+	}
+	if (!mt_index_add (ix, num, size, pos)) {
+	    mt_index_free (mt_no);
+	    return NULL;
+	}
+	pos += (size+2)*sizeof(t_value);
+    }
+
+    ix->valid = 1;
+    return ix;
+}
+
+
+/*
+ *  Find zone in tape zone index.
+ *  If zone is not found, *err is stop code of linear search (with codes
+ *  count in *ocodes), or SCPE_OK if linear search is needed.
+ */
+static MT_ZONE * mt_index_find (int mt_no, int user_zone_num, t_stat * err, int * ocodes)
+{
+    MT_INDEX * ix;
+    int  lo, hi, mid, k;
+
+    *err = SCPE_OK;
+    if (sim_deb && mt_dev.dctrl) return NULL;
+
+    ix = mt_index_get (mt_no);
+    if (ix == NULL) return NULL;
+
+    /* linear search stops on first zone with greater number */
+    lo = 0;
+    hi = ix->count;
+    while( lo < hi ) {
+	mid = (lo + hi) / 2;
+	if (ix->zones[mid].max_num > user_zone_num) hi = mid;
+	else lo = mid + 1;
+    }
+
+    k = ix->first[user_zone_num];
+    if ((k >= 0) && (k < lo)) return &ix->zones[k];
+
+    if (lo < ix->count) {
+	*err = STOP_NOTAPEZONE;
+	if (ocodes) *ocodes = ix->zones[lo].codes + ix->zones[lo].size + 2;
+    }
+    else if (ix->clean) {
+	*err = STOP_NOTAPE;
+	if (ocodes) *ocodes = ix->end_codes;
+    }
+    return NULL;
+}
+
+
 /*
  *  Событие: закончен обмен с МЛ.
  */
@@ -160,8 +321,14 @@ t_stat mt_attach (UNIT *uptr, const char *cptr)
     t_stat s;
 
     sim_cancel(uptr);				           /* cancel current IO */
-   
-    s = attach_unit (uptr, cptr);
+
+    /* att -o: writes go into overlay, tape is not changed (m20_ovl) */
+    if (sim_switches & SWMASK ('O'))
+        s = m20_ovl_attach (uptr, cptr);
+    else
+        s = attach_unit (uptr, cptr);
+    mt_index_free ((int)(uptr - mt_unit));
+    if (s == SCPE_OK) mt_index_get ((int)(uptr - mt_unit));
 
     if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_attach(..), name='%s' res=%d\n", cptr, s);
 
@@ -175,12 +342,17 @@ t_stat mt_attach (UNIT *uptr, const char *cptr)
  */
 t_stat mt_detach (UNIT *uptr)
 {
+    t_stat s, err;
 
     if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_detach(..)\n");
 
     sim_cancel(uptr);
+    err = m20_aio_wait (uptr);
+    mt_index_free ((int)(uptr - mt_unit));
 
-    return detach_unit (uptr);
+    /* det -c: overlay is written into tape */
+    s = m20_ovl_detach (uptr, (sim_switches & SWMASK ('C')) != 0);
+    return (s != SCPE_OK) ? s : err;
 }
 
 
@@ -203,6 +375,7 @@ t_stat mt_format_tape (t_value *sum, int * ocodes, int first, int last)
     int codes_num = 0;
     int no_mosu_access = 0;
     int user_mt_no, tape_chk, j;
+    int index_ok;
     //int first, last;
     unsigned long int  tape_len;
 
@@ -266,6 +439,9 @@ t_stat mt_format_tape (t_value *sum, int * ocodes, int first, int last)
 
     if ((zone_num > MAX_TAPE_ZONE_NUM) || (zone_num < MIN_TAPE_ZONE_NUM)) return STOP_TAPEFMTINVAL;
 
+    res = m20_aio_wait (&mt_unit[mt_no]);
+    if (res) return res;
+
     /* detect tape length */
     if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: format_tape(): get tape length\n");
     res = fseek (mt_unit[mt_no].fileref, 0, SEEK_END);
@@ -285,6 +461,10 @@ t_stat mt_format_tape (t_value *sum, int * ocodes, int first, int last)
     if ((last_fmt_pos+(codes_group_size+1+1)*sizeof(t_value)) > MAX_TAPE_SIZE*sizeof(t_value)) 
         return STOP_TAPEBADFLEN;
 
+    /* index is appended if zone is written in full */
+    index_ok = mt_index[mt_no].valid && mt_index[mt_no].clean;
+    mt_index[mt_no].valid = 0;
+
     /* 
        Write zone number and size.
        In real M-20 zone was written twice and no codes count was written.
@@ -330,6 +510,9 @@ t_stat mt_format_tape (t_value *sum, int * ocodes, int first, int last)
     codes_num++;
     if (ocodes) *ocodes = codes_num;
     if (sum) *sum = chksum;
+
+    if (index_ok)
+        mt_index[mt_no].valid = mt_index_add (&mt_index[mt_no], zone_num, codes_group_size, last_fmt_pos);
 	
     return SCPE_OK;
 }
@@ -337,6 +520,51 @@ t_stat mt_format_tape (t_value *sum, int * ocodes, int first, int last)
 
 
 
+/*
+ * Запись данных в найденную зону МЛ с позиции файла pos.
+ * Words and checksum are written behind (m20_aio), results are ready at once.
+ */
+static t_stat mt_write_zone (int mt_no, long pos, int first, int userwords, t_value *sum, int * ocodes,
+                             int codes_num, int no_mosu_access, int disable_control)
+{
+    int  i, nwords;
+    t_value  temp_value, chksum;
+
+    if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_write(): write zone data or zeroes\n");
+    chksum = 0;
+    for( i=0; i<userwords; i++ ) {
+        if (no_mosu_access) temp_value = 0;
+        else temp_value = mosu_load(first+i);
+        if (sim_deb && mt_dev.dctrl) {
+          if (tape_write_data_dump) fprintf (sim_deb, "mt: write_value=%015llo\n",temp_value);
+        }
+        chksum = cyclic_checksum (chksum, temp_value);
+        //if (sim_deb && mt_dev.dctrl)
+        //    fprintf (sim_deb, "mt: mt_write(): mosu[%04o]=%015llo\n", first+i,temp_value);
+        temp_zone_buf[i] = temp_value;
+    }
+    codes_num += userwords;
+    nwords = userwords;
+    /* Write last checksum (for all user data) */
+    if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_write(): sum=%015llo\n", chksum);
+    if (!disable_control) {
+      if (sim_deb && mt_dev.dctrl) {
+        if (tape_write_data_dump) fprintf (sim_deb, "mt: write_value=%015llo\n", chksum);
+      }
+      temp_zone_buf[nwords++] = chksum;
+      if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_write(): write_data_chksum_count=1\n");
+      codes_num++;
+    }
+    /* store results */
+    if (sum) *sum = chksum;
+    if (ocodes) *ocodes = codes_num;
+    if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: writing_done\n");
+
+    return m20_aio_write (&mt_unit[mt_no], pos, temp_zone_buf, nwords);
+}
+
+
+
 /*
  * Запись на МЛ.
  * Если параметр sum ненулевой, посчитываем и кладём туда контрольную
@@ -345,10 +573,12 @@ t_stat mt_format_tape (t_value *sum, int * ocodes, int first, int last)
 t_stat mt_write (int mt_no, int user_zone_num, int first, int last, t_value *sum, int * ocodes, 
                  int no_mosu_access, int disable_control)
 {
-    int  nwords, count, userwords, i, codes_num, res;
+    int  nwords, count, userwords, codes_num, res;
     int  cur_zone_num, cur_zone_size;
     t_value  temp_value, chksum;
     unsigned long int  tape_len, cur_tape_pos;
+    MT_ZONE * zone;
+    t_stat  err;
 
     if (sim_deb && mt_dev.dctrl)
 	fprintf (sim_deb, "mt: mt_write(%d,%05o,%04o,%04o,..)\n", mt_no, user_zone_num, first, last);
@@ -367,6 +597,24 @@ t_stat mt_write (int mt_no, int user_zone_num, int first, int last, t_value *sum
     /* Неверная длина записи на МЛ (д.б. не более макс.длины зоны)*/
     if ((userwords < MIN_TAPE_ZONE_SIZE) || (userwords > MAX_TAPE_ZONE_SIZE)) return STOP_TAPEBADWLEN;
 
+    /* find zone by index, building of index reads tape */
+    if (!mt_index[mt_no].valid) {
+        err = m20_aio_wait (&mt_unit[mt_no]);
+        if (err) return err;
+    }
+    zone = mt_index_find (mt_no, user_zone_num, &err, ocodes);
+    if (zone) {
+        if (ocodes) *ocodes = zone->codes + 1;
+        if (userwords > zone->size) return STOP_TAPELARGEDATA;
+        return mt_write_zone (mt_no, zone->pos + sizeof(t_value), first, userwords, sum, ocodes,
+                              zone->codes + 1, no_mosu_access, disable_control);
+    }
+    if (err) return err;
+
+    /* linear search reads tape */
+    err = m20_aio_wait (&mt_unit[mt_no]);
+    if (err) return err;
+
     /* detect tape length */
     if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_write(): get tape length\n");
     res = fseek (mt_unit[mt_no].fileref, 0, SEEK_END);
@@ -422,47 +670,11 @@ t_stat mt_write (int mt_no, int user_zone_num, int first, int last, t_value *sum
             cur_tape_pos = ftell (mt_unit[mt_no].fileref);
             if (sim_deb && mt_dev.dctrl)
 	        fprintf (sim_deb, "mt: mt_write(): cur_tape_pos=%d, tape_len=%d\n", cur_tape_pos, tape_len );
-            res = fseek (mt_unit[mt_no].fileref, cur_tape_pos, SEEK_SET);
-            if (res) return SCPE_IOERR;
-            if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_write(): write zone data or zeroes\n");
-            chksum = 0;
-            for( i=0; i<userwords; i++ ) {
-                if (no_mosu_access) temp_value = 0;
-                else temp_value = mosu_load(first+i);
-                if (sim_deb && mt_dev.dctrl) {
-                  if (tape_write_data_dump) fprintf (sim_deb, "mt: write_value=%015llo\n",temp_value);
-                }
-                chksum = cyclic_checksum (chksum, temp_value);
-                //if (sim_deb && mt_dev.dctrl)
-	        //    fprintf (sim_deb, "mt: mt_write(): mosu[%04o]=%015llo\n", first+i,temp_value);
-                count = (int)fxwrite (&temp_value, sizeof(t_value), 1, mt_unit[mt_no].fileref);
-                if (ferror (mt_unit[mt_no].fileref)) return SCPE_IOERR;
-                if (count != 1) return SCPE_IOERR;
-                codes_num++;
-                if (ocodes) *ocodes = codes_num;
-            }
-            /* Write last checksum (for all user data) */
-            //if (sum) {
-            if (1) {
-              if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_write(): sum=%015llo\n", chksum);
-              temp_value = chksum;
-              if (!disable_control) {
-                if (sim_deb && mt_dev.dctrl) {
-                  if (tape_write_data_dump) fprintf (sim_deb, "mt: write_value=%015llo\n", temp_value);
-                }
-                count = (int)fxwrite (&temp_value, sizeof(t_value), 1, mt_unit[mt_no].fileref);
-                if (sim_deb && mt_dev.dctrl) 
-                  fprintf (sim_deb, "mt: mt_write(): write_data_chksum_count=%d\n", count);
-                if (ferror (mt_unit[mt_no].fileref)) return SCPE_IOERR;
-                if (count != 1) return SCPE_IOERR;
-                codes_num++;
-              }
-              /* store results */
-              if (sum) *sum = chksum;
-              if (ocodes) *ocodes = codes_num;
-            }
-            if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: writing_done\n");
-            return SCPE_OK;
+            res = mt_write_zone (mt_no, cur_tape_pos, first, userwords, sum, ocodes, codes_num,
+                                 no_mosu_access, disable_control);
+            /* zone may be in damaged tail of tape */
+            if (!mt_index[mt_no].clean) mt_index[mt_no].valid = 0;
+            return res;
 	}
 
 
@@ -517,6 +729,48 @@ t_stat mt_write (int mt_no, int user_zone_num, int first, int last, t_value *sum
 
 
 
+/*
+ * Перенос в МОСУ данных найденной зоны МЛ из temp_zone_buf.
+ */
+static t_stat mt_read_zone (int cur_zone_size, t_value chksum, int first, int userwords,
+                            t_value *sum, int no_mosu_access, int disable_control)
+{
+    int  i;
+    t_value  temp_value, calc_sum, user_chksum;
+
+    /* Check zone size to write */
+    if (sim_deb && mt_dev.dctrl)
+        fprintf (sim_deb, "mt: mt_read(): userwords=%d, cur_zone_size=%d\n", userwords, cur_zone_size );
+    if (userwords > cur_zone_size) userwords = cur_zone_size;
+    if (sim_deb && mt_dev.dctrl)
+        fprintf (sim_deb, "mt: mt_read(): [new] userwords=%d, cur_zone_size=%d\n", userwords, cur_zone_size );
+    if (userwords < cur_zone_size) {
+        user_chksum =  temp_zone_buf[userwords];
+        if (sim_deb && mt_dev.dctrl)
+            fprintf (sim_deb, "mt: mt_read(): user_chksum=%015llo\n", user_chksum );
+        chksum = user_chksum;
+        if (sim_deb && mt_dev.dctrl)
+            fprintf (sim_deb, "mt: mt_read(): new_real_chksum=%015llo\n", user_chksum );
+    }
+    /* Copy tape zone data */
+    calc_sum = 0;
+    for( i=0; i<userwords; i++ ) {
+        temp_value = temp_zone_buf[i];
+        if (!no_mosu_access) mosu_store(first+i,temp_value);
+        calc_sum = cyclic_checksum (calc_sum, temp_value);
+    }
+    if (sim_deb && mt_dev.dctrl)
+      fprintf (sim_deb, "mt: mt_read(): read_chksum=%015llo calc_chksum=%015llo\n", chksum, calc_sum );
+    if (sum) {
+      if (sum) *sum = calc_sum;
+      if (!disable_control && (calc_sum != chksum)) return STOP_TAPEREADERR;
+    }
+    if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: reading_done\n");
+    return SCPE_OK;
+}
+
+
+
 /*
  * Чтение с МЛ
  */
@@ -525,14 +779,20 @@ t_stat mt_read (int mt_no, int user_zone_num, int first, int last, t_value *sum,
 {
     int  nwords, count, userwords, i, codes_num, res;
     int  cur_zone_num, cur_zone_size;
-    t_value  temp_value, chksum, calc_sum, user_chksum;
+    t_value  temp_value, chksum;
     unsigned long tape_len, cur_tape_pos;
+    MT_ZONE * zone;
+    t_stat  err;
 
     if (sim_deb && mt_dev.dctrl)
 	fprintf (sim_deb, "mt: mt_read(%d,%05o,%04o,%04o,..)\n", mt_no, user_zone_num, first, last);
 
     if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_read(): no_mosu_access=%d\n", no_mosu_access );
 
+    /* zone may be written behind yet */
+    err = m20_aio_wait (&mt_unit[mt_no]);
+    if (err) return err;
+
     /* wrong zone address? */
     if ((user_zone_num > MAX_TAPE_ZONE_NUM) || (user_zone_num < MIN_TAPE_ZONE_NUM)) return STOP_TAPEINVZONE;
 
@@ -545,6 +805,24 @@ t_stat mt_read (int mt_no, int user_zone_num, int first, int last, t_value *sum,
       fprintf (sim_deb, "mt: read: no_mosu_access=%d, disable_control=%d\n", no_mosu_access, disable_control );
     }
 
+    /* find zone by index */
+    zone = mt_index_find (mt_no, user_zone_num, &err, ocodes);
+    if (zone) {
+        if (ocodes) *ocodes = zone->codes + 1;
+        res = fseek (mt_unit[mt_no].fileref, zone->pos + sizeof(t_value), SEEK_SET);
+        if (res) return SCPE_IOERR;
+        count = (int)fxread (temp_zone_buf, sizeof(t_value), zone->size, mt_unit[mt_no].fileref);
+        if (ferror (mt_unit[mt_no].fileref)) return SCPE_IOERR;
+        if (count != zone->size) return STOP_TAPEINVDATA;
+        count = (int)fxread (&chksum, sizeof(t_value), 1, mt_unit[mt_no].fileref);
+        if (ferror (mt_unit[mt_no].fileref)) return SCPE_IOERR;
+        if (count != 1) return STOP_TAPEINVDATA;
+        if (ocodes) *ocodes = zone->codes + zone->size + 2;
+        return mt_read_zone (zone->size, chksum, first, userwords, sum,
+                             no_mosu_access, disable_control);
+    }
+    if (err) return err;
+
     /* detect tape length */
     if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: mt_read(): get tape length\n");
     res = fseek (mt_unit[mt_no].fileref, 0, SEEK_END);
@@ -633,35 +911,8 @@ t_stat mt_read (int mt_no, int user_zone_num, int first, int last, t_value *sum,
 	if (cur_zone_num == user_zone_num) {
             if (sim_deb && mt_dev.dctrl)
 	        fprintf (sim_deb, "mt: mt_read(): matching_zone_found (%d==%d)\n", user_zone_num, cur_zone_num );
-	    /* Check zone size to write */
-            if (sim_deb && mt_dev.dctrl)
-	        fprintf (sim_deb, "mt: mt_read(): userwords=%d, cur_zone_size=%d\n", userwords, cur_zone_size );
-	    if (userwords > cur_zone_size) userwords = cur_zone_size;
-            if (sim_deb && mt_dev.dctrl)
-	        fprintf (sim_deb, "mt: mt_read(): [new] userwords=%d, cur_zone_size=%d\n", userwords, cur_zone_size );
-	    if (userwords < cur_zone_size) {
-                user_chksum =  temp_zone_buf[userwords];
-                if (sim_deb && mt_dev.dctrl)
-	            fprintf (sim_deb, "mt: mt_read(): user_chksum=%015llo\n", user_chksum );
-                chksum = user_chksum;
-                if (sim_deb && mt_dev.dctrl)
-	            fprintf (sim_deb, "mt: mt_read(): new_real_chksum=%015llo\n", user_chksum );
-	    }
-	    /* Copy tape zone data */
-            calc_sum = 0;
-	    for( i=0; i<userwords; i++ ) {
-	        temp_value = temp_zone_buf[i];
-	        if (!no_mosu_access) mosu_store(first+i,temp_value);
-                calc_sum = cyclic_checksum (calc_sum, temp_value);
-	    }
-            if (sim_deb && mt_dev.dctrl)
-	      fprintf (sim_deb, "mt: mt_read(): read_chksum=%015llo calc_chksum=%015llo\n", chksum, calc_sum );
-	    if (sum) {
-	      if (sum) *sum = calc_sum;
-              if (!disable_control && (calc_sum != chksum)) return STOP_TAPEREADERR;
-            }
-            if (sim_deb && mt_dev.dctrl) fprintf (sim_deb, "mt: reading_done\n");
-	    return SCPE_OK;
+	    return mt_read_zone (cur_zone_size, chksum, first, userwords, sum,
+	                         no_mosu_access, disable_control);
 	}
 
 
@@ -756,3 +1007,34 @@ t_stat mt_tape_io(t_value *sum, int * ocodes)
 
     return err;
 }
+
+
+
+/*
+ * Save tape units and switches of machine (libm20).
+ * Zone index is dropped, it is built again on next access.
+ */
+void mt_state_save (M20_MT_STATE * st)
+{
+    int i;
+
+    for (i = 0; i < MAX_TAPES_COUNT; i++) {
+         sim_cancel (&mt_unit[i]);
+         mt_index_free (i);
+    }
+
+    memcpy (st->unit, mt_unit, sizeof(st->unit));
+    memcpy (st->log_map, log_tape_map_array, sizeof(st->log_map));
+    memcpy (st->access_mode, tape_access_mode_array, sizeof(st->access_mode));
+}
+
+
+/*
+ * Restore tape units and switches of machine (libm20).
+ */
+void mt_state_restore (const M20_MT_STATE * st)
+{
+    memcpy (mt_unit, st->unit, sizeof(st->unit));
+    memcpy (log_tape_map_array, st->log_map, sizeof(st->log_map));
+    memcpy (tape_access_mode_array, st->access_mode, sizeof(st->access_mode));
+}
@@ -0,0 +1,415 @@
+/*
+ * File:     m20_ovl.c
+ * Purpose:  M-20 simulator copy-on-write overlay for drum and tape files
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * att -o drum0 base.drum0 opens base image read only. Unit gets overlay
+ * file instead: reads of untouched pages come from base, first write to
+ * a page copies it into memory, so base is never changed and attach does
+ * not depend on image size. Many jobs may share one base image.
+ *
+ * det drum0 drops written pages, det -c drum0 writes them into base.
+ *
+ * Overlay is stdio file with own read/write/seek (fopencookie, GNU C
+ * library), so drum and tape code does not know about it. On other hosts
+ * base is copied into temporary file on attach.
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *  18-Oct-2026  AGT  m20_ovl_fork for FORK
+ *
+ */
+
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "m20_defs.h"
+
+#if defined(__GLIBC__)
+#define M20_OVL_COOKIE
+#endif
+
+
+#define  OVL_PAGE   4096                        /* bytes */
+
+typedef struct m20_ovl {
+    struct m20_ovl * next;
+    FILE *    f;                                /* overlay, fileref of unit */
+    FILE *    base;                             /* base image, read only */
+#if defined(M20_OVL_COOKIE)
+    long      base_size;
+    long      size;                             /* with written pages */
+    long      pos;
+    long      npages;
+    char **   pages;                            /* written pages, NULL - in base */
+#endif
+} M20_OVL;
+
+static M20_OVL * ovl_list = NULL;
+
+
+/*
+ *  Overlay of file
+ */
+static M20_OVL * ovl_find (FILE * f)
+{
+    M20_OVL * o;
+
+    for (o = ovl_list; o != NULL; o = o->next)
+        if (o->f == f) return o;
+    return NULL;
+}
+
+
+static void ovl_unlink (M20_OVL * o)
+{
+    M20_OVL ** p;
+
+    for (p = &ovl_list; *p != NULL; p = &(*p)->next) {
+        if (*p == o) {
+            *p = o->next;
+            return;
+        }
+    }
+}
+
+
+#if defined(M20_OVL_COOKIE)
+
+/*
+ *  Read from base, zeroes past its end
+ */
+static int ovl_base_read (M20_OVL * o, long pos, char * buf, long n)
+{
+    long avail = o->base_size - pos;
+
+    memset (buf, 0, n);
+    if (avail <= 0) return 0;
+    if (n > avail) n = avail;
+    if (fseek (o->base, pos, SEEK_SET)) return -1;
+    if (fread (buf, 1, n, o->base) != (size_t)n) return -1;
+    return 0;
+}
+
+
+/*
+ *  Page for write, copied from base on first write
+ */
+static char * ovl_page (M20_OVL * o, long pg)
+{
+    char ** pages;
+    long n;
+
+    if (pg >= o->npages) {
+        n = (pg + 1) * 2;
+        pages = (char **) realloc (o->pages, n * sizeof(char *));
+        if (pages == NULL) return NULL;
+        memset (pages + o->npages, 0, (n - o->npages) * sizeof(char *));
+        o->pages = pages;
+        o->npages = n;
+    }
+    if (o->pages[pg] == NULL) {
+        o->pages[pg] = (char *) malloc (OVL_PAGE);
+        if (o->pages[pg] == NULL) return NULL;
+        if (ovl_base_read (o, pg * OVL_PAGE, o->pages[pg], OVL_PAGE)) {
+            free (o->pages[pg]);
+            o->pages[pg] = NULL;
+            return NULL;
+        }
+    }
+    return o->pages[pg];
+}
+
+
+static ssize_t ovl_read (void * cookie, char * buf, size_t size)
+{
+    M20_OVL * o = (M20_OVL *) cookie;
+    long pg, off, n, done = 0;
+
+    if (o->pos >= o->size) return 0;
+    if ((long)size > o->size - o->pos) size = o->size - o->pos;
+    while (done < (long)size) {
+        pg = o->pos / OVL_PAGE;
+        off = o->pos % OVL_PAGE;
+        n = OVL_PAGE - off;
+        if (n > (long)size - done) n = size - done;
+        if ((pg < o->npages) && o->pages[pg])
+            memcpy (buf + done, o->pages[pg] + off, n);
+        else if (ovl_base_read (o, o->pos, buf + done, n))
+            return -1;
+        done += n;
+        o->pos += n;
+    }
+    return done;
+}
+
+
+static ssize_t ovl_write (void * cookie, const char * buf, size_t size)
+{
+    M20_OVL * o = (M20_OVL *) cookie;
+    long pg, off, n, done = 0;
+    char * page;
+
+    while (done < (long)size) {
+        pg = o->pos / OVL_PAGE;
+        off = o->pos % OVL_PAGE;
+        n = OVL_PAGE - off;
+        if (n > (long)size - done) n = size - done;
+        page = ovl_page (o, pg);
+        if (page == NULL) break;
+        memcpy (page + off, buf + done, n);
+        done += n;
+        o->pos += n;
+        if (o->pos > o->size) o->size = o->pos;
+    }
+    return (done == 0 && size) ? -1 : done;
+}
+
+
+static int ovl_seek (void * cookie, off64_t * offset, int whence)
+{
+    M20_OVL * o = (M20_OVL *) cookie;
+    off64_t pos;
+
+    switch (whence) {
+        case SEEK_SET: pos = *offset; break;
+        case SEEK_CUR: pos = o->pos + *offset; break;
+        case SEEK_END: pos = o->size + *offset; break;
+        default: return -1;
+    }
+    if ((pos < 0) || (pos > LONG_MAX)) return -1;
+    o->pos = (long) pos;
+    *offset = pos;
+    return 0;
+}
+
+
+static int ovl_close (void * cookie)
+{
+    M20_OVL * o = (M20_OVL *) cookie;
+    long i;
+    int r;
+
+    ovl_unlink (o);
+    for (i = 0; i < o->npages; i++) free (o->pages[i]);
+    free (o->pages);
+    r = fclose (o->base);
+    free (o);
+    return r;
+}
+
+
+/*
+ *  Overlay file on base
+ */
+static FILE * ovl_open (M20_OVL * o)
+{
+    cookie_io_functions_t io = { ovl_read, ovl_write, ovl_seek, ovl_close };
+
+    if (fseek (o->base, 0, SEEK_END)) return NULL;
+    o->base_size = o->size = ftell (o->base);
+    if (o->base_size < 0) return NULL;
+    return fopencookie (o, "rb+", io);
+}
+
+
+/*
+ *  Write pages into base
+ */
+static t_stat ovl_commit (M20_OVL * o, const char * name)
+{
+    FILE * f;
+    long i, n;
+    t_stat r = SCPE_OK;
+
+    f = sim_fopen (name, "rb+");
+    if (f == NULL) return SCPE_OPENERR;
+    for (i = 0; i < o->npages; i++) {
+        if (o->pages[i] == NULL) continue;
+        n = o->size - i * OVL_PAGE;
+        if (n > OVL_PAGE) n = OVL_PAGE;
+        if (n <= 0) continue;
+        if (fseek (f, i * OVL_PAGE, SEEK_SET) ||
+            (fwrite (o->pages[i], 1, n, f) != (size_t)n)) {
+            r = SCPE_IOERR;
+            break;
+        }
+    }
+    if (fclose (f)) r = SCPE_IOERR;
+    return r;
+}
+
+#else
+
+/*
+ *  Copy file from start
+ */
+static t_stat ovl_copy (FILE * from, FILE * to)
+{
+    char buf[OVL_PAGE];
+    size_t n;
+
+    rewind (from);
+    rewind (to);
+    while ((n = fread (buf, 1, sizeof(buf), from)) > 0)
+        if (fwrite (buf, 1, n, to) != n) return SCPE_IOERR;
+    if (ferror (from) || fflush (to)) return SCPE_IOERR;
+    return SCPE_OK;
+}
+
+
+/*
+ *  Temporary copy of base
+ */
+static FILE * ovl_open (M20_OVL * o)
+{
+    FILE * f = tmpfile ();
+
+    if (f == NULL) return NULL;
+    if (ovl_copy (o->base, f) != SCPE_OK) {
+        fclose (f);
+        return NULL;
+    }
+    fclose (o->base);
+    o->base = NULL;
+    return f;
+}
+
+
+/*
+ *  Copy temporary file into base
+ */
+static t_stat ovl_commit (M20_OVL * o, const char * name)
+{
+    FILE * f;
+    t_stat r;
+
+    f = sim_fopen (name, "wb");
+    if (f == NULL) return SCPE_OPENERR;
+    r = ovl_copy (o->f, f);
+    if (fclose (f)) r = SCPE_IOERR;
+    return r;
+}
+
+#endif
+
+
+/*
+ *  Attach unit to overlay on base file (att -o)
+ */
+t_stat m20_ovl_attach (UNIT * uptr, CONST char * cptr)
+{
+    M20_OVL * o;
+    t_stat s;
+
+    o = (M20_OVL *) calloc (1, sizeof(M20_OVL));
+    if (o == NULL) return SCPE_MEM;
+
+    uptr->flags |= UNIT_RO;                     /* base is opened "rb", buffer is read */
+    s = attach_unit (uptr, cptr);
+    uptr->flags &= ~UNIT_RO;
+    if (s != SCPE_OK) {
+        free (o);
+        return s;
+    }
+
+    o->base = uptr->fileref;
+    o->f = ovl_open (o);
+    if (o->f == NULL) {
+        uptr->flags |= UNIT_RO;                 /* no write back of buffer */
+        detach_unit (uptr);
+        uptr->flags &= ~UNIT_RO;
+        free (o);
+        return SCPE_OPENERR;
+    }
+    uptr->fileref = o->f;
+    o->next = ovl_list;
+    ovl_list = o;
+
+    sim_messagef (SCPE_OK, "%s: copy-on-write overlay, %s is not changed until det -c\n",
+                  sim_uname (uptr), cptr);
+    return SCPE_OK;
+}
+
+
+/*
+ *  Unit of forked process (FORK): base is opened again, its file offset
+ *  is not shared with other processes; plain attached file becomes overlay
+ */
+t_stat m20_ovl_fork (UNIT * uptr)
+{
+    M20_OVL * o;
+    FILE * base;
+
+    base = sim_fopen (uptr->filename, "rb");
+    if (base == NULL) return SCPE_OPENERR;
+
+    o = ovl_find (uptr->fileref);
+    if (o != NULL) {
+#if defined(M20_OVL_COOKIE)
+        fclose (o->base);
+        o->base = base;
+        return SCPE_OK;
+#else
+        fclose (base);                          /* temporary file is shared */
+        return SCPE_NOFNC;
+#endif
+    }
+
+    o = (M20_OVL *) calloc (1, sizeof(M20_OVL));
+    if (o == NULL) {
+        fclose (base);
+        return SCPE_MEM;
+    }
+    o->base = base;
+    o->f = ovl_open (o);
+    if (o->f == NULL) {
+        if (o->base) fclose (o->base);
+        free (o);
+        return SCPE_OPENERR;
+    }
+    fclose (uptr->fileref);                     /* flushed before fork */
+    uptr->fileref = o->f;
+    o->next = ovl_list;
+    ovl_list = o;
+    return SCPE_OK;
+}
+
+
+/*
+ *  Detach unit, written pages of overlay go into base if commit
+ */
+t_stat m20_ovl_detach (UNIT * uptr, int commit)
+{
+    M20_OVL * o;
+    t_stat s, r = SCPE_OK;
+
+    if (!(uptr->flags & UNIT_ATT) || ((o = ovl_find (uptr->fileref)) == NULL))
+        return detach_unit (uptr);
+
+    if ((uptr->flags & UNIT_BUF) && uptr->filebuf && uptr->hwmark) {
+        rewind (uptr->fileref);                 /* drum image (att -m) goes into overlay */
+        fxwrite (uptr->filebuf, sizeof(t_value), uptr->hwmark, uptr->fileref);
+    }
+    if (ferror (uptr->fileref) || fflush (uptr->fileref)) r = SCPE_IOERR;
+
+    if (commit && (r == SCPE_OK)) {
+        sim_messagef (SCPE_OK, "%s: writing overlay to file: %s\n", sim_uname (uptr), uptr->filename);
+        r = ovl_commit (o, uptr->filename);
+    }
+
+    uptr->flags |= UNIT_RO;                     /* buffer is already written */
+    s = detach_unit (uptr);
+    uptr->flags &= ~UNIT_RO;
+#if !defined(M20_OVL_COOKIE)
+    ovl_unlink (o);
+    free (o);
+#endif
+    return (r != SCPE_OK) ? r : s;
+}
@@ -32,19 +32,19 @@ const char *sim_stop_messages[] = {
 	"訡 ⥭ ࠡ",			/* Drum read error */
 	"ୠ  ⥭ ࠡ",		/* Invalid drum read length */
 	"ୠ   ࠡ",		/* Invalid drum write length */
-	"訡  ࠡ",			/* Drum write error */
-	"୮   饭  ࠡ", 	/* Invalid drum control word */
+	"஫쭠 窠 ",			/* Watchpoint */
+	"⨣ ᫮ ",			/* Instruction count reached */
 	"⥭ 樠஢ ࠡ", 	/* Reading uninialized drum data */
-	"୮   饭  ",		/* Invalid tape control word */
+	"宦  ୠ",			/* Run differs from journal */
 	"୮   ࠧ⪨ ",		/* Invalid tape format word */
 	"  ⭮ ⮩  ॠ",	/* Tape not implemented */
 	"⪠ ⭮   ॠ",	/* Tape formatting not implemented */
 	"뢮  䮪  ॠ",		/* Punch not implemented */
-	"  䮪  ॠ",		/* Punch reader not implemented */
+	"ணࠬ HLE 室  樥",	/* HLE verify failed */
 	"୮ ",					/* Invalid control word */
 	" 㬥 ",			/* Invalid argument of instruction */
 	"⠭  ᮢ",			/* Assertion failed */
-	"   ࠡ⠥  ",		/* MB instruction without MA */
+	"⮩ 横 (᪨ ⠭)",		/* idle loop */
 	"譨 ன⢠  ন",         /* External devices i/o not implemented */
         "뢠饥 ன⢮ ",                 /* Card reader empty */
 	"   ࠡ⠥  ᮢ",           /* CR instruction without CA */
@@ -34,19 +34,19 @@ const char *sim_stop_messages[] = {
 	"  ",			/* Drum read error */
 	"   ",		/* Invalid drum read length */
 	"   ",		/* Invalid drum write length */
-	"  ",			/* Drum write error */
-	"     ", 	/* Invalid drum control word */
+	"  ",			/* Watchpoint */
+	"  ",			/* Instruction count reached */
 	"  ", 	/* Reading uninialized drum data */
-	"     ",		/* Invalid tape control word */
+	"  ",			/* Run differs from journal */
 	"    ",		/* Invalid tape format word */
 	"     ",	/* Tape not implemented */
 	"    ",	/* Tape formatting not implemented */
 	"    ",		/* Punch not implemented */
-	"    ",		/* Punch reader not implemented */
+	" HLE   ",	/* HLE verify failed */
 	" ",					/* Invalid control word */
 	"  ",			/* Invalid argument of instruction */
 	"  ",			/* Assertion failed */
-	"     ",		/* MB instruction without MA */
+	"  ( )",		/* idle loop */
 	"   ",         /* External devices i/o not implemented */
         "  ",                 /* Card reader empty */
 	"     ",           /* CR instruction without CA */
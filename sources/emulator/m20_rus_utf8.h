@@ -32,19 +32,19 @@ const char *sim_stop_messages[] = {
 	"Ошибка чтения барабана",			/* Drum read error */
 	"Неверная длина чтения барабана",		/* Invalid drum read length */
 	"Неверная длина записи барабана",		/* Invalid drum write length */
-	"Ошибка записи барабана",			/* Drum write error */
-	"Неверное УЧ для обращения к барабану", 	/* Invalid drum control word */
+	"Контрольная точка МОЗУ",			/* Watchpoint */
+	"Достигнуто число команд",			/* Instruction count reached */
 	"Чтение неинициализированного барабана", 	/* Reading uninialized drum data */
-	"Неверное УЧ для обращения к ленте",		/* Invalid tape control word */
+	"Расхождение с журналом",			/* Run differs from journal */
 	"Неверное УЧ для разметки ленты",		/* Invalid tape format word */
 	"Обмен с магнитной лентой не реализован",	/* Tape not implemented */
 	"Разметка магнитной ленты не реализована",	/* Tape formatting not implemented */
 	"Вывод на перфокарты не реализован",		/* Punch not implemented */
-	"Ввод с перфокарт не реализован",		/* Punch reader not implemented */
+	"Подпрограмма HLE расходится с интерпретацией",	/* HLE verify failed */
 	"Неверное УЧ",					/* Invalid control word */
 	"Неверный аргумент команды",			/* Invalid argument of instruction */
 	"Останов по несовпадению",			/* Assertion failed */
-	"Команда МБ не работает без МА",		/* MB instruction without MA */
+	"Холостой цикл (динамический останов)",		/* idle loop */
 	"Внешние устройства не поддерживаются",         /* External devices i/o not implemented */
         "Считывающее устройство пусто",                 /* Card reader empty */
 	"Команда ЧУ не работает без адресов",           /* CR instruction without CA */
@@ -32,6 +32,7 @@
  *  21-Dec-2014  DVS  Added opcode and modifiers for cpu trace output
  *  20-Jul-2021  LOY  Updated some definitions for new SIMH version (CONST)
  *  11-Mar-2025  LOY  Add some more const in declarations, as in SIMH declarations
+ *  18-Oct-2026  AGT  Binary memory image (LOAD -B, DUMP -B [-R]), start address in text dump
  *
  */
 
@@ -61,6 +62,8 @@ extern int   debug_dump_mem;
 extern t_value mosu_load (int addr);
 extern void mosu_store (int addr, t_value val);
 
+extern void put_rval (REG *rptr, uint32 idx, t_value val);	/* scp.c */
+
 
 extern const char *m20_opname [M20_SYM_OPCODE_TABLE_SIZE];
 extern const char *m20_short_opname [M20_SYM_OPCODE_TABLE_SIZE];
@@ -381,6 +384,101 @@ t_stat m20_dump (FILE *of, char *fnam)
 		    (int) (cmd >> BITS_0)  & MAX_ADDR_VALUE);
    }
 
+   fprintf (of, "\n@%04o\n", regKRA);
+
+   return SCPE_OK;
+}
+
+
+
+/*
+ *  Load memory from binary image.
+ */
+t_stat m20_load_image (FILE *input)
+{
+   M20_IMAGE_HDR hdr;
+   M20_IMAGE_RANGE range;
+   t_value buf[MAX_MEM_SIZE];
+   uint32 i, n, count;
+
+   if (fread (&hdr, sizeof(hdr), 1, input) != 1) return SCPE_FMT;
+   if (memcmp (hdr.magic, M20_IMAGE_MAGIC, sizeof(hdr.magic)) != 0) return SCPE_FMT;
+   if (hdr.version != M20_IMAGE_VERSION) return SCPE_FMT;
+   if (hdr.start >= MAX_MEM_SIZE) return SCPE_FMT;
+
+   for (n=0; n<hdr.ranges; ++n) {
+      if (fread (&range, sizeof(range), 1, input) != 1) return SCPE_FMT;
+      if (range.addr >= MAX_MEM_SIZE || range.count > MAX_MEM_SIZE - range.addr) return SCPE_FMT;
+      if (fread (buf, sizeof(t_value), range.count, input) != range.count) return SCPE_FMT;
+      for (i=0; i<range.count; ++i)
+         mosu_store (range.addr + i, buf[i] & WORD45);
+   }
+
+   regKRA = hdr.start;
+
+   if (hdr.flags & M20_IMAGE_REGS) {
+      if (fread (&count, sizeof(count), 1, input) != 1) return SCPE_FMT;
+      if (count != M20_IMAGE_REG_COUNT) return SCPE_FMT;
+      if (fread (buf, sizeof(t_value), count, input) != count) return SCPE_FMT;
+      for (i=0; i<count; ++i)
+         put_rval (&cpu_reg[i], 0, buf[i]);
+   }
+
+   return SCPE_OK;
+}
+
+
+
+/*
+ *  Dump memory to binary image: ranges of non-zero words,
+ *  with regs flag (DUMP -B -R) CPU registers too.
+ */
+t_stat m20_dump_image (FILE *of, int regs)
+{
+   M20_IMAGE_HDR hdr;
+   M20_IMAGE_RANGE range[MAX_MEM_SIZE/2];
+   t_value mem[MAX_MEM_SIZE];
+   uint32 i, n, count, last = 0;
+
+   for (i=1; i<MAX_MEM_SIZE; ++i)
+      mem[i] = mosu_load(i);
+
+   /* Zero words are skipped, short gaps stay inside range */
+   n = 0;
+   for (i=1; i<MAX_MEM_SIZE; ++i) {
+      if (mem[i] == 0) continue;
+      if (n > 0 && i - last <= M20_IMAGE_GAP)
+         range[n-1].count = i - range[n-1].addr + 1;
+      else {
+         range[n].addr = i;
+         range[n].count = 1;
+         ++n;
+      }
+      last = i;
+   }
+
+   memset (&hdr, 0, sizeof(hdr));
+   memcpy (hdr.magic, M20_IMAGE_MAGIC, sizeof(hdr.magic));
+   hdr.version = M20_IMAGE_VERSION;
+   hdr.flags = regs ? M20_IMAGE_REGS : 0;
+   hdr.start = regKRA;
+   hdr.ranges = n;
+   if (fwrite (&hdr, sizeof(hdr), 1, of) != 1) return SCPE_IOERR;
+
+   for (i=0; i<n; ++i) {
+      if (fwrite (&range[i], sizeof(range[i]), 1, of) != 1) return SCPE_IOERR;
+      if (fwrite (&mem[range[i].addr], sizeof(t_value), range[i].count, of) != range[i].count)
+         return SCPE_IOERR;
+   }
+
+   if (regs) {
+      count = M20_IMAGE_REG_COUNT;
+      for (i=0; i<count; ++i)
+         mem[i] = get_rval (&cpu_reg[i], 0);
+      if (fwrite (&count, sizeof(count), 1, of) != 1) return SCPE_IOERR;
+      if (fwrite (mem, sizeof(t_value), count, of) != count) return SCPE_IOERR;
+   }
+
    return SCPE_OK;
 }
 
@@ -389,10 +487,15 @@ t_stat m20_dump (FILE *of, char *fnam)
 
 
 /*
- *  Loader/dumper
+ *  Loader/dumper (-B binary image, -R with CPU registers)
  */
 t_stat sim_load (FILE *fi, CONST char *cptr, CONST char *fnam, int dump_flag)
 {
+    if (sim_switches & SWMASK ('B')) {
+        if (dump_flag) return m20_dump_image (fi, (sim_switches & SWMASK ('R')) != 0);
+        return m20_load_image (fi);
+    }
+
     if (dump_flag) return m20_dump (fi, fnam);
 
     return m20_load (fi);
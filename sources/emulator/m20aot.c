@@ -0,0 +1,482 @@
+/*
+ * File:     m20aot.c
+ * Purpose:  Translate M-20 program to C blocks for AOT engine of emulator
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Program is loaded by emulator itself (libm20), then control flow is
+ * followed from start address: every basic block found becomes C function
+ * executing its instructions with the same handlers as interpreter
+ * (m20_cpu.c), with decode and dispatch done here. Output file is built
+ * into emulator:
+ *
+ *   ./m20aot -i prog.m20 -o prog_aot.c
+ *   make -f makefile.unx m20x AOT=prog_aot.c
+ *   ./m20x, set cpu aot
+ *
+ * Only jumps by untagged address are followed (-e adds entry points).
+ * Zero word is instruction too (00: move 0 to 0), block ends only at jump,
+ * stop, I/O, word with bits above 45 or word not loaded by program.
+ * Instructions which are address of store by untagged instruction are
+ * taken from memory at run time. I/O instructions are left to interpreter.
+ * Emulator runs block only while its words match the program, store into
+ * block drops it (see cpu_run_aot).
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *  18-Oct-2026  AGT  Zero words are translated, not taken for empty memory
+ *
+ */
+
+
+#include "m20lib.h"
+
+#if _WIN32
+#include "getopt.h"
+#else
+#include <unistd.h>
+#endif
+
+
+/*------------------------------- GNU C library -----------------------------*/
+#if _WIN32
+extern int       opterr;
+extern int       optind;
+extern char     *optarg;
+#endif
+
+
+#define  MAX_CMD_BUF_SIZE  2048
+#define  AOT_BLOCK_MAX     64           /* CPU_BLOCK_MAX of m20_cpu.c */
+
+#define  OP(w)     ((int)((w) >> BITS_36 & MAX_OPCODE_VALUE))
+#define  TAGS(w)   ((int)((w) >> BITS_42 & MAX_ADDR_TAG_VALUE))
+#define  A1(w)     ((int)((w) >> BITS_24 & MAX_ADDR_VALUE))
+#define  A2(w)     ((int)((w) >> BITS_12 & MAX_ADDR_VALUE))
+#define  A3(w)     ((int)((w) >> BITS_0  & MAX_ADDR_VALUE))
+
+/* Local data */
+
+extern  int        optind;
+extern  int        opterr;
+extern  char     * optarg;
+
+char         * out_file = NULL;
+char         * in_file = NULL;
+int           verbose = 0;
+int           start_addr = -1;
+
+t_value       mem[MAX_MEM_SIZE];
+char          loaded[MAX_MEM_SIZE];     /* word is set by program file */
+int           block_len[MAX_MEM_SIZE];  /* translated block at address */
+char          queued[MAX_MEM_SIZE];
+char          is_code[MAX_MEM_SIZE];    /* word of translated block */
+char          is_var[MAX_MEM_SIZE];     /* word is stored into */
+int           queue[MAX_MEM_SIZE];
+int           nqueue = 0;
+
+const char prog_ver[] = "1.0.0";
+const char rcs_id[] = "$Id$";
+
+
+
+
+/*----------------------- Functions ---------------------------------------*/
+
+
+/*
+ *  Print help screen
+ */
+void usage(void)
+{
+  fprintf( stderr, "\n" );
+  fprintf( stderr, "Translate M-20 program to C for AOT engine of emulator, version %s\n", prog_ver );
+  fprintf( stderr, "Usage: m20aot [-hv] [-s start] [-e entry]... [-i in-file] [-o out-file]\n" );
+  fprintf( stderr, "       -h   this help\n" );
+  fprintf( stderr, "       -v   verbose output\n" );
+  fprintf( stderr, "       -s   start address, octal (default: @ of file)\n" );
+  fprintf( stderr, "       -e   more entry address, octal (jump by RA, data as code)\n" );
+  fprintf( stderr, "Input is M-20 format file or binary memory image.\n" );
+  fprintf( stderr, "Sample command line:\n" );
+  fprintf( stderr, "   ./m20aot -i prog.m20 -o prog_aot.c\n" );
+  fprintf( stderr, "   make -f makefile.unx m20x AOT=prog_aot.c\n" );
+  fprintf( stderr, "\n" );
+  exit(1);
+}
+
+
+
+/*
+ *  Check binary image header
+ */
+int is_image( const char * fname )
+{
+  FILE * fp;
+  char   magic[sizeof(M20_IMAGE_MAGIC)-1];
+  int    ret = 0;
+
+  fp = fopen( fname, "rb" );
+  if (fp == NULL) return -1;
+  if (fread( magic, sizeof(magic), 1, fp ) == 1)
+    ret = (memcmp( magic, M20_IMAGE_MAGIC, sizeof(magic) ) == 0);
+  fclose( fp );
+  return ret;
+}
+
+
+
+/*
+ *  Octal address from option
+ */
+int get_addr( const char * s )
+{
+  char * end;
+  long   addr;
+
+  addr = strtol( s, &end, 8 );
+  if ((*s == '\0') || (*end != '\0') || (addr < 0) || (addr > MAX_ADDR_VALUE)) {
+    fprintf( stderr, "ERROR: bad address %s!\n", s );
+    exit(1);
+  }
+  return (int)addr;
+}
+
+
+
+/*
+ *  Queue block entry
+ */
+void add_entry( int addr )
+{
+  if ((addr <= 0) || (addr >= MAX_MEM_SIZE) || queued[addr]) return;
+  queued[addr] = 1;
+  queue[nqueue++] = addr;
+}
+
+
+
+/*
+ *  Instruction ending block (cpu_block_end of m20_cpu.c):
+ *  1 - block ends after it, 2 - I/O, left to interpreter
+ */
+int block_end( int op )
+{
+  switch (op) {
+    case OPCODE_JUMP_WITH_RETURN:
+    case OPCODE_JUMP_BY_ADDR:
+    case OPCODE_COND_JUMP_BY_SIG_W_1:
+    case OPCODE_COND_JUMP_BY_SIG_W_0:
+    case OPCODE_GOTO_AFTER_CYCLE_BY_PA_012:
+    case OPCODE_GOTO_AFTER_CYCLE_BY_PA_032:
+    case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_011:
+    case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_031:
+    case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_051:
+    case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_071:
+    case OPCODE_STOP_017:
+    case OPCODE_STOP_037:
+    case OPCODE_STOP_057:
+    case OPCODE_STOP_077:
+         return 1;
+    case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS_WITH_STOP:
+    case OPCODE_INPUT_CODES_FROM_PUNCH_CARDS:
+    case OPCODE_IO_EXT_DEV_TO_MEM_050:
+    case OPCODE_IO_EXT_DEV_TO_MEM_070:
+         return 2;
+  }
+  return 0;
+}
+
+
+
+/*
+ *  Next addresses after last instruction of block
+ */
+void add_successors( int addr )
+{
+  t_value w = mem[addr];
+  int     op = OP(w);
+
+  switch (op) {
+    case OPCODE_JUMP_BY_ADDR:
+         break;
+    case OPCODE_JUMP_WITH_RETURN:               /* return comes to a1 */
+         if (!(TAGS(w) & 4)) add_entry( A1(w) );
+         break;
+    default:                                    /* condition not met, stop */
+         add_entry( addr + 1 );
+         break;
+  }
+  if ((op != OPCODE_STOP_017) && (op != OPCODE_STOP_037) &&
+      (op != OPCODE_STOP_057) && (op != OPCODE_STOP_077) &&
+      !(TAGS(w) & 2))
+    add_entry( A2(w) );
+}
+
+
+
+/*
+ *  Follow control flow from queued entries
+ */
+void find_blocks( void )
+{
+  int start, addr, len, end;
+
+  while (nqueue > 0) {
+    start = queue[--nqueue];
+    len = 0;
+    for (addr = start; addr < MAX_MEM_SIZE; addr++) {
+      if (!loaded[addr] || (mem[addr] & ~WORD45))
+        break;                                  /* not program, not instruction */
+      end = block_end( OP(mem[addr]) );
+      if (end == 2) {
+        if (len == 0) add_entry( addr + 1 );
+        else add_entry( addr );
+        break;
+      }
+      is_code[addr] = 1;
+      len++;
+      if (end) {
+        add_successors( addr );
+        break;
+      }
+      if (len >= AOT_BLOCK_MAX) {
+        add_entry( addr + 1 );
+        break;
+      }
+    }
+    block_len[start] = len;
+  }
+}
+
+
+
+/*
+ *  Words of blocks which are stored into: address modification
+ */
+void find_variable( void )
+{
+  int addr, op;
+
+  for (addr = 0; addr < MAX_MEM_SIZE; addr++) {
+    if (!is_code[addr]) continue;
+    op = OP(mem[addr]);
+    switch (op) {                               /* no store to a3 */
+      case OPCODE_GOTO_AFTER_CYCLE_BY_PA_012:
+      case OPCODE_GOTO_AFTER_CYCLE_BY_PA_032:
+      case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_011:
+      case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_1_031:
+      case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_051:
+      case OPCODE_GOTO_AFTER_CYCLE_BY_PA_SIG_W_0_071:
+           continue;
+    }
+    if (!(TAGS(mem[addr]) & 1)) is_var[A3(mem[addr])] = 1;
+  }
+}
+
+
+
+/*
+ *  Effective address as C expression
+ */
+const char * ea_expr( char * buf, int a, int tag )
+{
+  if (tag) sprintf( buf, "AOT_RA (%05o)", a );
+  else sprintf( buf, "%05o", a );
+  return buf;
+}
+
+
+
+/*
+ *  C function of block
+ */
+void write_block( FILE * fp, int start )
+{
+  int     i, len = block_len[start];
+  t_value w;
+  char    e1[32], e2[32], e3[32];
+
+  fprintf( fp, "/* %04o-%04o */\n", start, start + len - 1 );
+
+  fprintf( fp, "static const t_value aot_code_%04o[%d] = {\n", start, len );
+  for (i = 0; i < len; i++)
+    fprintf( fp, "    0%" LL_FMT "oLL,\n", (t_uint64)mem[start+i] );
+  fprintf( fp, "};\n" );
+
+  fprintf( fp, "static const M20_DECODED_INST aot_di_%04o[%d] = {\n", start, len );
+  for (i = 0; i < len; i++) {
+    w = mem[start+i];
+    fprintf( fp, "    { NULL, 1, %03o, %o, %05o, %05o, %05o },\n",
+             OP(w), TAGS(w), A1(w), A2(w), A3(w) );
+  }
+  fprintf( fp, "};\n" );
+
+  fprintf( fp, "static t_stat aot_%04o (PCPU_LOOP_STATE ls)\n{\n", start );
+  fprintf( fp, "    AOT_BEGIN (aot_di_%04o);\n", start );
+  for (i = 0; i < len; i++) {
+    w = mem[start+i];
+    if (is_var[start+i])
+      fprintf( fp, "    AOT_VINST (%05o, %d, %03o, %o);\n",
+               start + i, i, OP(w), TAGS(w) );
+    else
+      fprintf( fp, "    AOT_INST  (%05o, %d, %03o, %s, %s, %s);\n",
+               start + i, i, OP(w),
+               ea_expr( e1, A1(w), TAGS(w) & 4 ),
+               ea_expr( e2, A2(w), TAGS(w) & 2 ),
+               ea_expr( e3, A3(w), TAGS(w) & 1 ) );
+  }
+  fprintf( fp, "    AOT_END;\n}\n\n" );
+}
+
+
+
+/*
+ *  Translated program: blocks and their table
+ */
+int write_file( FILE * fp, int * ninst )
+{
+  int     addr, i, nblocks = 0;
+  t_uint64 vmask;
+
+  *ninst = 0;
+  for (addr = 0; addr < MAX_MEM_SIZE; addr++) {
+    if (block_len[addr] == 0) continue;
+    nblocks++;
+    *ninst += block_len[addr];
+  }
+
+  fprintf( fp, "/*\n" );
+  fprintf( fp, " * %s translated by m20aot %s, start %04o\n", in_file, prog_ver, start_addr );
+  fprintf( fp, " * %d blocks, %d instructions\n", nblocks, *ninst );
+  fprintf( fp, " *\n" );
+  fprintf( fp, " * Built into emulator: make -f makefile.unx m20x AOT=%s\n", out_file );
+  fprintf( fp, " */\n\n" );
+
+  for (addr = 0; addr < MAX_MEM_SIZE; addr++)
+    if (block_len[addr]) write_block( fp, addr );
+
+  fprintf( fp, "static const M20_AOT_BLOCK cpu_aot_table[%d] = {\n", nblocks );
+  for (addr = 0; addr < MAX_MEM_SIZE; addr++) {
+    if (block_len[addr] == 0) continue;
+    vmask = 0;
+    for (i = 0; i < block_len[addr]; i++)
+      if (is_var[addr+i]) vmask |= (t_uint64)1 << i;
+    fprintf( fp, "    { %05o, %2d, 0x%016" LL_FMT "xULL, aot_code_%04o, aot_%04o },\n",
+             addr, block_len[addr], vmask, addr, addr );
+  }
+  fprintf( fp, "};\n" );
+
+  return nblocks;
+}
+
+
+
+/*
+ *  Main program stream
+ */
+int main( int argc, char ** argv )
+{
+  int                 ret_code = 0;
+  int                 op;
+  int                 in_image;
+  int                 addr, nblocks, ninst;
+  t_stat              r;
+  M20_MACHINE *       m;
+  FILE *              fp;
+  char                cmd[MAX_CMD_BUF_SIZE];
+
+/* Process command line  */
+  opterr = 0;
+  while( (op = getopt(argc,argv,"vhi:o:s:e:")) != -1)
+    switch(op) {
+      case 's':
+               start_addr = get_addr( optarg );
+               break;
+      case 'e':
+               add_entry( get_addr( optarg ) );
+               break;
+      case 'o':
+               out_file = optarg;
+               break;
+      case 'i':
+               in_file = optarg;
+               break;
+      case 'v':
+               verbose = 1;
+               break;
+      case 'h':
+               usage();
+               break;
+      default:
+               break;
+    }
+
+  if ((out_file == NULL) || (in_file == NULL)) {
+       usage();
+  }
+
+  in_image = is_image( in_file );
+  if (in_image < 0) {
+    fprintf( stderr, "ERROR: cannot open file %s!\n", in_file );
+    return(10);
+  }
+
+  if (m20lib_init() != SCPE_OK || (m = m20lib_create()) == NULL) {
+    fprintf( stderr, "ERROR: cannot start emulator!\n" );
+    return(12);
+  }
+
+  _snprintf( cmd, sizeof(cmd)-1, "LOAD %s\"%s\"", in_image ? "-B " : "", in_file );
+  cmd[sizeof(cmd)-1] = '\0';
+  if (verbose) fprintf( stderr, "%s\n", cmd );
+  r = m20lib_command( m, cmd );
+  if (r != SCPE_OK) {
+    fprintf( stderr, "ERROR: cannot load file %s: %s!\n", in_file, m20lib_message(r) );
+    ret_code = 10;
+    goto all_done;
+  }
+
+  for (addr = 0; addr < MAX_MEM_SIZE; addr++)
+    mem[addr] = m20lib_read( m, addr );
+  if (start_addr < 0) start_addr = m20lib_kra( m );
+
+  /* load again over ones: words left zero and ones are not in file */
+  for (addr = 1; addr < MAX_MEM_SIZE; addr++)
+    m20lib_write( m, addr, WORD45 );
+  r = m20lib_command( m, cmd );
+  for (addr = 0; (r == SCPE_OK) && (addr < MAX_MEM_SIZE); addr++)
+    loaded[addr] = (mem[addr] != 0) || (m20lib_read( m, addr ) != WORD45);
+
+  add_entry( start_addr );
+
+  find_blocks();
+  find_variable();
+  for (addr = 0; (addr < MAX_MEM_SIZE) && (block_len[addr] == 0); addr++) ;
+  if (addr == MAX_MEM_SIZE) {
+    fprintf( stderr, "ERROR: no instructions to translate at %04o!\n", start_addr );
+    ret_code = 10;
+    goto all_done;
+  }
+
+  fp = fopen( out_file, "w" );
+  if (fp == NULL) {
+    fprintf( stderr, "ERROR: cannot create file %s!\n", out_file );
+    ret_code = 11;
+    goto all_done;
+  }
+  nblocks = write_file( fp, &ninst );
+  if (fclose( fp ) != 0) {
+    fprintf( stderr, "ERROR: cannot write file %s!\n", out_file );
+    ret_code = 11;
+    goto all_done;
+  }
+  if (verbose) fprintf( stderr, "%s: %d blocks, %d instructions\n", out_file, nblocks, ninst );
+
+all_done:
+  m20lib_destroy( m );
+
+  return(ret_code);
+}
@@ -0,0 +1,176 @@
+/*
+ * File:     m20img.c
+ * Purpose:  Convert M-20 format file to binary memory image and back
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Conversion is done by emulator itself (libm20): file is loaded into
+ * memory of machine and dumped in other format, so text and binary image
+ * always give the same memory contents and start address.
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *
+ */
+
+
+#include "m20lib.h"
+
+#if _WIN32
+#include "getopt.h"
+#else
+#include <unistd.h>
+#endif
+
+
+/*------------------------------- GNU C library -----------------------------*/
+#if _WIN32
+extern int       opterr;
+extern int       optind;
+extern char     *optarg;
+#endif
+
+
+#define  MAX_CMD_BUF_SIZE  2048
+
+/* Local data */
+
+extern  int        optind;
+extern  int        opterr;
+extern  char     * optarg;
+
+char         * out_file = NULL;
+char         * in_file = NULL;
+int           verbose = 0;
+int           to_text = -1;
+
+const char prog_ver[] = "1.0.0";
+const char rcs_id[] = "$Id$";
+
+
+
+
+/*----------------------- Functions ---------------------------------------*/
+
+
+/*
+ *  Print help screen
+ */
+void usage(void)
+{
+  fprintf( stderr, "\n" );
+  fprintf( stderr, "Convert M-20 format file to binary memory image and back, version %s\n", prog_ver );
+  fprintf( stderr, "Usage: m20img [-hvbt] [-i in-file] [-o out-file]\n" );
+  fprintf( stderr, "       -h   this help\n" );
+  fprintf( stderr, "       -v   verbose output\n" );
+  fprintf( stderr, "       -b   write binary image (default for text input)\n" );
+  fprintf( stderr, "       -t   write M-20 format text (default for binary input)\n" );
+  fprintf( stderr, "Sample command line:\n" );
+  fprintf( stderr, "   ./m20img -i test.m20 -o test.m20b\n" );
+  fprintf( stderr, "   ./m20img -i test.m20b -o test.m20\n" );
+  fprintf( stderr, "\n" );
+  exit(1);
+}
+
+
+
+/*
+ *  Check binary image header
+ */
+int is_image( const char * fname )
+{
+  FILE * fp;
+  char   magic[sizeof(M20_IMAGE_MAGIC)-1];
+  int    ret = 0;
+
+  fp = fopen( fname, "rb" );
+  if (fp == NULL) return -1;
+  if (fread( magic, sizeof(magic), 1, fp ) == 1)
+    ret = (memcmp( magic, M20_IMAGE_MAGIC, sizeof(magic) ) == 0);
+  fclose( fp );
+  return ret;
+}
+
+
+
+/*
+ *  Main program stream
+ */
+int main( int argc, char ** argv )
+{
+  int                 ret_code = 0;
+  int                 op;
+  int                 in_image;
+  t_stat              r;
+  M20_MACHINE *       m;
+  char                cmd[MAX_CMD_BUF_SIZE];
+
+/* Process command line  */
+  opterr = 0;
+  while( (op = getopt(argc,argv,"vhbti:o:")) != -1)
+    switch(op) {
+      case 'b':
+               to_text = 0;
+               break;
+      case 't':
+               to_text = 1;
+               break;
+      case 'o':
+               out_file = optarg;
+               break;
+      case 'i':
+               in_file = optarg;
+               break;
+      case 'v':
+               verbose = 1;
+               break;
+      case 'h':
+               usage();
+               break;
+      default:
+               break;
+    }
+
+  if ((out_file == NULL) || (in_file == NULL)) {
+       usage();
+  }
+
+  in_image = is_image( in_file );
+  if (in_image < 0) {
+    fprintf( stderr, "ERROR: cannot open file %s!\n", in_file );
+    return(10);
+  }
+  if (to_text < 0) to_text = in_image;
+
+  if (m20lib_init() != SCPE_OK || (m = m20lib_create()) == NULL) {
+    fprintf( stderr, "ERROR: cannot start emulator!\n" );
+    return(12);
+  }
+
+  _snprintf( cmd, sizeof(cmd)-1, "LOAD %s\"%s\"", in_image ? "-B " : "", in_file );
+  cmd[sizeof(cmd)-1] = '\0';
+  if (verbose) fprintf( stderr, "%s\n", cmd );
+  r = m20lib_command( m, cmd );
+  if (r != SCPE_OK) {
+    fprintf( stderr, "ERROR: cannot load file %s: %s!\n", in_file, m20lib_message(r) );
+    ret_code = 10;
+    goto all_done;
+  }
+
+  _snprintf( cmd, sizeof(cmd)-1, "DUMP %s\"%s\"", to_text ? "" : "-B ", out_file );
+  cmd[sizeof(cmd)-1] = '\0';
+  if (verbose) fprintf( stderr, "%s\n", cmd );
+  r = m20lib_command( m, cmd );
+  if (r != SCPE_OK) {
+    fprintf( stderr, "ERROR: cannot create file %s: %s!\n", out_file, m20lib_message(r) );
+    ret_code = 11;
+  }
+
+all_done:
+  m20lib_destroy( m );
+
+  return(ret_code);
+}
@@ -0,0 +1,460 @@
+/*
+ * File:     m20lib.c
+ * Purpose:  M-20 emulator as embeddable library (libm20)
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Library is linked with SCP compiled without main() (scp_lib.o),
+ * see makefile target 'lib'. Machine state is kept in M20_MACHINE
+ * (cpu_state_save() and device *_state_save()) while other machine
+ * is selected.
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *
+ */
+
+
+#include "m20lib.h"
+
+#if _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+
+#define M20_TMP_FILES   16                      /* images from memory per machine */
+#define M20_RUN_CHUNK   0x7fffffff              /* instructions per sim_instr() call */
+
+
+struct m20_machine {
+    M20_CPU_STATE    cpu;
+    M20_DRUM_STATE   drum;
+    M20_MT_STATE     mt;
+    M20_CD_STATE     cd;
+    M20_LP_STATE     lp;
+    t_uint64         count;                     /* instructions executed */
+    double           time;                      /* emulated time */
+    char           * tmp_files[M20_TMP_FILES];  /* images attached from memory */
+};
+
+
+/* external references (SCP) */
+extern t_stat sim_brk_init (void);
+extern t_stat detach_all (int32 start_device, t_bool shutdown);
+
+/* external references (CPU module) */
+extern uint16  regKRA;
+extern int     print_sys_stat;
+extern int     print_stat_on_break;
+
+extern t_stat cpu_examine (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
+extern t_stat cpu_deposit (t_value val, t_addr addr, UNIT *uptr, int32 sw);
+
+extern UNIT  cpu_unit;
+extern UNIT  drum_unit[];
+
+
+/* Local data */
+
+static int            m20lib_ready = 0;
+static M20_MACHINE    m20_power_on;             /* state after initial reset */
+static M20_MACHINE  * m20_selected = NULL;      /* machine in emulator globals */
+
+#if _WIN32
+static CRITICAL_SECTION  m20_lock;
+#define M20_LOCK()       EnterCriticalSection (&m20_lock)
+#define M20_UNLOCK()     LeaveCriticalSection (&m20_lock)
+#else
+static pthread_mutex_t   m20_lock = PTHREAD_MUTEX_INITIALIZER;
+#define M20_LOCK()       pthread_mutex_lock (&m20_lock)
+#define M20_UNLOCK()     pthread_mutex_unlock (&m20_lock)
+#endif
+
+
+
+
+/*----------------------- Functions ---------------------------------------*/
+
+
+/*
+ *  Copy emulator globals to machine
+ */
+static void m20_state_save (M20_MACHINE * m)
+{
+    cpu_state_save (&m->cpu);
+    drum_state_save (&m->drum);
+    mt_state_save (&m->mt);
+    cd_state_save (&m->cd);
+    lp_state_save (&m->lp);
+}
+
+
+/*
+ *  Copy machine to emulator globals
+ */
+static void m20_state_restore (const M20_MACHINE * m)
+{
+    cpu_state_restore (&m->cpu);
+    drum_state_restore (&m->drum);
+    mt_state_restore (&m->mt);
+    cd_state_restore (&m->cd);
+    lp_state_restore (&m->lp);
+}
+
+
+/*
+ *  Make machine selected (called under lock)
+ */
+static void m20_select (M20_MACHINE * m)
+{
+    if (m20_selected == m) return;
+
+    if (m20_selected != NULL) m20_state_save (m20_selected);
+    m20_state_restore (m);
+    m20_selected = m;
+}
+
+
+/*
+ *  Initialize SCP and devices like main() of SCP does, without console
+ */
+t_stat m20lib_init (void)
+{
+    t_stat r;
+
+    if (m20lib_ready) return SCPE_OK;
+
+#if _WIN32
+    InitializeCriticalSection (&m20_lock);
+#endif
+
+    sim_finit ();
+    if (sim_timer_init ()) return SCPE_IERR;
+    if (sim_emax <= 0) sim_emax = 1;
+    sim_eval = (t_value *) calloc (sim_emax, sizeof(t_value));
+    if (sim_eval == NULL) return SCPE_MEM;
+    if (sim_dflt_dev == NULL) sim_dflt_dev = sim_devices[0];
+
+    r = reset_all_p (0);
+    if (r != SCPE_OK) return r;
+    r = sim_brk_init ();
+    if (r != SCPE_OK) return r;
+
+    /* no profile printed on stop */
+    print_sys_stat = 0;
+    print_stat_on_break = 0;
+
+    m20_state_save (&m20_power_on);
+    m20lib_ready = 1;
+
+    return SCPE_OK;
+}
+
+
+/*
+ *  Text of stop code
+ */
+const char * m20lib_message (t_stat r)
+{
+    if (r < SCPE_BASE) return sim_stop_messages[r] ? sim_stop_messages[r] : "Unknown stop code";
+
+    return sim_error_text (r);
+}
+
+
+/*
+ *  New machine in power on state
+ */
+M20_MACHINE * m20lib_create (void)
+{
+    M20_MACHINE * m;
+
+    if (!m20lib_ready) return NULL;
+
+    m = (M20_MACHINE *) malloc (sizeof(M20_MACHINE));
+    if (m == NULL) return NULL;
+
+    memcpy (m, &m20_power_on, sizeof(M20_MACHINE));
+    return m;
+}
+
+
+/*
+ *  Detach units of machine, remove images from memory and free machine
+ */
+void m20lib_destroy (M20_MACHINE * m)
+{
+    int i;
+
+    if (m == NULL) return;
+
+    M20_LOCK ();
+    m20_select (m);
+    detach_all (0, FALSE);
+    m20_selected = NULL;
+    M20_UNLOCK ();
+
+    for (i = 0; i < M20_TMP_FILES; i++) {
+        if (m->tmp_files[i] == NULL) continue;
+        remove (m->tmp_files[i]);
+        free (m->tmp_files[i]);
+    }
+    free (m);
+}
+
+
+/*
+ *  Execute SCP command for machine: SET, ATTACH, DETACH, DEPOSIT, EXAMINE, LOAD, RESET...
+ *  Use m20lib_run() and m20lib_boot() instead of RUN, GO and BOOT.
+ */
+t_stat m20lib_command (M20_MACHINE * m, const char * cmd)
+{
+    char gbuf[CBUFSIZE];
+    CONST char * cptr;
+    CTAB * cmdp;
+    t_stat r;
+
+    cptr = get_glyph (cmd, gbuf, 0);
+    cmdp = find_cmd (gbuf);
+    if (cmdp == NULL) return SCPE_UNK;
+
+    M20_LOCK ();
+    m20_select (m);
+    sim_switches = 0;
+    r = cmdp->action (cmdp->arg, cptr);
+    M20_UNLOCK ();
+
+    return r;
+}
+
+
+/*
+ *  Load memory image (.m20)
+ */
+t_stat m20lib_load (M20_MACHINE * m, const char * file)
+{
+    char cmd[CBUFSIZE];
+
+    _snprintf (cmd, sizeof(cmd), "LOAD \"%s\"", file);
+    return m20lib_command (m, cmd);
+}
+
+
+/*
+ *  Attach file to unit (DRUM0, MT1, CDR, LPT...)
+ */
+t_stat m20lib_attach (M20_MACHINE * m, const char * unit, const char * file)
+{
+    char cmd[CBUFSIZE];
+
+    _snprintf (cmd, sizeof(cmd), "ATTACH %s \"%s\"", unit, file);
+    return m20lib_command (m, cmd);
+}
+
+
+/*
+ *  Attach image from memory buffer.
+ *  Image is copied to temporary file removed by m20lib_destroy();
+ *  drum image is kept in memory (att -m), see m20lib_drum_image().
+ */
+t_stat m20lib_attach_mem (M20_MACHINE * m, const char * unit, const void * buf, size_t size)
+{
+    char cmd[CBUFSIZE];
+    char * name;
+    FILE * f;
+    int i;
+#if !_WIN32
+    int fd;
+#endif
+
+    for (i = 0; (i < M20_TMP_FILES) && m->tmp_files[i]; i++);
+    if (i == M20_TMP_FILES) return SCPE_MEM;
+
+#if _WIN32
+    name = _tempnam (NULL, "m20");
+    if (name == NULL) return SCPE_OPENERR;
+    f = fopen (name, "wb");
+#else
+    name = (char *) malloc (CBUFSIZE);
+    if (name == NULL) return SCPE_MEM;
+    _snprintf (name, CBUFSIZE, "%s/m20lib-XXXXXX", getenv ("TMPDIR") ? getenv ("TMPDIR") : "/tmp");
+    fd = mkstemp (name);
+    f = (fd < 0) ? NULL : fdopen (fd, "wb");
+#endif
+    if (f == NULL) {
+        free (name);
+        return SCPE_OPENERR;
+    }
+    m->tmp_files[i] = name;
+
+    if (fwrite (buf, 1, size, f) != size) {
+        fclose (f);
+        return SCPE_IOERR;
+    }
+    if (fclose (f)) return SCPE_IOERR;
+
+    _snprintf (cmd, sizeof(cmd), "ATTACH %s%s \"%s\"",
+               (sim_strncasecmp (unit, "DRUM", 4) == 0) ? "-M " : "", unit, name);
+    return m20lib_command (m, cmd);
+}
+
+
+/*
+ *  Boot from unit (CDR) like BOOT command, without run
+ */
+t_stat m20lib_boot (M20_MACHINE * m, const char * unit)
+{
+    DEVICE * dptr;
+    UNIT * uptr;
+    t_stat r;
+    char gbuf[CBUFSIZE];
+
+    get_glyph (unit, gbuf, 0);                      /* upper case, as in commands */
+    M20_LOCK ();
+    m20_select (m);
+    dptr = find_unit (gbuf, &uptr);
+    if ((dptr == NULL) || (uptr == NULL)) r = SCPE_NXDEV;
+    else if (dptr->boot == NULL) r = SCPE_NOFNC;
+    else {
+        r = reset_all (0);
+        if (r == SCPE_OK) r = dptr->boot ((int32) (uptr - dptr->units), dptr);
+    }
+    M20_UNLOCK ();
+
+    return r;
+}
+
+
+/*
+ *  Run count instructions from KRA (0 - until stop).
+ *  Returns stop code, SCPE_STOP if count is done.
+ */
+t_stat m20lib_run (M20_MACHINE * m, t_uint64 count)
+{
+    t_stat r;
+    int32 chunk, done;
+    int until_stop;
+    double t;
+
+    M20_LOCK ();
+    m20_select (m);
+    t = sim_gtime ();
+    until_stop = (count == 0);
+
+    for (;;) {
+        chunk = (until_stop || (count > M20_RUN_CHUNK)) ? M20_RUN_CHUNK : (int32) count;
+        sim_step = chunk;
+        r = sim_instr ();
+        done = chunk - sim_step;
+        m->count += done;
+        if (r != SCPE_STOP) break;
+        if (until_stop) continue;
+        count -= done;
+        if (count == 0) break;
+    }
+
+    sim_step = 0;
+    sim_flush_buffered_files ();                    /* as after RUN: outputs are on disk */
+    m->time += sim_gtime () - t;
+    M20_UNLOCK ();
+
+    return r;
+}
+
+
+/*
+ *  Read memory word (as EXAMINE)
+ */
+t_value m20lib_read (M20_MACHINE * m, int addr)
+{
+    t_value val = 0;
+
+    M20_LOCK ();
+    m20_select (m);
+    cpu_examine (&val, (t_addr) addr, &cpu_unit, 0);
+    M20_UNLOCK ();
+
+    return val;
+}
+
+
+/*
+ *  Write memory word (as DEPOSIT)
+ */
+t_stat m20lib_write (M20_MACHINE * m, int addr, t_value val)
+{
+    t_stat r;
+
+    M20_LOCK ();
+    m20_select (m);
+    r = cpu_deposit (val, (t_addr) addr, &cpu_unit, 0);
+    M20_UNLOCK ();
+
+    return r;
+}
+
+
+/*
+ *  Instruction address register
+ */
+int m20lib_kra (M20_MACHINE * m)
+{
+    int kra;
+
+    M20_LOCK ();
+    kra = (m20_selected == m) ? regKRA : m->cpu.kra;
+    M20_UNLOCK ();
+
+    return kra;
+}
+
+
+void m20lib_set_kra (M20_MACHINE * m, int addr)
+{
+    M20_LOCK ();
+    if (m20_selected == m) regKRA = (uint16) (addr & MAX_ADDR_VALUE);
+    else m->cpu.kra = (uint16) (addr & MAX_ADDR_VALUE);
+    M20_UNLOCK ();
+}
+
+
+/*
+ *  Instructions executed and emulated time (us) by m20lib_run()
+ */
+t_uint64 m20lib_count (M20_MACHINE * m)
+{
+    return m->count;
+}
+
+
+double m20lib_time (M20_MACHINE * m)
+{
+    return m->time;
+}
+
+
+/*
+ *  Drum image kept in memory (att -m), NULL if not attached so.
+ *  Valid until next call for this machine.
+ */
+const t_value * m20lib_drum_image (M20_MACHINE * m, int unit, uint32 * words)
+{
+    UNIT * uptr;
+    const t_value * image;
+
+    if ((unit < 0) || (unit >= MAX_PHYS_DRUM_COUNT)) return NULL;
+
+    M20_LOCK ();
+    uptr = (m20_selected == m) ? &drum_unit[unit] : &m->drum.unit[unit];
+    image = (uptr->flags & UNIT_BUF) ? (const t_value *) uptr->filebuf : NULL;
+    if (words) *words = image ? uptr->hwmark : 0;
+    M20_UNLOCK ();
+
+    return image;
+}
@@ -0,0 +1,75 @@
+/*
+ * File:     m20lib.h
+ * Purpose:  M-20 emulator as embeddable library (libm20)
+ *
+ * Copyright (c) 2026, agent
+ *
+ * $Id$
+ *
+ * Any number of M-20 machines in one process. Every machine has its own
+ * memory, registers, device switches and attached units (drums, tapes,
+ * card reader and punch, printer). Emulator core keeps the selected
+ * machine in its globals, library exchanges them on every call for
+ * another machine (32K words memory copy), so run machines by reasonable
+ * count of instructions.
+ *
+ * Calls are serialized by one lock: machines may be driven from any
+ * thread of a pool, but only one of them runs at a time. Debug switches
+ * (SET CPU DEBUG, DEBUG_DUMP_*, trace filter, ring trace) and breakpoints
+ * are common for all machines. For parallel runs on several CPUs use
+ * processes (scripts/m20batch.sh).
+ *
+ * Sample:
+ *
+ *   M20_MACHINE * m;
+ *   t_stat r;
+ *
+ *   m20lib_init ();
+ *   m = m20lib_create ();
+ *   m20lib_attach_mem (m, "DRUM0", image, sizeof(image));
+ *   m20lib_load (m, "prog.m20");
+ *   m20lib_set_kra (m, 1);
+ *   r = m20lib_run (m, 100000);              (SCPE_STOP - count is done)
+ *   printf ("%s, KRA: %04o\n", m20lib_message (r), m20lib_kra (m));
+ *   m20lib_destroy (m);
+ *
+ * Build: make -f makefile.unx lib, compile users with the same -DUSE_INT64
+ * and link with libm20.a -lm -lpthread.
+ *
+ * Revision History.
+ *
+ *  18-Oct-2026  AGT  Initial Implemementation
+ *
+ */
+
+#ifndef _M20LIB_H_
+#define _M20LIB_H_    0
+
+#include "m20_defs.h"
+
+typedef struct m20_machine M20_MACHINE;
+
+/* Library */
+t_stat         m20lib_init (void);
+const char *   m20lib_message (t_stat r);
+
+/* Machine */
+M20_MACHINE *  m20lib_create (void);
+void           m20lib_destroy (M20_MACHINE * m);
+t_stat         m20lib_command (M20_MACHINE * m, const char * cmd);
+t_stat         m20lib_load (M20_MACHINE * m, const char * file);
+t_stat         m20lib_attach (M20_MACHINE * m, const char * unit, const char * file);
+t_stat         m20lib_attach_mem (M20_MACHINE * m, const char * unit, const void * buf, size_t size);
+t_stat         m20lib_boot (M20_MACHINE * m, const char * unit);
+t_stat         m20lib_run (M20_MACHINE * m, t_uint64 count);
+
+/* State */
+t_value        m20lib_read (M20_MACHINE * m, int addr);
+t_stat         m20lib_write (M20_MACHINE * m, int addr, t_value val);
+int            m20lib_kra (M20_MACHINE * m);
+void           m20lib_set_kra (M20_MACHINE * m, int addr);
+t_uint64       m20lib_count (M20_MACHINE * m);
+double         m20lib_time (M20_MACHINE * m);
+const t_value * m20lib_drum_image (M20_MACHINE * m, int unit, uint32 * words);
+
+#endif
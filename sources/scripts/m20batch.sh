@@ -0,0 +1,263 @@
+#!/usr/bin/env bash
+#
+# Run M-20 jobs from a manifest in parallel processes.
+#
+# Usage: m20batch.sh [-j jobs] [-t timeout] [-d run-dir] [-x junit.xml] [-s summary.json] m20 manifest
+#
+# Manifest: one job per line, '#' starts a comment.
+#
+#   name  script  [key=value ...]
+#   default       [key=value ...]      (defaults for the following jobs)
+#
+# Keys:
+#   files=a,b,...      files copied into the job directory besides the script
+#                      (card decks, .m20 loads, drum and tape images)
+#   stop=message       expected stop message (default: Breakpoint)
+#   kra=oooo           expected KRA at the stop (octal)
+#   out=file:sha256    expected SHA-256 of an output file (printer, punch, tape),
+#                      may be given several times
+#   timeout=seconds    wall time limit of the job
+#
+# File names are relative to the manifest directory. Each job runs in its own
+# directory, images are copied with 'cp --reflink=auto' (copy-on-write where
+# the file system allows it), so jobs never share or modify the originals.
+#
+
+JOBS="$(nproc 2>/dev/null || echo 2)"
+TIMEOUT=60
+RUN_DIR=""
+JUNIT_FILE=""
+JSON_FILE=""
+
+function usage() {
+  echo "Usage: $0 [-j jobs] [-t timeout] [-d run-dir] [-x junit.xml] [-s summary.json] m20 manifest"
+  exit 1
+}
+
+while getopts "j:t:d:x:s:h" opt; do
+  case "$opt" in
+    j) JOBS="$OPTARG" ;;
+    t) TIMEOUT="$OPTARG" ;;
+    d) RUN_DIR="$OPTARG" ;;
+    x) JUNIT_FILE="$OPTARG" ;;
+    s) JSON_FILE="$OPTARG" ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[[ $# == 2 ]] || usage
+
+readonly M20="$(realpath "$1")"
+readonly MANIFEST="$(realpath "$2")"
+readonly BASE_DIR="$(dirname "$MANIFEST")"
+
+if ! [[ -x $M20 ]]; then
+  echo "The emulator executable not found: $M20"
+  exit 1
+fi
+
+if ! [[ -f $MANIFEST ]]; then
+  echo "Manifest not found: $MANIFEST"
+  exit 1
+fi
+
+if [[ -z $RUN_DIR ]]; then
+  RUN_DIR="$(mktemp -d -t "batch-$(date +%Y-%m-%d-%H-%M-%S)-XXXXXXXXXX" --tmpdir="${TMPDIR:-/tmp}")"
+fi
+mkdir -p "$RUN_DIR/results" || exit 1
+RUN_DIR="$(realpath "$RUN_DIR")"
+
+# Copy-on-write copies if cp supports them
+CP="cp"
+if cp --reflink=auto "$MANIFEST" "$RUN_DIR/.reflink" 2>/dev/null; then
+  CP="cp --reflink=auto"
+fi
+rm -f "$RUN_DIR/.reflink"
+
+# Format error message
+function error() {
+  local message="$1"
+  echo "$(tput setaf 1 2>/dev/null)$(tput bold 2>/dev/null)$message$(tput sgr0 2>/dev/null)"
+}
+
+# Format success message
+function success() {
+  local message="$1"
+  echo "$(tput setaf 2 2>/dev/null)$(tput bold 2>/dev/null)$message$(tput sgr0 2>/dev/null)"
+}
+
+# Escape string for XML and JSON
+function xml_escape() {
+  sed -e 's/&/\&amp;/g' -e 's/</\&lt;/g' -e 's/>/\&gt;/g' -e 's/"/\&quot;/g' <<< "$1"
+}
+
+function json_escape() {
+  sed -e 's/\\/\\\\/g' -e 's/"/\\"/g' -e 's/\t/\\t/g' <<< "$1"
+}
+
+# Run one job: index name script files stop kra outs timeout
+# Result line: name status wall emul_us stop kra details (separated by \x1f)
+function run_job() {
+  local index="$1" name="$2" script="$3" files="$4" stop="$5" kra="$6" outs="$7" limit="$8"
+  local job_dir="$RUN_DIR/$name"
+  local status="passed" details="" f start end wall rc line got_stop got_kra emul spec file hash
+
+  mkdir -p "$job_dir"
+  for f in "$script" ${files//,/ }; do
+    if ! $CP "$BASE_DIR/$f" "$job_dir/" 2>/dev/null; then
+      status="error"
+      details="cannot copy $f"
+    fi
+  done
+
+  if [[ $status == passed ]]; then
+    # Change windows 'del' command to unix 'rm' equivalent
+    sed -ri 's/^! del/! rm -f/' "$job_dir/$(basename "$script")"
+    start="$(date +%s.%N)"
+    (cd "$job_dir" && timeout --foreground "$limit" "$M20" "$(basename "$script")" > console.txt 2>&1 < /dev/null)
+    rc=$?
+    end="$(date +%s.%N)"
+    wall="$(awk "BEGIN { printf \"%.3f\", $end - $start }")"
+
+    line="$(grep -a -E '^[^ ].*, KRA: [0-7]+' "$job_dir/console.txt" | tail -1)"
+    got_stop="${line%%, KRA:*}"
+    got_kra="$(sed -nE 's/.*, KRA: ([0-7]+).*/\1/p' <<< "$line")"
+    emul="$(grep -a 'Summary:  times=' "$job_dir/console.txt" | tail -1 | sed -E 's/.*times=([0-9.]+).*/\1/')"
+
+    if [[ $rc == 124 ]]; then
+      status="error"
+      details="timeout after ${limit}s"
+    elif [[ $rc != 0 ]]; then
+      status="error"
+      details="exit code $rc"
+    elif [[ $got_stop != "$stop" ]]; then
+      status="failed"
+      details="stop '$got_stop', expected '$stop'"
+    elif [[ -n $kra && ( -z $got_kra || $((8#$got_kra)) != $((8#$kra)) ) ]]; then
+      status="failed"
+      details="KRA $got_kra, expected $kra"
+    else
+      for spec in $outs; do
+        file="${spec%%:*}"
+        hash="$(sha256sum "$job_dir/$file" 2>/dev/null | cut -d' ' -f1)"
+        if [[ $hash != "${spec#*:}" ]]; then
+          status="failed"
+          details="$file sha256 ${hash:-missing}"
+          break
+        fi
+      done
+    fi
+  fi
+
+  printf "%s\x1f%s\x1f%s\x1f%s\x1f%s\x1f%s\x1f%s\n" "$name" "$status" "${wall:-0}" "${emul:-0}" \
+         "$got_stop" "$got_kra" "$details" > "$RUN_DIR/results/$index"
+  if [[ $status == passed ]]; then
+    echo "$name ... $(success SUCCESS) (${wall}s)"
+  else
+    echo "$name ... $(error "${status^^}") $details"
+  fi
+}
+
+echo "RUN BATCH"
+echo
+echo "M-20 Emulator:     $M20"
+echo "Manifest:          $MANIFEST"
+echo "Run Directory:     $RUN_DIR"
+echo "Parallel Jobs:     $JOBS"
+echo
+
+# Parse manifest and start jobs
+def_files="" def_stop="Breakpoint" def_kra="" def_outs="" def_timeout="$TIMEOUT"
+index=0
+running=0
+batch_start="$(date +%s.%N)"
+while read -r name rest; do
+  [[ -z $name || $name == \#* ]] && continue
+  files="$def_files" stop="$def_stop" kra="$def_kra" outs="$def_outs" limit="$def_timeout"
+  script=""
+  for kv in $rest; do
+    case "$kv" in
+      files=*)   files="${files:+$files,}${kv#files=}" ;;
+      stop=*)    stop="${kv#stop=}" ;;
+      kra=*)     kra="${kv#kra=}" ;;
+      out=*)     outs="$outs ${kv#out=}" ;;
+      timeout=*) limit="${kv#timeout=}" ;;
+      *)         script="$kv" ;;
+    esac
+  done
+  if [[ $name == default ]]; then
+    def_files="$files" def_stop="$stop" def_kra="$kra" def_outs="$outs" def_timeout="$limit"
+    continue
+  fi
+  [[ -n $script ]] || { echo "$name: no script in manifest"; exit 1; }
+
+  index=$((index + 1))
+  run_job "$(printf "%05d" $index)" "$name" "$script" "$files" "$stop" "$kra" "$outs" "$limit" < /dev/null &
+  running=$((running + 1))
+  if (( running >= JOBS )); then
+    wait -n
+    running=$((running - 1))
+  fi
+done < <(sed 's/#.*//' "$MANIFEST")
+wait
+batch_end="$(date +%s.%N)"
+batch_wall="$(awk "BEGIN { printf \"%.3f\", $batch_end - $batch_start }")"
+
+# Summary
+TOTAL=0 FAILED=0 ERRORS=0
+for r in "$RUN_DIR"/results/*; do
+  [[ -f $r ]] || continue
+  IFS=$'\x1f' read -r name status wall emul got_stop got_kra details < "$r"
+  TOTAL=$((TOTAL + 1))
+  [[ $status == failed ]] && FAILED=$((FAILED + 1))
+  [[ $status == error ]] && ERRORS=$((ERRORS + 1))
+done
+
+if [[ -n $JSON_FILE ]]; then
+  {
+    echo "{"
+    echo "  \"manifest\": \"$(json_escape "$MANIFEST")\","
+    echo "  \"jobs\": $TOTAL, \"failed\": $FAILED, \"errors\": $ERRORS, \"wall_s\": $batch_wall,"
+    echo "  \"results\": ["
+    sep=""
+    for r in "$RUN_DIR"/results/*; do
+      [[ -f $r ]] || continue
+      IFS=$'\x1f' read -r name status wall emul got_stop got_kra details < "$r"
+      echo -n "$sep"
+      echo -n "    { \"name\": \"$(json_escape "$name")\", \"status\": \"$status\", \"wall_s\": $wall,"
+      echo -n " \"emulated_us\": $emul, \"stop\": \"$(json_escape "$got_stop")\", \"kra\": \"$got_kra\","
+      echo -n " \"details\": \"$(json_escape "$details")\" }"
+      sep=$',\n'
+    done
+    echo
+    echo "  ]"
+    echo "}"
+  } > "$JSON_FILE"
+fi
+
+if [[ -n $JUNIT_FILE ]]; then
+  {
+    echo "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    echo "<testsuite name=\"m20batch\" tests=\"$TOTAL\" failures=\"$FAILED\" errors=\"$ERRORS\" time=\"$batch_wall\">"
+    for r in "$RUN_DIR"/results/*; do
+      [[ -f $r ]] || continue
+      IFS=$'\x1f' read -r name status wall emul got_stop got_kra details < "$r"
+      echo "  <testcase classname=\"m20batch\" name=\"$(xml_escape "$name")\" time=\"$wall\">"
+      echo "    <properties><property name=\"emulated_us\" value=\"$emul\"/><property name=\"kra\" value=\"$got_kra\"/></properties>"
+      if [[ $status == failed ]]; then
+        echo "    <failure message=\"$(xml_escape "$details")\"/>"
+      elif [[ $status == error ]]; then
+        echo "    <error message=\"$(xml_escape "$details")\"/>"
+      fi
+      echo "  </testcase>"
+    done
+    echo "</testsuite>"
+  } > "$JUNIT_FILE"
+fi
+
+echo
+echo "Executed $TOTAL jobs in ${batch_wall}s, $(success "$((TOTAL - FAILED - ERRORS)) success"), $(error "$FAILED failed"), $(error "$ERRORS errors")"
+
+if [[ $FAILED != 0 || $ERRORS != 0 ]]; then
+  exit 1
+fi